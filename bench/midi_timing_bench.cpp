@@ -0,0 +1,234 @@
+// Timing benchmark for MidiPlayer. Plays synthetic dense sequences into an
+// in-process loopback output and reports how late each event would reach a
+// device, plus how often the playback thread woke. Needs no MIDI hardware.
+//
+//   midi_timing_bench [seconds per scenario] [p99 gate in ms]
+//
+// With a gate, exits with 1 when any scenario's p99 lateness exceeds it.
+// Also exits with 1 when pausing and resuming plays a note twice or drops one.
+
+#include "midi_player.h"
+#include "porttime.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+double steadyMicroseconds() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stands in for a PortMidi output: records every event with the time it
+// was handed over, on a microsecond clock aligned to Pt_Time
+class LoopbackSink : public MidiOutputSink {
+public:
+    struct Delivery {
+        PmEvent event;
+        double writtenUs; // Pt_Time base
+    };
+
+    LoopbackSink() {
+        // Pt_Time only has ms resolution; align on the edge where it ticks
+        const PtTimestamp start = Pt_Time();
+        while (Pt_Time() == start) {}
+        m_originUs = steadyMicroseconds() - Pt_Time() * 1000.0;
+    }
+
+    void write(const PmEvent* events, int32_t count) override {
+        const double now = steadyMicroseconds() - m_originUs;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int32_t i = 0; i < count; ++i) {
+            m_deliveries.push_back({events[i], now});
+        }
+    }
+
+    std::vector<Delivery> take() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<Delivery> deliveries;
+        deliveries.swap(m_deliveries);
+        return deliveries;
+    }
+
+private:
+    double m_originUs;
+    std::mutex m_mutex;
+    std::vector<Delivery> m_deliveries;
+};
+
+struct Scenario {
+    std::string name;
+    std::vector<MidiEvent> events;
+};
+
+void addNote(std::vector<MidiEvent>& events, double time, double duration, uint8_t channel, uint8_t note) {
+    events.push_back({time, 0, static_cast<uint8_t>(0x90 | channel), note, 100, 0});
+    events.push_back({time + duration, 0, static_cast<uint8_t>(0x80 | channel), note, 0, 0});
+}
+
+void sortEvents(std::vector<MidiEvent>& events) {
+    std::stable_sort(events.begin(), events.end(), [](const MidiEvent& a, const MidiEvent& b) {
+        return a.time < b.time;
+    });
+}
+
+// 32nd notes at 300 BPM: one every 25 ms
+Scenario thirtySecondRuns(double seconds) {
+    Scenario scenario{"32nd-note run, 300 BPM", {}};
+    const double step = 60.0 / 300.0 / 8.0;
+    for (int i = 0; i * step < seconds; ++i) {
+        addNote(scenario.events, i * step, step * 0.8, 0, static_cast<uint8_t>(48 + i % 24));
+    }
+    sortEvents(scenario.events);
+    return scenario;
+}
+
+// 48-note chords on every beat at 240 BPM, all struck at once
+Scenario largeChords(double seconds) {
+    Scenario scenario{"48-note chords, 240 BPM", {}};
+    const double beat = 60.0 / 240.0;
+    for (int i = 0; i * beat < seconds; ++i) {
+        for (int voice = 0; voice < 48; ++voice) {
+            addNote(scenario.events, i * beat, beat * 0.8, static_cast<uint8_t>(voice % 16),
+                    static_cast<uint8_t>(36 + voice));
+        }
+    }
+    sortEvents(scenario.events);
+    return scenario;
+}
+
+// 16 voices of 32nd runs at 300 BPM, staggered by 1 ms
+Scenario staggeredRuns(double seconds) {
+    Scenario scenario{"16 staggered 32nd runs", {}};
+    const double step = 60.0 / 300.0 / 8.0;
+    for (int voice = 0; voice < 16; ++voice) {
+        for (int i = 0; i * step < seconds; ++i) {
+            addNote(scenario.events, i * step + voice * 0.001, step * 0.8, static_cast<uint8_t>(voice),
+                    static_cast<uint8_t>(40 + (i + voice) % 48));
+        }
+    }
+    sortEvents(scenario.events);
+    return scenario;
+}
+
+struct Result {
+    size_t events = 0;
+    double meanLateMs = 0.0;
+    double p99LateMs = 0.0;
+    double maxLateMs = 0.0;
+    double minLeadMs = 0.0;      // Least time an event was written ahead of its due time
+    double wakeupsPerSecond = 0.0;
+};
+
+Result run(MidiPlayer& player, LoopbackSink& sink, const Scenario& scenario) {
+    auto events = std::make_shared<const std::vector<MidiEvent>>(scenario.events);
+    player.setEvents(events);
+    sink.take();
+
+    const uint64_t wakeups = player.wakeupCount();
+    const auto started = std::chrono::steady_clock::now();
+    player.play();
+    while (!player.isPlaying()) std::this_thread::yield();
+    while (player.isPlaying()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    // Leave out the player's own All Notes Off / Reset All Controllers
+    std::vector<LoopbackSink::Delivery> deliveries;
+    for (const auto& delivery : sink.take()) {
+        const int status = Pm_MessageStatus(delivery.event.message);
+        if ((status & 0xF0) == 0xB0 && Pm_MessageData1(delivery.event.message) >= 120) continue;
+        deliveries.push_back(delivery);
+    }
+
+    Result result;
+    result.events = std::min(deliveries.size(), scenario.events.size());
+    result.wakeupsPerSecond = (player.wakeupCount() - wakeups) / elapsed;
+    if (result.events == 0) return result;
+
+    // The first event is stamped at the song start; every later one is due
+    // its song time after that. A device plays an event outputLatencyMs
+    // after its timestamp, or on arrival if that is later.
+    const double latencyUs = MidiPlayer::outputLatencyMs() * 1000.0;
+    const double startUs = deliveries[0].event.timestamp * 1000.0 - scenario.events[0].time * 1e6;
+    std::vector<double> lateness(result.events);
+    result.minLeadMs = 1e9;
+    for (size_t i = 0; i < result.events; ++i) {
+        const double dueUs = startUs + scenario.events[i].time * 1e6 + latencyUs;
+        const double playedUs = std::max(deliveries[i].event.timestamp * 1000.0 + latencyUs, deliveries[i].writtenUs);
+        lateness[i] = std::max(0.0, playedUs - dueUs) / 1000.0;
+        result.minLeadMs = std::min(result.minLeadMs, (dueUs - deliveries[i].writtenUs) / 1000.0);
+        result.meanLateMs += lateness[i];
+    }
+    result.meanLateMs /= result.events;
+    std::sort(lateness.begin(), lateness.end());
+    result.p99LateMs = lateness[std::min(lateness.size() - 1, static_cast<size_t>(lateness.size() * 0.99))];
+    result.maxLateMs = lateness.back();
+    if (deliveries.size() != scenario.events.size()) {
+        std::fprintf(stderr, "%s: %zu of %zu events delivered\n", scenario.name.c_str(), deliveries.size(),
+                     scenario.events.size());
+    }
+    return result;
+}
+
+size_t countNoteOns(const std::vector<LoopbackSink::Delivery>& deliveries) {
+    return std::count_if(deliveries.begin(), deliveries.end(), [](const LoopbackSink::Delivery& delivery) {
+        return (Pm_MessageStatus(delivery.event.message) & 0xF0) == 0x90 && Pm_MessageData2(delivery.event.message) > 0;
+    });
+}
+
+// Pauses halfway and resumes; every note must still play exactly once
+bool pauseAndResume(MidiPlayer& player, LoopbackSink& sink, const Scenario& scenario) {
+    auto events = std::make_shared<const std::vector<MidiEvent>>(scenario.events);
+    player.setEvents(events);
+    sink.take();
+
+    player.play();
+    while (!player.isPlaying()) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::duration<double>(scenario.events.back().time / 2));
+    player.pause();
+    while (player.isPlaying()) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    player.play();
+    while (!player.isPlaying()) std::this_thread::yield();
+    while (player.isPlaying()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    const size_t expected = std::count_if(scenario.events.begin(), scenario.events.end(), [](const MidiEvent& event) {
+        return (event.status & 0xF0) == 0x90 && event.data2 > 0;
+    });
+    const size_t played = countNoteOns(sink.take());
+    std::printf("%s, paused halfway: %zu of %zu note-ons\n", scenario.name.c_str(), played, expected);
+    return played == expected;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? std::max(0.5, std::atof(argv[1])) : 5.0;
+    const double gateMs = argc > 2 ? std::atof(argv[2]) : -1.0;
+
+    MidiPlayer player;
+    if (!player.initialize()) {
+        return 1;
+    }
+    auto sink = std::make_unique<LoopbackSink>();
+    LoopbackSink& loopback = *sink;
+    player.setOutputSink(std::move(sink));
+
+    const Scenario scenarios[] = {thirtySecondRuns(seconds), largeChords(seconds), staggeredRuns(seconds)};
+    std::printf("%-26s %8s %9s %9s %9s %9s %10s\n", "scenario", "events", "mean ms", "p99 ms", "max ms",
+                "lead ms", "wakeups/s");
+    bool passed = true;
+    for (const Scenario& scenario : scenarios) {
+        const Result result = run(player, loopback, scenario);
+        std::printf("%-26s %8zu %9.3f %9.3f %9.3f %9.3f %10.1f\n", scenario.name.c_str(), result.events,
+                    result.meanLateMs, result.p99LateMs, result.maxLateMs, result.minLeadMs, result.wakeupsPerSecond);
+        if (gateMs >= 0 && result.p99LateMs > gateMs) passed = false;
+    }
+    passed = pauseAndResume(player, loopback, scenarios[0]) && passed;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,295 @@
+// Streams G-code through GCodeSender into a scripted firmware stand-in on
+// a pseudo-terminal, so the protocol can be checked without a printer.
+// The stand-in buffers like a real board, checks line numbers and
+// checksums, asks for resends, and can corrupt lines and drop oks. It
+// reports what the sender saw and whether the commands it executed match
+// the program exactly, in order and without repeats.
+//
+//   serial_sender_bench [program.gcode]
+//
+// Exits with 1 when any scenario executes the wrong commands or overflows
+// the stand-in's serial buffer. POSIX only.
+
+#include "gcode_sender.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct FirmwareScript {
+    bool checksums = true;      // Expect N.../* and request resends like Marlin
+    bool okOnParse = false;     // Grbl acknowledges when a line is parsed, Marlin when it runs
+    size_t rxBufferBytes = 128; // Serial buffer; bytes beyond it would be lost on a real board
+    size_t queueDepth = 4;      // Parsed commands waiting to run
+    double commandTime = 0.0005; // Time to run one command (s); G4 P adds its dwell
+    size_t corruptEvery = 0;    // Flip a byte in every nth received line, 0 for never
+    size_t dropOkEvery = 0;     // Leave out every nth ok, 0 for never
+};
+
+struct FirmwareResult {
+    std::vector<std::string> executed; // Commands as run, without N and checksum
+    size_t maxRxBytes = 0;
+    size_t overflows = 0;
+    size_t corrupted = 0;
+    size_t droppedOks = 0;
+};
+
+// Plays the firmware end of the pty until told to stop
+class FirmwareStandIn {
+public:
+    FirmwareStandIn(int master, const FirmwareScript& script)
+        : m_master(master), m_script(script), m_stop(false), m_thread(&FirmwareStandIn::run, this) {}
+
+    // Runs out whatever is still queued first
+    FirmwareResult stop() {
+        m_stop = true;
+        m_thread.join();
+        return m_result;
+    }
+
+private:
+    void reply(const std::string& text) {
+        ssize_t written = ::write(m_master, text.data(), text.size());
+        (void)written;
+    }
+
+    void sendOk() {
+        if (m_script.dropOkEvery > 0 && ++m_oks % m_script.dropOkEvery == 0) {
+            ++m_result.droppedOks;
+            return;
+        }
+        reply("ok\n");
+    }
+
+    // Marlin flushes its serial buffer and asks for the line after the last good one
+    void requestResend(const char* error) {
+        m_rx.clear();
+        reply(std::string("Error:") + error + ", Last Line: " + std::to_string(m_lastLine) + "\nResend: " +
+              std::to_string(m_lastLine + 1) + "\nok\n");
+    }
+
+    // Returns the command if the line is good
+    bool parse(std::string line, std::string& command) {
+        ++m_received;
+        if (m_script.corruptEvery > 0 && m_received % m_script.corruptEvery == 0 && line.size() > 4) {
+            line[line.size() / 2] ^= 0x20;
+            ++m_result.corrupted;
+        }
+        if (!m_script.checksums) {
+            command = line;
+            return true;
+        }
+
+        const size_t star = line.rfind('*');
+        if (line.empty() || line[0] != 'N' || star == std::string::npos) {
+            requestResend("No Line Number with checksum");
+            return false;
+        }
+        uint8_t sum = 0;
+        for (size_t i = 0; i < star; ++i) sum ^= static_cast<uint8_t>(line[i]);
+        if (std::strtoul(line.c_str() + star + 1, nullptr, 10) != sum) {
+            requestResend("checksum mismatch");
+            return false;
+        }
+        const size_t space = line.find(' ');
+        const size_t number = std::strtoul(line.c_str() + 1, nullptr, 10);
+        command = line.substr(space + 1, star - space - 1);
+        if (command.rfind("M110", 0) == 0) {
+            m_lastLine = number;
+            return true;
+        }
+        if (number != m_lastLine + 1) {
+            requestResend("Line Number is not Last Line Number+1");
+            return false;
+        }
+        m_lastLine = number;
+        return true;
+    }
+
+    void run() {
+        reply("start\n");
+        auto busyUntil = Clock::now();
+        char buffer[512];
+        while (!m_stop || !m_queue.empty()) {
+            pollfd descriptor = {m_master, POLLIN, 0};
+            if (poll(&descriptor, 1, 1) > 0 && (descriptor.revents & POLLIN)) {
+                const ssize_t count = ::read(m_master, buffer, sizeof(buffer));
+                if (count > 0) {
+                    m_rx.append(buffer, static_cast<size_t>(count));
+                    m_result.maxRxBytes = std::max(m_result.maxRxBytes, m_rx.size());
+                    if (m_rx.size() > m_script.rxBufferBytes) ++m_result.overflows;
+                }
+            }
+
+            // Move whole lines out of the serial buffer while there is room
+            size_t end;
+            while (m_queue.size() < m_script.queueDepth && (end = m_rx.find('\n')) != std::string::npos) {
+                std::string line = m_rx.substr(0, end);
+                m_rx.erase(0, end + 1);
+                std::string command;
+                if (!parse(line, command)) continue;
+                if (command.rfind("M110", 0) == 0) {
+                    sendOk();
+                    continue;
+                }
+                m_queue.push_back(command);
+                if (m_script.okOnParse) sendOk();
+            }
+
+            const auto now = Clock::now();
+            if (!m_queue.empty() && now >= busyUntil) {
+                const std::string command = m_queue.front();
+                m_queue.erase(m_queue.begin());
+                m_result.executed.push_back(command);
+                double cost = m_script.commandTime;
+                if (command.rfind("G4 P", 0) == 0) cost += std::atof(command.c_str() + 4) / 1000.0;
+                busyUntil = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(cost));
+                if (!m_script.okOnParse) sendOk();
+            }
+        }
+    }
+
+    int m_master;
+    FirmwareScript m_script;
+    std::atomic<bool> m_stop;
+    std::string m_rx;
+    std::vector<std::string> m_queue;
+    size_t m_lastLine = 0;
+    size_t m_received = 0;
+    size_t m_oks = 0;
+    FirmwareResult m_result;
+    std::thread m_thread;
+};
+
+// A spiral of moves with the odd held note, like generated programs
+std::string syntheticProgram(size_t lines) {
+    std::ostringstream out;
+    out << "G21 ; Set units to millimeters\nG90 ; Absolute positioning\nG28 ; Home all axes\n";
+    for (size_t i = 0; i < lines; ++i) {
+        out << "G1 X" << (110 + (i % 90)) << "." << (i % 7) << " Y" << (110 + (i * 7) % 80) << ".25 Z"
+            << (5 + i % 12) << " F" << (600 + (i * 37) % 5400) << " ; Note " << (21 + i % 88) << "\n";
+        if (i % 25 == 0) out << "G4 P5 ; Hold note\n";
+    }
+    out << "M84 ; Disable motors\n";
+    return out.str();
+}
+
+// What the firmware should run: every line without its comment
+std::vector<std::string> expectedCommands(const std::string& program) {
+    std::vector<std::string> commands;
+    std::istringstream lines(program);
+    std::string line;
+    while (std::getline(lines, line)) {
+        line = line.substr(0, line.find(';'));
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) continue;
+        const size_t end = line.find_last_not_of(" \t\r");
+        commands.push_back(line.substr(begin, end - begin + 1));
+    }
+    return commands;
+}
+
+struct Scenario {
+    const char* name;
+    GCodeSenderConfig sender;
+    FirmwareScript firmware;
+};
+
+bool run(const Scenario& scenario, const std::string& program) {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::fprintf(stderr, "Could not create a pseudo-terminal\n");
+        return false;
+    }
+
+    GCodeSender sender(scenario.sender);
+    if (!sender.open(ptsname(master))) {
+        close(master);
+        return false;
+    }
+    // Only once the sender has put the port in raw mode, or the tty would echo
+    FirmwareStandIn firmware(master, scenario.firmware);
+    sender.send(program);
+    sender.finish();
+    const bool finished = sender.wait();
+    const FirmwareResult result = firmware.stop();
+    close(master);
+
+    const GCodeSenderStats stats = sender.stats();
+    std::vector<std::string> expected = expectedCommands(program);
+    if (!scenario.sender.checksums) {
+        expected.insert(expected.begin(), "G4 P0"); // The connect probe runs too
+    }
+    const bool matches = result.executed == expected;
+    if (!matches) {
+        const auto diverged = std::mismatch(result.executed.begin(), result.executed.end(), expected.begin(),
+                                            expected.end());
+        std::fprintf(stderr, "%s: command %zu ran '%s', expected '%s'\n", scenario.name,
+                     static_cast<size_t>(diverged.first - result.executed.begin()),
+                     diverged.first != result.executed.end() ? diverged.first->c_str() : "",
+                     diverged.second != expected.end() ? diverged.second->c_str() : "");
+    }
+    std::printf("%s\n%s", scenario.name, stats.summary().c_str());
+    std::printf("Firmware: %zu commands %s, serial buffer peak %zu of %zu bytes, %zu overflows, "
+                "%zu corrupted lines, %zu dropped oks\n\n",
+                result.executed.size(), matches ? "in order" : "DO NOT MATCH the program", result.maxRxBytes,
+                scenario.firmware.rxBufferBytes, result.overflows, result.corrupted, result.droppedOks);
+    if (!finished) {
+        std::fprintf(stderr, "%s: %s\n", scenario.name, sender.error().c_str());
+    }
+    return finished && matches && result.overflows == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string program;
+    if (argc > 1) {
+        std::ifstream file(argv[1]);
+        if (!file) {
+            std::fprintf(stderr, "Could not open %s\n", argv[1]);
+            return 1;
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        program = contents.str();
+    } else {
+        program = syntheticProgram(3000);
+    }
+
+    PrinterProfile marlin{};
+    marlin.dialect = FirmwareDialect::Marlin;
+    PrinterProfile grbl{};
+    grbl.dialect = FirmwareDialect::Grbl;
+
+    Scenario clean{"Marlin, clean link", GCodeSenderConfig::fromProfile(marlin), {}};
+
+    Scenario noisy{"Marlin, corrupted lines and lost oks", GCodeSenderConfig::fromProfile(marlin), {}};
+    noisy.sender.responseTimeout = 0.5;
+    noisy.firmware.corruptEvery = 97;
+    noisy.firmware.dropOkEvery = 701;
+
+    Scenario characterCounting{"Grbl, character counting", GCodeSenderConfig::fromProfile(grbl), {}};
+    characterCounting.firmware.checksums = false;
+    characterCounting.firmware.okOnParse = true;
+    characterCounting.firmware.queueDepth = 15;
+
+    bool passed = true;
+    for (const Scenario* scenario : {&clean, &noisy, &characterCounting}) {
+        passed = run(*scenario, program) && passed;
+    }
+    return passed ? 0 : 1;
+}
@@ -4,7 +4,13 @@
 #include <map>
 #include <filesystem>
 #include <fstream>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <nlohmann/json.hpp>
+#include "gcode_dialect.h"
 
 struct PrinterProfile {
     std::string name;
@@ -16,6 +22,10 @@ struct PrinterProfile {
     double jerk;
     double stepsPerMm;
     bool isCustom;
+    FirmwareDialect dialect = FirmwareDialect::Marlin;
+    double maxCommandRate = 100.0; // Sustainable G-code commands per second
+    double minSegmentTime = 0.02;  // Shortest move the planner handles well (s)
+    std::string thumbnails = "16x16/PNG, 220x124/PNG"; // Header previews, see parseThumbnailSpecs
 };
 
 class AppSettings {
@@ -26,7 +36,12 @@ public:
     }
 
     void loadSettings();
+    // Write the settings now and wait until they are on disk
     void saveSettings();
+    // Wait for any scheduled save to reach disk; call before exiting
+    void flush();
+    // Why the last save failed, empty if it succeeded
+    std::string getSaveError() const;
     
     // Getters
     const std::string& getOutputDirectory() const { return outputDirectory; }
@@ -37,30 +52,30 @@ public:
     // Setters
     void setOutputDirectory(const std::string& dir) { 
         outputDirectory = dir;
-        saveSettings();
+        scheduleSave();
     }
     
     void setCurrentPrinter(size_t index) {
         if (index < printerProfiles.size()) {
             currentPrinterIndex = index;
-            saveSettings();
+            scheduleSave();
         }
     }
     
     void setDarkMode(bool dark) {
         darkMode = dark;
-        saveSettings();
+        scheduleSave();
     }
     
     void addCustomPrinter(const PrinterProfile& profile) {
         printerProfiles.push_back(profile);
-        saveSettings();
+        scheduleSave();
     }
     
     void updateCustomPrinter(size_t index, const PrinterProfile& profile) {
         if (index < printerProfiles.size() && printerProfiles[index].isCustom) {
             printerProfiles[index] = profile;
-            saveSettings();
+            scheduleSave();
         }
     }
     
@@ -70,18 +85,49 @@ public:
             if (currentPrinterIndex >= printerProfiles.size()) {
                 currentPrinterIndex = 0;
             }
-            saveSettings();
+            scheduleSave();
         }
     }
 
 private:
     AppSettings();  // Private constructor for singleton
+    ~AppSettings();
     
+    // What gets persisted, copied on the UI thread so the writer never
+    // touches the live settings
+    struct Snapshot {
+        std::string outputDirectory;
+        bool darkMode;
+        size_t currentPrinterIndex;
+        std::vector<PrinterProfile> customPrinters;
+    };
+
+    // Changes within this window of each other are written once, but a
+    // steady stream of changes is still written this often
+    static constexpr std::chrono::milliseconds kSaveDebounce{500};
+    static constexpr std::chrono::milliseconds kMaxSaveDelay{2000};
+
     void initializeDefaultProfiles();
     std::string getSettingsPath() const;
+    // Hand the current settings to the writer thread; never blocks on disk
+    void scheduleSave();
+    void writerLoop();
+    bool writeSnapshot(const Snapshot& snapshot, std::string& error) const;
     
     std::string outputDirectory;
     std::vector<PrinterProfile> printerProfiles;
     size_t currentPrinterIndex;
     bool darkMode;
+
+    std::string settingsPath; // Resolved once, before the writer starts
+    std::thread writer;
+    mutable std::mutex saveMutex;
+    std::condition_variable saveCondition;
+    std::optional<Snapshot> pendingSave;        // Latest unsaved settings
+    std::chrono::steady_clock::time_point firstChange; // Of the pending save
+    std::chrono::steady_clock::time_point lastChange;
+    bool writing;          // The writer is between taking a snapshot and finishing its file
+    bool flushRequested;   // Skip the debounce for what is pending
+    bool stopWriter;
+    std::string saveError;
 };
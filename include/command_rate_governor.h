@@ -0,0 +1,44 @@
+#pragma once
+#include "midi_parser.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A stretch of the piece where the governor had to drop notes
+struct ThinnedRegion {
+    double startTime;     // Source time of the region start (s)
+    double endTime;       // Source time of the region end (s)
+    size_t notesDemanded; // Notes in the region before governing
+    size_t notesKept;     // Notes that survived
+};
+
+struct GovernorResult {
+    std::vector<MidiNote> notes;         // Surviving notes, still sorted by time
+    std::vector<size_t> sourceIndices;   // Index of each surviving note in the input
+    std::vector<ThinnedRegion> regions;  // Where notes were merged or dropped
+    size_t mergedNotes = 0;              // Dropped for falling inside the minimum segment time
+    size_t droppedNotes = 0;             // Dropped to stay within the command rate
+};
+
+// Keeps generated programs within what the firmware can execute in real time.
+// Notes closer together than the minimum segment time are merged into the most
+// prominent one, then every second of output time, wherever it starts, is
+// held to the sustainable command rate by keeping the loudest and longest notes.
+class CommandRateGovernor {
+public:
+    CommandRateGovernor(double maxCommandsPerSecond, double minSegmentTime, double dwellThreshold);
+
+    // timeScale maps source seconds to output seconds (NoteAnalysis::timeScale)
+    GovernorResult apply(const std::vector<MidiNote>& notes, double timeScale) const;
+
+    // Header comment lines summarizing what was thinned
+    std::string summarize(const GovernorResult& result, size_t maxRegions = 10) const;
+
+private:
+    double priority(const MidiNote& note) const;
+    size_t commandCost(const MidiNote& note) const;
+
+    double m_maxCommandsPerSecond;
+    double m_minSegmentTime; // Output time (s)
+    double m_dwellThreshold; // Notes longer than this also emit a dwell (s)
+};
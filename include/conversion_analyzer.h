@@ -0,0 +1,50 @@
+#pragma once
+#include "app_settings.h"
+#include "gcode_generator.h"
+#include "midi_parser.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks a converted program against its printer (print time estimate and
+// virtual printer run) and optionally renders the stepper audio, on a worker
+// thread so the window stays responsive. Only the latest job counts: a new
+// one replaces any still waiting, and superseded reports are never shown.
+class ConversionAnalyzer {
+public:
+    struct Job {
+        PrinterProfile printer;
+        std::vector<ToolMove> moves;
+        std::vector<MidiNote> notes; // The ones the moves were generated from
+        double timeScale = 1.0;
+        std::string gcode;
+        std::string audioPath;       // Empty for no audio
+    };
+
+    ConversionAnalyzer();
+    ~ConversionAnalyzer();
+    ConversionAnalyzer(const ConversionAnalyzer&) = delete;
+    ConversionAnalyzer& operator=(const ConversionAnalyzer&) = delete;
+
+    void start(Job job);
+    bool isBusy() const;
+    // Of the latest job once it finishes, empty until then
+    std::string report() const;
+
+private:
+    void workerLoop();
+    static std::string analyze(const Job& job);
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::unique_ptr<Job> m_pending; // Null when idle
+    bool m_stopWorker;
+    uint64_t m_generation;          // Of the latest job started
+    uint64_t m_reportGeneration;    // Of m_report
+    std::string m_report;
+};
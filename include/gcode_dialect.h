@@ -0,0 +1,188 @@
+#pragma once
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// Firmware flavours the generator can target. Stored per PrinterProfile.
+enum class FirmwareDialect {
+    Marlin,
+    Klipper,
+    RepRapFirmware,
+    Grbl
+};
+
+// Dialect policies. Each one spells the handful of commands that differ between
+// firmwares; GCodeGenerator is instantiated once per policy so the choice is
+// made at compile time instead of on every emitted line. Policies only append
+// to the stream and leave its formatting state as they found it.
+
+struct MarlinDialect {
+    static constexpr const char* name = "Marlin";
+    static constexpr bool hasHeaters = true;
+    static constexpr bool hasSubroutines = false;
+
+    static void writeUnits(std::ostream& out) {
+        out << "G21 ; Set units to millimeters\n";
+    }
+    static void writeMotionLimits(std::ostream& out, double acceleration, double jerk) {
+        out << "M204 P" << acceleration << " ; Set printing acceleration\n"
+            << "M205 X" << jerk << " Y" << jerk << " ; Set jerk\n";
+    }
+    static void writeHome(std::ostream& out) {
+        out << "G28 ; Home all axes\n";
+    }
+    static void writeDwell(std::ostream& out, double seconds) {
+        out << "G4 P" << (seconds * 1000) << " ; Hold note\n";
+    }
+    static void writeMotorsOff(std::ostream& out) {
+        out << "M84 ; Disable motors\n";
+    }
+};
+
+struct KlipperDialect {
+    static constexpr const char* name = "Klipper";
+    static constexpr bool hasHeaters = true;
+    static constexpr bool hasSubroutines = true;
+
+    static void writeUnits(std::ostream& out) {
+        out << "; Klipper always works in millimeters\n";
+    }
+    static void writeMotionLimits(std::ostream& out, double acceleration, double jerk) {
+        // Klipper has no jerk; square corner velocity is the closest equivalent
+        out << "SET_VELOCITY_LIMIT ACCEL=" << acceleration
+            << " SQUARE_CORNER_VELOCITY=" << jerk << " ; Set acceleration and cornering\n";
+    }
+    static void writeHome(std::ostream& out) {
+        out << "G28 ; Home all axes\n";
+    }
+    static void writeDwell(std::ostream& out, double seconds) {
+        out << "G4 P" << (seconds * 1000) << " ; Hold note\n";
+    }
+    static void writeMotorsOff(std::ostream& out) {
+        out << "M84 ; Disable motors\n";
+    }
+
+    // Phrase subroutines become gcode_macro sections in one config file that
+    // printer.cfg pulls in with [include <PREFIX>_phrases.cfg]; macro names
+    // and so the file name carry the prefix in upper case
+    static std::string subroutineName(const std::string& prefix, size_t id) {
+        std::string name;
+        for (char c : prefix) {
+            name += (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+        }
+        return name + "_PHRASE_" + std::to_string(id);
+    }
+    static std::string subroutineFile(const std::string& name) {
+        return name.substr(0, name.rfind("_PHRASE_")) + "_phrases.cfg";
+    }
+    static void writeSubroutine(std::ostream& out, const std::string& name, const std::string& body) {
+        out << "[gcode_macro " << name << "]\n"
+            << "gcode:\n"
+            << "    G91\n";
+        std::istringstream lines(body);
+        std::string line;
+        while (std::getline(lines, line)) {
+            out << "    " << line << "\n";
+        }
+        out << "    G90\n\n";
+    }
+    static void writeSubroutineCall(std::ostream& out, const std::string& name) {
+        out << name << " ; Repeated phrase\n";
+    }
+};
+
+struct RepRapFirmwareDialect {
+    static constexpr const char* name = "RepRapFirmware";
+    static constexpr bool hasHeaters = true;
+    static constexpr bool hasSubroutines = true;
+
+    static void writeUnits(std::ostream& out) {
+        out << "G21 ; Set units to millimeters\n";
+    }
+    static void writeMotionLimits(std::ostream& out, double acceleration, double jerk) {
+        // RRF takes instantaneous speed changes (M566) in mm/min
+        out << "M204 P" << acceleration << " T" << acceleration << " ; Set printing and travel acceleration\n"
+            << "M566 X" << (jerk * 60) << " Y" << (jerk * 60) << " ; Set jerk\n";
+    }
+    static void writeHome(std::ostream& out) {
+        out << "G28 ; Home all axes\n";
+    }
+    static void writeDwell(std::ostream& out, double seconds) {
+        out << "G4 P" << (seconds * 1000) << " ; Hold note\n";
+    }
+    static void writeMotorsOff(std::ostream& out) {
+        out << "M18 ; Disable motors\n";
+    }
+
+    // Phrase subroutines are macro files uploaded next to the job in /gcodes
+    static std::string subroutineName(const std::string& prefix, size_t id) {
+        return prefix + "_phrase_" + std::to_string(id);
+    }
+    static std::string subroutineFile(const std::string& name) {
+        return name + ".g";
+    }
+    static void writeSubroutine(std::ostream& out, const std::string& name, const std::string& body) {
+        out << "; " << name << "\n"
+            << "G91\n"
+            << body
+            << "G90\n";
+    }
+    static void writeSubroutineCall(std::ostream& out, const std::string& name) {
+        out << "M98 P\"/gcodes/" << subroutineFile(name) << "\" ; Repeated phrase\n";
+    }
+};
+
+struct GrblDialect {
+    static constexpr const char* name = "GRBL";
+    static constexpr bool hasHeaters = false;
+    static constexpr bool hasSubroutines = false;
+
+    static void writeUnits(std::ostream& out) {
+        out << "G21 ; Set units to millimeters\n";
+    }
+    static void writeMotionLimits(std::ostream& out, double acceleration, double jerk) {
+        // GRBL only takes limits from its $ settings, which we must not rewrite
+        out << "; Acceleration " << acceleration << " mm/s^2 and jerk " << jerk
+            << " mm/s are set by $120-$122 and $11\n";
+    }
+    static void writeHome(std::ostream& out) {
+        out << "$H ; Run homing cycle\n";
+    }
+    static void writeDwell(std::ostream& out, double seconds) {
+        // GRBL's G4 P is in seconds, so keep millisecond resolution
+        std::streamsize precision = out.precision(3);
+        out << "G4 P" << seconds << " ; Hold note\n";
+        out.precision(precision);
+    }
+    static void writeMotorsOff(std::ostream& out) {
+        out << "M2 ; End program\n";
+    }
+};
+
+inline const char* firmwareDialectName(FirmwareDialect dialect) {
+    switch (dialect) {
+        case FirmwareDialect::Klipper: return KlipperDialect::name;
+        case FirmwareDialect::RepRapFirmware: return RepRapFirmwareDialect::name;
+        case FirmwareDialect::Grbl: return GrblDialect::name;
+        case FirmwareDialect::Marlin:
+        default: return MarlinDialect::name;
+    }
+}
+
+inline bool firmwareDialectHasSubroutines(FirmwareDialect dialect) {
+    switch (dialect) {
+        case FirmwareDialect::Klipper: return KlipperDialect::hasSubroutines;
+        case FirmwareDialect::RepRapFirmware: return RepRapFirmwareDialect::hasSubroutines;
+        case FirmwareDialect::Grbl: return GrblDialect::hasSubroutines;
+        case FirmwareDialect::Marlin:
+        default: return MarlinDialect::hasSubroutines;
+    }
+}
+
+inline FirmwareDialect firmwareDialectFromName(const std::string& name, FirmwareDialect fallback = FirmwareDialect::Marlin) {
+    for (FirmwareDialect dialect : {FirmwareDialect::Marlin, FirmwareDialect::Klipper,
+                                    FirmwareDialect::RepRapFirmware, FirmwareDialect::Grbl}) {
+        if (name == firmwareDialectName(dialect)) return dialect;
+    }
+    return fallback;
+}
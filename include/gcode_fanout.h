@@ -0,0 +1,53 @@
+#pragma once
+#include "gcode_generator.h"
+#include "app_settings.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// One set of mapping parameters to generate alongside the others
+struct GenerationVariant {
+    std::string name;               // Appended to the output file name
+    double radiusScale = 1.0;       // See GCodeGenerator::setRadiusScale
+    double zStepPerSemitone = 0.1;  // See GCodeGenerator::setZStepPerSemitone
+};
+
+struct FanOutResult {
+    std::string printerName;
+    std::string variantName;
+    std::string outputFile;
+    std::string audioFile;          // Rendered printer audio, empty unless enabled
+    bool success = false;
+    std::string error;
+};
+
+// Generates one G-code file per (printer profile, variant) combination from a
+// single parsed note set. The notes and their analysis are shared read-only by
+// all worker threads, so parsing is paid once regardless of the variant count.
+class FanOutGenerator {
+public:
+    explicit FanOutGenerator(std::shared_ptr<const std::vector<MidiNote>> notes);
+
+    void setPhraseDeduplication(bool enabled) { m_phraseDeduplication = enabled; }
+    // Also render each output's printer audio to a .wav beside it (see StepperAudioRenderer)
+    void setAudioPreview(bool enabled) { m_audioPreview = enabled; }
+
+    // Parse a MIDI file once and wrap the notes for sharing
+    static std::shared_ptr<const std::vector<MidiNote>> loadNotes(const std::string& inputFile);
+
+    // Generate every combination into outputDirectory as
+    // <baseName>_<printer>[_<variant>].gcode. maxThreads = 0 uses all cores.
+    std::vector<FanOutResult> run(const std::vector<PrinterProfile>& profiles,
+                                  const std::vector<GenerationVariant>& variants,
+                                  const std::string& outputDirectory,
+                                  const std::string& baseName,
+                                  unsigned int maxThreads = 0) const;
+
+private:
+    static std::string sanitizeFileName(const std::string& name);
+
+    std::shared_ptr<const std::vector<MidiNote>> m_notes;
+    NoteAnalysis m_analysis;
+    bool m_phraseDeduplication;
+    bool m_audioPreview;
+};
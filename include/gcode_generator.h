@@ -1,10 +1,43 @@
 #pragma once
 #include "midi_parser.h"
 #include "gcode_visualizer.h"
+#include "app_settings.h"
+#include "gcode_dialect.h"
+#include "thumbnail.h"
+#include <map>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <fstream>
 
+// Properties of a note set that every generation pass needs. Computed once per
+// parse and shared read-only between generators (see FanOutGenerator).
+struct NoteAnalysis {
+    double totalDuration = 0.0; // End time of the last sounding note (s)
+    double timeScale = 1.0;     // Factor that squeezes the piece into ~60 s
+};
+
+// ToolMove::noteIndex of moves that do not play a note
+constexpr size_t kNoSourceNote = static_cast<size_t>(-1);
+
+// One note mapped to printer motion
+struct ToolMove {
+    double x, y, z;     // Target position (mm)
+    double feedrate;    // Feedrate of the move (mm/min)
+    double dwell;       // Pause after arriving (s), 0 for none
+    double frequency;   // Pitch of the source note (Hz)
+    uint8_t note;       // MIDI note number
+    size_t noteIndex;   // Index of the source note in the generator's input
+};
+
+// A generated program plus any files it calls into (phrase subroutines)
+struct GCodeProgram {
+    std::string gcode;
+    std::map<std::string, std::string> sideFiles; // File name -> contents
+    std::vector<ToolMove> moves; // Motion as executed after homing, subroutines expanded
+    std::vector<size_t> mainNotes; // Source note of each note move in gcode itself, in order
+};
+
 class GCodeGenerator {
 public:
     GCodeGenerator();
@@ -15,14 +48,53 @@ public:
     void setStepsPerMm(double steps) { stepsPerMm = steps; }
     void setAcceleration(double acc) { acceleration = acc; }
     void setJerk(double j) { jerk = j; }
+    void setBedSize(double x, double y) { bedSizeX = x; bedSizeY = y; }
+    void setRadiusScale(double scale) { radiusScale = scale; }
+    void setZStepPerSemitone(double step) { zStepPerSemitone = step; }
+    void setFirmwareDialect(FirmwareDialect d) { dialect = d; }
+    void setPhraseDeduplication(bool enabled, size_t minPhraseLength = 8) {
+        phraseDeduplication = enabled;
+        minPhraseNotes = minPhraseLength;
+    }
+    void setSubroutinePrefix(const std::string& prefix) { subroutinePrefix = prefix; }
+    // commandsPerSecond <= 0 disables the rate governor
+    void setCommandRateLimit(double commandsPerSecond, double minSegment) {
+        maxCommandRate = commandsPerSecond;
+        minSegmentTime = minSegment;
+    }
+    // Preview images embedded in the header, empty for none
+    void setThumbnails(const std::vector<ThumbnailSpec>& specs) { thumbnails = specs; }
+    void setPrinterProfile(const PrinterProfile& profile);
     void setVisualizer(GCodeVisualizer* visualizer) { m_visualizer = visualizer; }
 
+    // Analyze a note set once so several generators can reuse the result
+    static NoteAnalysis analyzeNotes(const std::vector<MidiNote>& notes);
+
     // Generate G-code from MIDI notes
     std::string generateGCode(const std::vector<MidiNote>& notes);
+    std::string generateGCode(const std::vector<MidiNote>& notes, const NoteAnalysis& analysis) const;
+
+    // Generate the main program together with its subroutine files
+    GCodeProgram generateProgram(const std::vector<MidiNote>& notes, const NoteAnalysis& analysis) const;
+
+    // Map every note to its target position, feedrate and dwell
+    std::vector<ToolMove> planMoves(const std::vector<MidiNote>& notes, const NoteAnalysis& analysis) const;
+    // The mapping of one note, as planMoves applies it (noteIndex is left unset)
+    ToolMove mapNote(const MidiNote& note, double timeScale) const;
+
+    // Setup up to the first note, and the finish after the last, in the
+    // profile's dialect; for streaming notes as they are played
+    std::string startupGCode() const;
+    std::string finishGCode() const;
+    // One absolute note move line, as in generated programs
+    static void writeNoteMove(std::ostream& out, const ToolMove& move);
     
     // Generate G-code and save to file
     void generateGCodeToFile(const std::string& inputFile, const std::string& outputFile);
 
+    // Write a program to outputFile and its side files into the same directory
+    static void writeProgram(const GCodeProgram& program, const std::string& outputFile);
+
 private:
     double maxSpeed;    // Maximum speed for movements (mm/s)
     double stepsPerMm;  // Steps per millimeter for the stepper motor
@@ -30,10 +102,33 @@ private:
     double jerk;       // Jerk in mm/s
     double bedSizeX;   // Bed size in X direction (mm)
     double bedSizeY;   // Bed size in Y direction (mm)
+    double radiusScale; // Multiplier on the base spiral radius
+    double zStepPerSemitone; // Z rise per semitone above A0 (mm)
+    FirmwareDialect dialect; // Firmware the emitted commands target
+    bool phraseDeduplication; // Emit repeated phrases as subroutine calls (Klipper, RRF only)
+    size_t minPhraseNotes;   // Shortest phrase worth a subroutine
+    std::string subroutinePrefix; // Prefix for subroutine names and files
+    double maxCommandRate;   // Commands per second the firmware sustains
+    double minSegmentTime;   // Shortest segment the planner handles (s)
+    std::vector<ThumbnailSpec> thumbnails; // Previews written into the header
     GCodeVisualizer* m_visualizer;
     
+    // Write the whole program using the command spellings of one dialect
+    template <typename Dialect>
+    void emitProgram(std::ostream& gcode, const std::vector<MidiNote>& notes,
+                     const std::vector<ToolMove>& moves, const std::string& governorSummary,
+                     GCodeProgram& program) const;
+
+    template <typename Dialect>
+    void writeStartup(std::ostream& gcode) const;
+    template <typename Dialect>
+    void writeFinish(std::ostream& gcode) const;
+
+    // Notes longer than this get a dwell after their move (s)
+    static constexpr double kDwellThreshold = 0.1;
+
     // Convert MIDI note to frequency
-    double noteToFreq(uint8_t note);
+    static double noteToFreq(uint8_t note);
     
     // Convert frequency to motor speed
     double freqToSpeed(double frequency);
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Words of one G-code line that the tools in this project care about
+struct GCodeLine {
+    enum Word : uint32_t {
+        HasX = 1 << 0,
+        HasY = 1 << 1,
+        HasZ = 1 << 2,
+        HasE = 1 << 3,
+        HasF = 1 << 4,
+        HasP = 1 << 5,
+        HasS = 1 << 6
+    };
+
+    int g = -1;          // G command number, -1 if none
+    int m = -1;          // M command number, -1 if none
+    bool extended = false; // Named command (Klipper macros, SET_VELOCITY_LIMIT, ...)
+    uint32_t words = 0;  // Which of the values below were present
+    double x = 0, y = 0, z = 0, e = 0, f = 0, p = 0, s = 0;
+    int note = -1;       // Note number from a generator "; Note N" comment
+
+    bool has(Word word) const { return (words & word) != 0; }
+    bool isMove() const { return g == 0 || g == 1; }
+};
+
+// Parse a decimal number starting at begin. Plain fixed-point numbers (all the
+// generator writes) are assembled from an integer mantissa and an exact power
+// of ten; anything longer falls back to strtod. Returns the first unparsed
+// character, or begin if there was no number.
+const char* parseGCodeNumber(const char* begin, const char* end, double& value);
+
+// Parse one line [begin, end) without its newline. Line numbers (N) and
+// checksums (*) are skipped. Returns false for blank and comment-only lines.
+bool parseGCodeLine(const char* begin, const char* end, GCodeLine& line);
+
+// Find the next '\n' in [begin, end), 16 bytes at a time where SSE2 is
+// available. Returns end if there is none.
+const char* findNewline(const char* begin, const char* end);
+
+// Offset of the first character of every line, followed by size + 1 so line
+// i spans [starts[i], starts[i + 1] - 1). Found in one pass, 16 bytes at a
+// time where SSE2 is available.
+void findLineStarts(const char* data, size_t size, std::vector<size_t>& starts);
+
+// One linear move resolved to absolute coordinates
+struct ToolpathSegment {
+    float start[3];
+    float end[3];
+    float feedrate;    // Feedrate in effect for the move (mm/min)
+    float dwellAfter;  // G4 time that follows the move (s)
+    uint32_t line;     // 1-based line the move came from
+    int32_t note;      // Note number from its "; Note" comment, -1 if none
+    bool extruding;    // Last E word seen was positive
+};
+
+// Modal state carried from one line (or one load) to the next
+struct ToolpathParseState {
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+    float feedrate = 0.0f;
+    bool extruding = false;
+    bool relative = false; // G91 in effect
+    uint32_t lines = 0;    // Lines consumed so far
+};
+
+struct ToolpathParseOptions {
+    double dwellUnit = 0.001;           // Seconds per G4 P unit (GRBL uses 1)
+    unsigned int threads = 0;           // 0 uses all cores
+    size_t minChunkBytes = 1 << 20;     // Inputs are only split into chunks this large
+};
+
+// Parse G-code text into segments, appending to segments. Large inputs are
+// split at line boundaries and lexed on several threads; positioning mode,
+// coordinates, feedrate and extrusion state crossing chunk boundaries are
+// resolved with prefix passes over per-chunk summaries. state holds the modal
+// state before the first line and is updated to the state after the last.
+void parseToolpath(const char* data, size_t size, ToolpathParseState& state,
+                   std::vector<ToolpathSegment>& segments,
+                   const ToolpathParseOptions& options = ToolpathParseOptions());
@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+
+// Where streamed G-code lines go. writeLine is called from the producing
+// thread; the line has no line ending.
+class GCodeLineSink {
+public:
+    virtual ~GCodeLineSink() = default;
+    virtual void writeLine(const std::string& line) = 0;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Read-only view of a generated program that stays responsive at any size.
+// A line-offset index is built in one newline scan, only the rows in view
+// are laid out (ImGuiListClipper), and the note table and text search run
+// on a worker thread that publishes results as it goes.
+class GCodePreview {
+public:
+    GCodePreview();
+    ~GCodePreview();
+    GCodePreview(const GCodePreview&) = delete;
+    GCodePreview& operator=(const GCodePreview&) = delete;
+
+    void setText(std::string text);
+    void clear() { setText(std::string()); }
+
+    size_t lineCount() const;
+    std::string_view line(size_t index) const; // 0-based, without the line ending
+
+    // 1-based, as the lexer and the visualizer's pick report lines
+    void scrollToLine(size_t line);
+
+    // Toolbar (jump to line, jump to note, search) and the text itself
+    void draw();
+
+private:
+    // Immutable once built, so the worker can read it while the UI replaces it
+    struct Document {
+        std::string text;
+        std::vector<size_t> lineStarts; // Offset of each line, plus text.size() + 1 at the end
+    };
+
+    // Written by the worker, read by the UI under m_resultMutex. Results
+    // are only published while their generation is still the current one.
+    struct Results {
+        uint64_t noteGeneration = 0;
+        std::vector<uint32_t> noteLines; // 0-based line of every "; Note" move
+        bool notesDone = true;
+        uint64_t searchGeneration = 0;
+        std::vector<uint32_t> matches;   // 0-based lines containing the pattern
+        bool searchDone = true;
+    };
+
+    void startSearch();
+    void jumpToMatch(size_t match);
+    void workerLoop();
+    void findNoteLines(const Document& document, uint64_t generation);
+    void findMatches(const Document& document, const std::string& pattern, uint64_t generation);
+
+    std::shared_ptr<const Document> m_document;
+
+    std::thread m_worker;
+    std::mutex m_jobMutex;
+    std::condition_variable m_jobReady;
+    std::shared_ptr<const Document> m_jobDocument; // Pending job, null when idle
+    bool m_jobNotes;                               // Build the note table first
+    std::string m_jobPattern;                      // Empty for no search
+    bool m_stopWorker;
+    std::atomic<uint64_t> m_textGeneration;        // Bumped by setText
+    std::atomic<uint64_t> m_searchGeneration;      // Bumped by setText and every new pattern
+
+    mutable std::mutex m_resultMutex;
+    Results m_results;
+
+    // UI state
+    char m_searchText[128];
+    int m_gotoLine;
+    int m_gotoNote;
+    size_t m_currentMatch;  // Index into m_results.matches, npos before the first jump
+    size_t m_highlightLine; // 0-based, npos for none
+    size_t m_scrollTarget;  // 0-based line to bring into view next frame, npos for none
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include "app_settings.h"
+#include "gcode_line_sink.h"
+#include "serial_port.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct GCodeSenderConfig {
+    int baudRate = 115200;
+    bool checksums = true;          // Send N<line> ... *<checksum> and honour resend requests
+    size_t maxOutstandingLines = 4; // Lines sent ahead of "ok": the firmware's command buffer
+    size_t rxBufferBytes = 127;     // Bytes sent ahead of "ok": the firmware's serial buffer
+    double connectTimeout = 10.0;   // For the firmware to answer once the port opens (s); boards reset on connect
+    double responseTimeout = 30.0;  // Silence with lines outstanding before they are resent (s)
+    double stallThreshold = 0.25;   // A wait for the window to open at least this long is a stall (s)
+
+    static GCodeSenderConfig fromProfile(const PrinterProfile& profile);
+};
+
+struct GCodeSenderStats {
+    size_t linesSent = 0;         // Including resent lines
+    size_t bytesSent = 0;
+    size_t linesAcknowledged = 0;
+    size_t resends = 0;           // Resend requests honoured and response timeouts
+    size_t errors = 0;            // Error replies other than resend requests
+    double elapsed = 0.0;         // Since the handshake (s)
+    double flowWaitTime = 0.0;    // A line was ready but the window was full (s)
+    double starvedTime = 0.0;     // The window was open but no line was queued (s)
+    size_t stalls = 0;            // Waits for the window longer than the stall threshold
+    double longestStall = 0.0;    // (s)
+
+    std::string summary() const;
+};
+
+enum class SenderState {
+    Connecting, // Port open, waiting for the firmware to answer
+    Connected,  // Streaming, or idle waiting for lines
+    Finished,   // Every line was acknowledged after finish()
+    Failed      // See error()
+};
+
+// Streams G-code to a printer over a serial port from a background thread.
+// A line is only sent while both the lines and the bytes awaiting "ok" stay
+// within the firmware's buffers, so neither its command queue nor its
+// serial buffer can overflow. With checksums, lines are numbered and
+// resent from where the firmware asks. Lines can be queued as they are
+// produced, so the live streamer can feed it directly.
+//
+// Subroutine calls are sent as they are; their files must already be on
+// the printer.
+class GCodeSender : public GCodeLineSink {
+public:
+    explicit GCodeSender(const GCodeSenderConfig& config);
+    ~GCodeSender() override;
+    GCodeSender(const GCodeSender&) = delete;
+    GCodeSender& operator=(const GCodeSender&) = delete;
+
+    // Opens the port and connects in the background; false if it can't be
+    // opened or a connection is still running. A cancelled, failed or
+    // finished sender can be opened again and starts afresh.
+    bool open(const std::string& port);
+
+    // Queue lines; never blocks. Comments and blank lines are dropped, and
+    // so is everything once the sender is cancelled, failed or finished.
+    void writeLine(const std::string& line) override;
+    void send(const std::string& gcode);
+
+    // No more lines will come; the sender stops once all are acknowledged
+    void finish();
+    // Blocks until finished or failed; true if every line was acknowledged
+    bool wait();
+    // Stops sending. Lines already in the firmware's buffers still run.
+    void cancel();
+
+    SenderState state() const { return m_state; }
+    std::string error() const;
+    GCodeSenderStats stats() const;
+
+    // XOR of every byte, as in Marlin's "*" checksum
+    static uint8_t checksum(const std::string& text);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Acknowledged lines kept beyond the unacknowledged ones, for resends
+    // of lines whose "ok" was already counted
+    static constexpr size_t kResendHistory = 64;
+    static constexpr std::chrono::milliseconds kPollInterval{1};
+
+    void run();
+    bool handshake();
+    bool acceptsLines() const;
+    const std::string* nextLine();
+    bool fits(const std::string& line) const;
+    void handleReply(const std::string& reply);
+    void rewind(size_t lineNumber);
+    std::string prepareLine(const std::string& line, size_t number) const;
+    void fail(const std::string& message);
+
+    GCodeSenderConfig m_config;
+    SerialPort m_port;
+    std::thread m_thread;
+    std::atomic<SenderState> m_state;
+    std::atomic<bool> m_cancelRequested;
+
+    // Producer side
+    mutable std::mutex m_queueMutex;
+    std::deque<std::string> m_queue;
+    bool m_finishRequested;
+
+    // Sender thread only
+    std::deque<std::string> m_history; // Prepared lines, m_historyFirst onwards
+    size_t m_historyFirst;             // Line number of m_history.front()
+    size_t m_nextLine;                 // Number of the next line to send
+    std::deque<size_t> m_inFlight;     // Sizes of lines awaiting "ok", oldest first
+    size_t m_inFlightBytes;
+    size_t m_swallowOks;               // Each resend request is followed by an "ok" that acknowledges no line
+    size_t m_duplicateResends;         // Repeats of the last resend request still to ignore
+    size_t m_lastResend;
+    Clock::time_point m_lastReply;
+    std::string m_replyBuffer;
+
+    mutable std::mutex m_statsMutex;
+    GCodeSenderStats m_stats;
+    std::string m_error;
+};
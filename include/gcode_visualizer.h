@@ -1,9 +1,18 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "gcode_lexer.h"
+#include "mapped_file.h"
 
 class GCodeVisualizer {
 public:
@@ -11,7 +20,57 @@ public:
     ~GCodeVisualizer();
 
     void loadGCode(const std::string& gcode);
+    // Parse on a background thread; geometry appears as uploadPending() takes it
+    void loadGCodeProgressive(std::string gcode);
+    // Upload queued geometry for at most the frame budget. Call once per frame.
+    void uploadPending();
+    void setUploadBudget(double milliseconds) { m_uploadBudgetMs = milliseconds; }
+    // Preview a file too large to hold in memory. The file is mapped and
+    // indexed once into "<path>.m2gidx" (rebuilt when the file changes);
+    // chunks are then paged onto the GPU by view and level of detail so the
+    // buffers and tables kept stay within memoryBudget bytes.
+    bool loadGCodeFile(const std::string& path, size_t memoryBudget = kDefaultMemoryBudget);
+    bool isLoading() const;
+    float loadProgress() const;
+    // GPU buffers plus CPU-side tables held for the current path
+    size_t residentBytes() const;
     void render();
+    // Draw into an offscreen texture of width x height pixels, but only when
+    // the camera, geometry, playback position or size changed since the last
+    // call. While interacting the image is drawn at a resolution that adapts
+    // to the frame time; full resolution follows once the view settles.
+    // Returns the colour texture; renderedExtent() is the part of it holding
+    // the image, in texture coordinates with the origin at the bottom left.
+    unsigned int renderToTexture(int width, int height, bool interacting);
+    glm::vec2 renderedExtent() const { return m_renderedExtent; }
+    // Level of detail drawn by the last render(), 0 = full resolution
+    size_t currentLodLevel() const { return m_currentLod; }
+
+    // Playback scrubbing. Times are print seconds estimated from feedrates and
+    // dwells; only the path up to that time is drawn, with a toolhead marker.
+    void setPlaybackTime(double seconds);
+    void clearPlaybackTime();
+    double totalPrintTime() const;
+    // Song onset (s) of each "; Note" move in file order, for setSongTime
+    void setNoteOnsets(std::vector<double> songSeconds) { m_noteOnsets = std::move(songSeconds); }
+    // Map a song position onto print time through the note moves
+    void setSongTime(double songSeconds);
+
+    struct PickResult {
+        bool hit = false;
+        size_t segment = 0;     // Index in file order
+        uint32_t line = 0;      // 1-based G-code line of the move
+        int note = -1;          // MIDI note from the move's comment, -1 if none
+        size_t noteIndex = 0;   // Position among the note moves (see setNoteOnsets)
+        glm::vec3 point{0.0f};  // Closest point on the segment
+    };
+    // Nearest segment passing within tolerance (mm) of a world-space ray
+    PickResult pick(const glm::vec3& origin, const glm::vec3& direction, float tolerance);
+    // Same for a cursor position in a viewport of the given size (pixels)
+    PickResult pickScreen(float x, float y, float width, float height, float pixelTolerance = 4.0f);
+    // Chunks submitted by the last render() after frustum culling
+    size_t visibleChunkCount() const { return m_visibleChunks; }
+
     void setViewMatrix(const glm::mat4& view);
     void setProjMatrix(const glm::mat4& proj);
     void resetView();
@@ -20,36 +79,290 @@ public:
     void zoom(float delta);
 
 private:
+    // 8 bytes per vertex: position quantized into m_frame plus an index into
+    // the shader's palette
     struct Vertex {
-        glm::vec3 position;
-        glm::vec3 color;
+        uint16_t position[3];
+        uint16_t attributes;
+    };
+
+    enum VertexAttribute : uint16_t {
+        kTravel = 0,
+        kExtruding = 1,
+        kMarker = 2
+    };
+
+    // Maps 16-bit vertex coordinates to millimetres: origin + q * step
+    struct QuantizationFrame {
+        glm::vec3 origin;
+        glm::vec3 step;
+
+        Vertex encode(const float position[3], uint16_t attributes, size_t& clamped) const;
+        glm::vec3 decode(const Vertex& vertex) const;
+        static QuantizationFrame forBounds(const glm::vec3& min, const glm::vec3& max);
+    };
+
+    // One level of the simplified-path pyramid, drawn as GL_LINES
+    struct LodLevel {
+        std::vector<Vertex> vertices; // Freed once uploaded
+        std::vector<uint32_t> reached; // Full-path segments done when each LOD segment ends
+        float maxError;               // Furthest the level strays from the full path (mm)
+        size_t first;                 // Range in m_lodVbo
+        size_t count;
+    };
+
+    // Per-segment data kept on the CPU: when each segment starts and stops
+    // moving (print seconds) and where it came from
+    struct SegmentTimeline {
+        std::vector<float> starts;
+        std::vector<float> ends;
+        std::vector<uint32_t> lines;        // 1-based G-code line
+        std::vector<int8_t> notes;          // MIDI note, -1 if none
+        std::vector<uint32_t> noteSegments; // Segments with a note, ascending
+
+        void append(const SegmentTimeline& other);
+        void clear();
+    };
+
+    // A run of consecutive segments that stays within a small box, so it can
+    // be culled or picked as a unit while draws keep file order
+    struct SegmentChunk {
+        glm::vec3 min;
+        glm::vec3 max;
+        uint32_t firstSegment;
+        uint32_t segmentCount;
     };
 
-    struct Line {
-        glm::vec3 start;
-        glm::vec3 end;
-        glm::vec3 color;
+    // BVH over chunks. Leaves cover m_chunkOrder[first, first + count);
+    // inner nodes have count 0, their left child next and the right at first.
+    struct BvhNode {
+        glm::vec3 min;
+        glm::vec3 max;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // Index file written by loadGCodeFile: this header, then arrays in file
+    // order at the given offsets (each 8-byte aligned). Only readable by the
+    // build that wrote it; the version changes with the layout.
+    struct IndexHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t levelCount;
+        uint64_t sourceSize;
+        int64_t sourceModified;  // Source write time, file clock ticks
+        double dwellUnit;
+        uint64_t segmentCount;
+        uint64_t noteCount;
+        uint64_t chunkCount;
+        float origin[3];
+        float step[3];
+        float boundsMin[3];
+        float boundsMax[3];
+        uint64_t vertices;       // Vertex[2 * segmentCount]
+        uint64_t starts;         // float[segmentCount]
+        uint64_t ends;           // float[segmentCount]
+        uint64_t lines;          // uint32_t[segmentCount]
+        uint64_t notes;          // int8_t[segmentCount]
+        uint64_t noteSegments;   // uint32_t[noteCount]
+        uint64_t chunks;         // SegmentChunk[chunkCount]
+        uint64_t levels;         // IndexLevel[levelCount]
+    };
+
+    struct IndexLevel {
+        float maxError;
+        uint32_t reserved;
+        uint64_t vertexCount;
+        uint64_t vertices;       // Vertex[vertexCount]
+        uint64_t reached;        // uint32_t[vertexCount / 2]
+    };
+
+    // Per-segment arrays, from m_timeline or from the mapped index
+    struct TimelineView {
+        const float* starts;
+        const float* ends;
+        const uint32_t* lines;
+        const int8_t* notes;
+        const uint32_t* noteSegments;
+        size_t segments;
+        size_t noteCount;
+    };
+
+    // Geometry handed from the loader thread to the render thread
+    struct LoadedChunk {
+        std::vector<Vertex> vertices;
+        SegmentTimeline timeline;
+        bool hasFrame;              // First chunk: the frame every chunk uses
+        QuantizationFrame frame;
     };
 
     void initializeGL();
-    void parseGCode(const std::string& gcode);
-    void updateBuffers();
+    std::vector<ToolpathSegment> parseGCode(const std::string& gcode);
+    void updateBuffers(const std::vector<Vertex>& vertices);
+    void configureVertexLayout(unsigned int vao, unsigned int vbo);
+    void reserveVertices(size_t count);
+    void appendVertices(const std::vector<Vertex>& vertices);
+    void cancelLoad();
+    void produceChunks(std::string gcode, ToolpathParseOptions options);
+    static ToolpathParseOptions optionsFor(const std::string& gcode);
+    static void encodeSegments(const std::vector<ToolpathSegment>& segments, const QuantizationFrame& frame,
+                               std::vector<Vertex>& vertices, size_t& clamped);
+    static void recordSegments(const std::vector<ToolpathSegment>& segments, size_t firstSegment, double& clock,
+                               SegmentTimeline& timeline);
+    void updateMarker(size_t segment, double seconds);
+    size_t visibleLodVertices(const LodLevel& level, size_t completed) const;
+    void startIndexBuild(std::vector<Vertex> vertices);
+    void cancelIndexBuild();
+    void installIndex();
+    size_t selectLodLevel() const;
+    // World size of one pixel at the path's nearest point or at its centre
+    float pixelWorldSize(float viewportHeight, bool nearestPoint) const;
+    // adaptive stops once a level barely shrinks; otherwise all levels are built
+    static std::vector<LodLevel> buildLodLevels(const std::vector<Vertex>& vertices, const QuantizationFrame& frame,
+                                                const std::atomic<bool>& cancel, bool adaptive = true);
+    static void buildChunkIndex(const std::vector<Vertex>& vertices, const QuantizationFrame& frame,
+                                std::vector<SegmentChunk>& chunks, std::vector<uint32_t>& order,
+                                std::vector<BvhNode>& nodes);
+    static void splitChunks(const std::vector<Vertex>& vertices, const QuantizationFrame& frame, float maxExtent,
+                            uint32_t firstSegment, std::vector<SegmentChunk>& chunks);
+    static void buildBvh(const std::vector<SegmentChunk>& chunks, std::vector<uint32_t>& order,
+                         std::vector<BvhNode>& nodes);
+    void collectVisibleChunks();
+    void drawVisibleChunks(size_t completed);
+    size_t segmentCount() const;
+    TimelineView timelineView() const;
+
+    // File-backed mode
+    static bool indexMatches(const MappedFile& index, uint64_t sourceSize, int64_t sourceModified);
+    static bool writeFileIndex(const MappedFile& source, int64_t sourceModified, const std::string& indexPath,
+                               const std::atomic<bool>& cancel, std::atomic<size_t>& progress);
+    void produceIndex(std::string gcodePath, std::vector<std::string> indexPaths);
+    bool openIndex(const std::string& path);
+    void closeIndex();
+    const IndexHeader& indexHeader() const { return *reinterpret_cast<const IndexHeader*>(m_index.data()); }
+    const Vertex* indexVertices() const {
+        return reinterpret_cast<const Vertex*>(m_index.data() + indexHeader().vertices);
+    }
+    void renderPaged(size_t completed);
+    void drawPagedChunks(size_t completed);
+    int pageInChunk(uint32_t chunk);
+    void makeLevelResident(size_t level);
+    void invalidate() { ++m_revision; }
 
-    std::vector<Line> m_lines;
-    std::vector<Vertex> m_vertices;
-    
     unsigned int m_vao;
     unsigned int m_vbo;
     unsigned int m_shader;
+    size_t m_vertexCapacity; // Vertices the VBO has room for
+    size_t m_uploadedVertices;
+    QuantizationFrame m_frame;
+
+    // Simplified copies of the path for zoomed-out views and the chunk BVH,
+    // built off-thread once loading finishes
+    static constexpr float kLodBaseError = 0.05f;  // Error of the first level (mm)
+    static constexpr float kLodErrorGrowth = 4.0f; // Error ratio between levels
+    static constexpr size_t kMaxLodLevels = 8;
+    static constexpr float kLodPixelTolerance = 0.75f; // Allowed error on screen (px)
+    unsigned int m_lodVao;
+    unsigned int m_lodVbo;
+    size_t m_lodBufferVertices;
+    std::vector<LodLevel> m_lodLevels;
+    std::vector<LodLevel> m_builtLodLevels; // Owned by m_indexBuilder until m_indexReady
+    std::vector<SegmentChunk> m_builtChunks;
+    std::vector<uint32_t> m_builtChunkOrder;
+    std::vector<BvhNode> m_builtBvh;
+    std::thread m_indexBuilder;
+    std::atomic<bool> m_indexReady;
+    std::atomic<bool> m_cancelIndex;
+    glm::vec3 m_boundsMin;
+    glm::vec3 m_boundsMax;
+    size_t m_currentLod;
+
+    // Spatial index over the full-resolution path
+    static constexpr size_t kMaxChunkSegments = 2048;
+    static constexpr float kMaxChunkExtent = 1.0f / 32.0f; // Of the path's diagonal
+    std::vector<SegmentChunk> m_chunks;
+    std::vector<uint32_t> m_chunkOrder;
+    std::vector<BvhNode> m_bvh;
+    std::vector<int> m_drawFirsts;  // glMultiDrawArrays ranges, rebuilt per frame
+    std::vector<int> m_drawCounts;
+    std::vector<uint32_t> m_visibleScratch;
+    std::vector<std::pair<uint32_t, bool>> m_bvhStack;
+    size_t m_visibleChunks;
+
+    // Playback scrubbing state
+    static constexpr float kDefaultFeedrate = 1500.0f; // mm/min before the first F word
+    SegmentTimeline m_timeline;
+    std::vector<double> m_noteOnsets;
+    bool m_playbackActive;
+    double m_playbackTime;
+    size_t m_completedSegments;  // Segments fully drawn at m_playbackTime
+    size_t m_markerSegment;      // Segment whose endpoints m_markerEnds holds
+    Vertex m_markerEnds[2];
+    unsigned int m_markerVao;
+    unsigned int m_markerVbo;
 
     glm::mat4 m_view;
     glm::mat4 m_proj;
     glm::vec3 m_center;
     float m_scale;
     
-    // Current position state for G-code parsing
-    float m_currentX;
-    float m_currentY;
-    float m_currentZ;
-    bool m_isExtruding;
+    // Modal state carried between parsed lines
+    ToolpathParseState m_parseState;
+
+    // Progressive loading: a loader thread fills a bounded queue that the
+    // render thread drains into the VBO. The bounds are unknown until the end,
+    // so streamed geometry uses a fixed-resolution frame centred on the first
+    // chunk, wide enough for any hobby printer.
+    static constexpr size_t kMaxQueuedChunks = 8;
+    static constexpr size_t kChunkBytes = 256 * 1024;
+    static constexpr float kStreamingStep = 1.0f / 64.0f; // mm, covers +-512 mm
+    std::thread m_loader;
+    mutable std::mutex m_queueMutex;
+    std::condition_variable m_queueSpace;
+    std::deque<LoadedChunk> m_queue;
+    bool m_loaderDone;
+    std::vector<Vertex> m_loadedVertices; // Whole path for the index build, set with m_loaderDone
+    glm::vec3 m_loadedMin;
+    glm::vec3 m_loadedMax;
+    std::atomic<bool> m_cancelLoad;
+    std::atomic<size_t> m_bytesParsed;
+    size_t m_bytesTotal;
+    double m_uploadBudgetMs;
+
+    // File-backed mode: the index stays mapped and full-resolution chunks
+    // are paged into fixed slots of m_vbo, least recently drawn out first.
+    // When the view holds more chunks than there are slots, the finest LOD
+    // level that fits the budget is drawn instead, one level resident at a time.
+    static constexpr size_t kDefaultMemoryBudget = size_t(256) << 20;
+    static constexpr uint32_t kIndexVersion = 1;
+    static constexpr size_t kIndexSliceBytes = 8 << 20;  // Parsed per step while indexing
+    static constexpr float kFileChunkExtent = 8.0f;      // mm; the path's size is unknown while indexing
+    static constexpr size_t kSlotVertices = kMaxChunkSegments * 2;
+    static constexpr size_t kMinSlots = 16;
+    MappedFile m_index;
+    bool m_indexing;          // The loader is writing an index rather than queueing chunks
+    std::string m_indexPath;  // Written by the loader thread, opened when it finishes
+    size_t m_memoryBudget;
+    std::vector<IndexLevel> m_indexLevels;
+    size_t m_residentLevel;                 // LOD level held in m_lodVbo, npos for none
+    std::vector<int32_t> m_slotChunks;      // Chunk in each slot, -1 for a free slot
+    std::vector<uint64_t> m_slotUsed;       // Frame each slot was last drawn
+    std::vector<int32_t> m_chunkSlots;      // Slot of each chunk, -1 if not resident
+    uint64_t m_frameNumber;
+
+    // Cached offscreen image (renderToTexture)
+    static constexpr float kMinInteractiveScale = 0.25f;
+    static constexpr double kSlowFrameSeconds = 1.5 / 60.0; // Missed vsync: lower the resolution
+    static constexpr double kFastFrameSeconds = 1.1 / 60.0; // Keeping up: raise it again
+    unsigned int m_fbo;
+    unsigned int m_colorTexture;
+    int m_targetWidth;
+    int m_targetHeight;
+    uint64_t m_revision;          // Bumped by anything that changes the image
+    uint64_t m_renderedRevision;
+    float m_renderedScale;        // Resolution of the cached image, 0 if there is none
+    float m_interactiveScale;
+    bool m_renderIncomplete;      // The last render left chunks to page in later
+    glm::vec2 m_renderedExtent;
+    std::chrono::steady_clock::time_point m_lastTargetFrame;
 };
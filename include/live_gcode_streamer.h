@@ -0,0 +1,132 @@
+#pragma once
+#include "gcode_generator.h"
+#include "gcode_line_sink.h"
+#include "midi_parser.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <portmidi.h>
+
+// A MIDI message as it came in, stamped on the steady clock
+struct LiveInputEvent {
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// Where live notes come from. read is called from the streamer thread only.
+class LiveEventSource {
+public:
+    virtual ~LiveEventSource() = default;
+    // Append what arrives within timeout; false once the source has ended
+    virtual bool read(std::vector<LiveInputEvent>& events, std::chrono::microseconds timeout) = 0;
+};
+
+// A PortMidi input device (PortMidi must already be initialized)
+class PortMidiInputSource : public LiveEventSource {
+public:
+    explicit PortMidiInputSource(int deviceIndex);
+    ~PortMidiInputSource() override;
+
+    bool isOpen() const { return m_stream != nullptr; }
+    bool read(std::vector<LiveInputEvent>& events, std::chrono::microseconds timeout) override;
+
+    // Index and name of every input device
+    static std::vector<std::pair<int, std::string>> inputDevices();
+
+private:
+    PortMidiStream* m_stream;
+};
+
+// Replays a decoded MIDI file in real time, as if it were being played
+// live; for testing without a keyboard
+class ReplaySource : public LiveEventSource {
+public:
+    explicit ReplaySource(std::shared_ptr<const std::vector<MidiEvent>> events);
+
+    bool read(std::vector<LiveInputEvent>& events, std::chrono::microseconds timeout) override;
+
+private:
+    std::shared_ptr<const std::vector<MidiEvent>> m_events;
+    size_t m_next;
+    std::chrono::steady_clock::time_point m_start; // Set on the first read
+    bool m_started;
+};
+
+// Appends lines to a file, flushed per line so a follower sees them at once
+class FileLineSink : public GCodeLineSink {
+public:
+    explicit FileLineSink(const std::string& path);
+
+    bool isOpen() const { return static_cast<bool>(m_file); }
+    void writeLine(const std::string& line) override;
+
+private:
+    std::ofstream m_file;
+};
+
+// Note-on to emitted line, over every streamed note
+struct LiveLatencyStats {
+    size_t notes = 0;       // Lines emitted for notes
+    size_t thinned = 0;     // Notes dropped to respect the command rate
+    double meanMs = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+
+    std::string summary() const;
+};
+
+// Live mode: maps every note-on from a source through the generator's
+// note mapping as it arrives and writes the move to a sink straight away.
+// Song time is the time since start, unscaled, so the spiral turns once a
+// minute. Note lengths aren't known at note-on, so moves carry no dwell,
+// and notes closer together than the profile's command rate are dropped.
+class LiveGCodeStreamer {
+public:
+    LiveGCodeStreamer(const PrinterProfile& profile, std::unique_ptr<LiveEventSource> source,
+                      std::shared_ptr<GCodeLineSink> sink);
+    ~LiveGCodeStreamer();
+    LiveGCodeStreamer(const LiveGCodeStreamer&) = delete;
+    LiveGCodeStreamer& operator=(const LiveGCodeStreamer&) = delete;
+
+    // Writes the startup, then streams until stop or the source ends, and
+    // writes the finish either way
+    void start();
+    void stop();
+    bool isRunning() const { return m_running; }
+    LiveLatencyStats latency() const;
+    const std::shared_ptr<GCodeLineSink>& sink() const { return m_sink; }
+
+private:
+    // Latency histogram: 10 µs buckets up to 20 ms, then one overflow bucket
+    static constexpr double kBucketMs = 0.01;
+    static constexpr size_t kBucketCount = 2001;
+    static constexpr std::chrono::microseconds kReadTimeout{1000}; // Bounds how long stop waits
+
+    void streamLoop();
+    void writeLines(const std::string& text);
+    void record(double latencyMs);
+
+    GCodeGenerator m_generator;
+    double m_minInterval;    // Between note moves (s), from the command rate
+    std::unique_ptr<LiveEventSource> m_source;
+    std::shared_ptr<GCodeLineSink> m_sink;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stopRequested;
+
+    mutable std::mutex m_statsMutex;
+    std::vector<uint32_t> m_histogram;
+    size_t m_notes;
+    size_t m_thinned;
+    double m_totalMs;
+    double m_maxMs;
+};
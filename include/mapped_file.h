@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into the address space. Pages are
+// read in on first touch and can be dropped again by the OS, so a mapping
+// costs address space rather than heap.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Returns false (and stays closed) if the file can't be opened or mapped
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_open; }
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void swap(MappedFile& other) noexcept;
+
+    const char* m_data = nullptr; // Null for an empty file
+    size_t m_size = 0;
+    bool m_open = false;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_descriptor = -1;
+#endif
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstdint>
 
 struct MidiNote {
@@ -10,6 +11,17 @@ struct MidiNote {
     double timestamp;  // Time offset from start in seconds
 };
 
+// A channel message at its place in the song. Tempo changes are already
+// folded into time, so the array can be sent to an output as it is.
+struct MidiEvent {
+    double time;      // Seconds from the start, through the tempo map of all tracks
+    uint32_t tick;    // Absolute tick
+    uint8_t status;   // Channel message status byte (0x80-0xEF)
+    uint8_t data1;
+    uint8_t data2;    // 0 for program change and channel pressure
+    uint8_t track;
+};
+
 class MidiParser {
 public:
     MidiParser() = default;
@@ -17,11 +29,27 @@ public:
 
     bool loadFile(const std::string& filename);
     bool parse(const std::string& filename, std::vector<MidiNote>& notes);
-    const std::vector<MidiNote>& getNotes() const { return m_notes; }
+    const std::vector<MidiNote>& getNotes() const { return m_notes; } // Sorted by timestamp
+
+    // Every channel message of the last file, sorted by time (file order for
+    // ties). Never modified once loaded, so a player can hold on to it.
+    std::shared_ptr<const std::vector<MidiEvent>> getEvents() const { return m_events; }
 
 private:
+    struct TempoChange {
+        uint32_t tick;
+        uint32_t tempo;  // Microseconds per quarter note
+    };
+
     std::vector<MidiNote> m_notes;
-    double ticksToSeconds(uint32_t ticks, uint16_t ticksPerQuarterNote, uint32_t tempo);
-    void parseTrack(const std::vector<uint8_t>& data, size_t& pos, uint16_t ticksPerQuarterNote);
-    uint32_t readVarLen(const std::vector<uint8_t>& data, size_t& pos);
+    std::shared_ptr<const std::vector<MidiEvent>> m_events;
+
+    // Returns the tick of the track's last event
+    uint32_t parseTrack(const std::vector<uint8_t>& data, size_t pos, size_t end, uint8_t track,
+                        std::vector<MidiEvent>& events, std::vector<TempoChange>& tempos);
+    // Sets the time of every event (sorted by tick) and returns that of endTick
+    double applyTempoMap(std::vector<MidiEvent>& events, std::vector<TempoChange> tempos, uint16_t division,
+                         uint32_t endTick);
+    void buildNotes(const std::vector<MidiEvent>& events, double endTime);
+    uint32_t readVarLen(const std::vector<uint8_t>& data, size_t& pos, size_t end);
 };
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "midi_parser.h"
+#include "spsc_queue.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <portmidi.h>
@@ -7,7 +10,21 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
 
+// Where MidiPlayer sends its output instead of a PortMidi stream. Events
+// arrive in timestamp order, stamped in Pt_Time ms, up to the lookahead
+// before they are due; a device plays each outputLatencyMs() after its
+// timestamp. write is called from the playback thread.
+class MidiOutputSink {
+public:
+    virtual ~MidiOutputSink() = default;
+    virtual void write(const PmEvent* events, int32_t count) = 0;
+};
+
+// Plays a decoded event timeline on a PortMidi output. The transport calls
+// only queue a command for the playback thread, so they return at once;
+// they must all come from one thread (the UI).
 class MidiPlayer {
 public:
     MidiPlayer();
@@ -15,33 +32,100 @@ public:
 
     bool initialize();
     bool loadMidiFile(const std::string& filename);
-    void play();
+    // Play events decoded elsewhere; the array is shared, not copied
+    void setEvents(std::shared_ptr<const std::vector<MidiEvent>> events);
+    void play();                     // From the current position
     void pause();
-    void stop();
-    void setTempo(float tempo);
+    void stop();                     // Pause and rewind
+    void seek(double seconds);       // Keeps playing if it was
+    void setTempo(float tempo);      // Playback rate, 1 = as written
     float getPlaybackPosition() const;
+    float getDuration() const { return m_duration; }
     bool isPlaying() const;
     std::vector<std::string> getAvailableOutputDevices() const;
     bool setOutputDevice(int deviceIndex);
+    void setOutputSink(std::unique_ptr<MidiOutputSink> sink); // Replaces the device
+
+    static int32_t outputLatencyMs() { return kOutputLatencyMs; }
+    uint64_t wakeupCount() const { return m_wakeups; } // Playback thread passes, for timing checks
 
 private:
-    struct MidiEvent {
-        long timestamp;  // in milliseconds
-        unsigned char status;
-        unsigned char data1;
-        unsigned char data2;
+    struct Command {
+        enum Type { Play, Pause, Stop, Seek, SetTempo, SetEvents, Quit };
+        Type type = Play;
+        double value = 0.0;
+        std::shared_ptr<const std::vector<MidiEvent>> events;
     };
 
+    // Controller, program, pressure and pitch bend values of every channel
+    // at some point of the song, 0xFF for never set
+    struct ChaseState {
+        uint8_t controllers[16][128];
+        uint8_t program[16];
+        uint8_t pressure[16];
+        uint8_t bend[16][2];
+        bool used[16];
+    };
+
+    // Events are written to PortMidi up to kLookaheadMs before they are due,
+    // stamped with their own time; the driver plays them kOutputLatencyMs
+    // after that, so thread wakeups don't add jitter.
+    static constexpr int32_t kOutputLatencyMs = 10;
+    static constexpr int32_t kOutputBufferSize = 1024; // Events PortMidi can hold
+    static constexpr long kLookaheadMs = 50;
+    static constexpr long kBatchMs = 25;               // Gathered per wakeup, the rest stays as margin
+    static constexpr size_t kMaxBatchEvents = 256;     // Per Pm_Write
+    static constexpr size_t kChaseInterval = 1024;     // Events between chase snapshots
+    static constexpr float kMinTempo = 0.05f;
+
+    void send(Command command);
     void playbackThread();
+    void apply(Command& command);
+    long writeDueEvents(std::vector<PmEvent>& batch); // ms until the next wakeup, -1 when idle
+    void seekTo(double seconds);
+    void chase(size_t eventIndex);
+    static void track(ChaseState& state, const MidiEvent& event);
+    void write(std::vector<PmEvent>& events);
+    void silence();
+    long outputTime(); // When newly written events can start: after everything already queued
+    void publishClock(long now);
     void cleanup();
 
-    std::vector<MidiEvent> m_events;
-    PortMidiStream* m_stream;
+    // Song position at a Pt_Time, and the Pt_Time an event is due (playback thread only)
+    double songTimeAt(long now) const {
+        return m_anchorSong + std::max(now - m_anchorTime, 0L) * double(m_tempo) / 1000.0;
+    }
+    long dueTime(const MidiEvent& event) const {
+        return m_anchorTime + static_cast<long>((event.time - m_anchorSong) * 1000.0 / m_tempo + 0.5);
+    }
+
+    SpscQueue<Command, 64> m_commands;
     std::unique_ptr<std::thread> m_playbackThread;
-    std::mutex m_mutex;
-    std::atomic<bool> m_isPlaying;
-    std::atomic<bool> m_shouldStop;
+    std::mutex m_mutex;              // Only for m_wake; never held while working
+    std::condition_variable m_wake;  // Cuts the playback thread's sleep short on a command
+    float m_duration;                // UI side, of the last events sent
+
+    // Owned by the playback thread
+    std::shared_ptr<const std::vector<MidiEvent>> m_events;
+    std::vector<ChaseState> m_chaseSnapshots; // State before every kChaseInterval-th event
+    bool m_channelsUsed[16];
+    bool m_playing;
     float m_tempo;
-    long m_startTime;
+    double m_anchorSong;             // Song position (s) at m_anchorTime
+    long m_anchorTime;               // Pt_Time ms
     size_t m_currentEventIndex;
+
+    // Published by the playback thread as a seqlock (odd while writing),
+    // so the UI reads a consistent clock without waiting
+    std::atomic<bool> m_isPlaying;
+    std::atomic<uint32_t> m_clockSequence;
+    std::atomic<double> m_clockSong;
+    std::atomic<long> m_clockTime;
+    std::atomic<float> m_clockTempo;
+    std::atomic<uint64_t> m_wakeups;
+
+    std::mutex m_streamMutex;        // Guards the output against device changes
+    PortMidiStream* m_stream;
+    std::unique_ptr<MidiOutputSink> m_sink; // Used instead of m_stream when set
+    long m_lastWriteTime;            // Latest timestamp handed to PortMidi (Pt_Time ms)
 };
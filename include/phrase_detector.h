@@ -0,0 +1,36 @@
+#pragma once
+#include "midi_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A later passage that repeats the notes [sourceStart, sourceStart + length)
+// exactly: same pitches, velocities, durations and gaps.
+struct PhraseRepeat {
+    size_t start;        // Index of the first note of the repeat
+    size_t sourceStart;  // Index of the first note of the earlier occurrence
+    size_t length;       // Number of notes in the phrase
+};
+
+// Finds repeated note subsequences with a rolling hash over note tokens
+// (pitch, velocity, duration and gap to the previous note). Pitch sets the
+// feedrate, so a transposed repeat is a different phrase. The first note of
+// a phrase anchors it: only its pitch and velocity count, not its gap or
+// duration, so a phrase of N notes compares N - 1 tokens plus the anchor.
+class PhraseDetector {
+public:
+    explicit PhraseDetector(size_t minPhraseLength = 8, double timeQuantum = 0.001);
+
+    // Non-overlapping repeats in ascending order of start. Notes must be
+    // sorted by timestamp. Each repeat points at the earliest occurrence of
+    // its notes and stays within that occurrence's phrase, so a loop comes
+    // back as the same phrase over and over.
+    std::vector<PhraseRepeat> findRepeats(const std::vector<MidiNote>& notes) const;
+
+private:
+    uint64_t tokenFor(const MidiNote& previous, const MidiNote& note) const;
+    static uint64_t anchorFor(const MidiNote& note);
+
+    size_t m_minPhraseLength;
+    double m_timeQuantum; // Resolution used when comparing durations and gaps (s)
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include "midi_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pitch × time occupancy of a note list at successively halved resolutions.
+// Each cell packs the number of notes starting in the bin (low 24 bits,
+// saturating) and the highest velocity sounding in it (high 8 bits, 0 for
+// silence). Coarser levels sum onsets and take the maximum velocity, so
+// every level is exact and any view can be drawn from the level whose bins
+// are about a pixel wide.
+class NotePyramid {
+public:
+    void build(const std::vector<MidiNote>& notes);
+    void clear();
+
+    bool empty() const { return m_levels.empty(); }
+    size_t levelCount() const { return m_levels.size(); }
+    double binSeconds(size_t level) const { return m_baseBinSeconds * static_cast<double>(uint64_t(1) << level); }
+    size_t binCount(size_t level) const { return m_levels[level].size() / m_rows; }
+    int lowestPitch() const { return m_lowestPitch; }
+    int rowCount() const { return static_cast<int>(m_rows); }
+    double duration() const { return m_duration; }
+
+    // Cell of row (pitch - lowestPitch) in a bin
+    uint32_t cell(size_t level, size_t bin, int row) const { return m_levels[level][bin * m_rows + row]; }
+
+    static uint32_t onsets(uint32_t cell) { return cell & 0xFFFFFF; }
+    static uint8_t velocity(uint32_t cell) { return static_cast<uint8_t>(cell >> 24); }
+    static uint32_t merge(uint32_t a, uint32_t b);
+
+private:
+    static constexpr size_t kMaxBaseBins = 16384; // Finer views are drawn from the notes themselves
+    static constexpr double kMinBinSeconds = 0.001;
+
+    std::vector<std::vector<uint32_t>> m_levels; // [bin * rows + row]
+    double m_baseBinSeconds = kMinBinSeconds;
+    double m_duration = 0.0;
+    int m_lowestPitch = 0;
+    size_t m_rows = 1;
+};
+
+// Keep the notes starting in [start, end), moved so the range starts at 0
+// and cut off at its end. notes must be sorted by timestamp.
+std::vector<MidiNote> notesInRange(const std::vector<MidiNote>& notes, double start, double end);
+
+// Timeline of the parsed notes before conversion. The view is rasterized
+// into a texture with one texel per pitch and pixel column, from the
+// pyramid when zoomed out and from the notes in view when zoomed in past
+// its finest level, so zooming and panning cost O(pixels) at any note count.
+// Wheel zooms, right-drag pans, left-drag selects the range to convert.
+class PianoRoll {
+public:
+    PianoRoll();
+    ~PianoRoll();
+    PianoRoll(const PianoRoll&) = delete;
+    PianoRoll& operator=(const PianoRoll&) = delete;
+
+    void setNotes(std::vector<MidiNote> notes);
+    void clear();
+    const std::vector<MidiNote>& notes() const { return m_notes; }
+
+    bool hasSelection() const { return m_selectionEnd > m_selectionStart; }
+    double selectionStart() const { return m_selectionStart; }
+    double selectionEnd() const { return m_selectionEnd; }
+    void clearSelection() { m_selectionStart = m_selectionEnd = 0.0; }
+
+    void setCursorTime(double seconds) { m_cursorTime = seconds; } // Negative hides the cursor
+
+    void draw(float height);
+
+private:
+    // RGBA texels, top row = highest pitch
+    void rasterize(double start, double end, int columns, std::vector<uint32_t>& texels) const;
+    void rasterizeNotes(double start, double end, int columns, std::vector<uint32_t>& texels) const;
+    void rasterizeLevel(size_t level, double start, double end, int columns, std::vector<uint32_t>& texels) const;
+    static uint32_t colorFor(uint32_t cell);
+
+    std::vector<MidiNote> m_notes; // Sorted by timestamp
+    double m_longestNote;          // How far back a note in view can start
+    NotePyramid m_pyramid;
+
+    double m_viewStart;            // Visible time range (s)
+    double m_viewEnd;
+    double m_selectionStart;
+    double m_selectionEnd;
+    double m_dragAnchor;           // Selection start while dragging, negative when not
+    double m_cursorTime;
+
+    unsigned int m_texture;
+    int m_textureColumns;
+    bool m_dirty;                  // View or notes changed since the last upload
+    std::vector<uint32_t> m_texels;
+};
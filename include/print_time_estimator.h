@@ -0,0 +1,69 @@
+#pragma once
+#include "gcode_generator.h"
+#include "app_settings.h"
+#include <string>
+#include <vector>
+
+// Trapezoidal velocity profile of one planned move
+struct BlockTiming {
+    double length;       // Move length (mm)
+    double entrySpeed;   // Speed at the start of the move (mm/s)
+    double cruiseSpeed;  // Highest speed reached (mm/s)
+    double exitSpeed;    // Speed at the end of the move (mm/s)
+    double accelTime;    // Time spent accelerating (s)
+    double cruiseTime;   // Time spent at cruise speed (s)
+    double decelTime;    // Time spent decelerating (s)
+    double dwell;        // Pause after the move (s)
+    double startTime;    // When the move starts, from the first move (s)
+
+    double moveTime() const { return accelTime + cruiseTime + decelTime; }
+};
+
+// Onset error of one note: positive drift means the printer is late
+struct NoteDrift {
+    size_t noteIndex;  // Index into the note vector given to the generator
+    double expected;   // Output-time onset the music asks for (s)
+    double actual;     // Simulated onset (s)
+    double drift;      // actual - expected (s)
+};
+
+struct BarDrift {
+    size_t bar;         // Bar number, counted from 0
+    double startTime;   // Source time of the bar start (s)
+    double maxDrift;    // Largest absolute note drift in the bar (s)
+};
+
+struct PrintTimeReport {
+    double totalTime = 0.0;         // Motion plus dwells, homing excluded (s)
+    double dwellTime = 0.0;         // Part of totalTime spent in G4 (s)
+    double expectedDuration = 0.0;  // Output-time span of the notes (s)
+    double maxDrift = 0.0;          // Largest absolute drift (s)
+    double p99Drift = 0.0;          // 99th percentile absolute drift (s)
+    double meanDrift = 0.0;         // Mean absolute drift (s)
+    std::vector<NoteDrift> notes;   // One entry per note-playing move
+    std::vector<BarDrift> worstBars;
+
+    std::string summary() const;
+};
+
+// Estimates how long generated moves take on a firmware with trapezoidal
+// acceleration and jerk-limited junctions, and how far each note's onset
+// drifts from its place in the music.
+class PrintTimeEstimator {
+public:
+    PrintTimeEstimator(double acceleration, double jerk, double maxSpeed);
+    explicit PrintTimeEstimator(const PrinterProfile& profile);
+
+    // Plan every move with forward/backward junction speed passes
+    std::vector<BlockTiming> planBlocks(const std::vector<ToolMove>& moves) const;
+
+    // notes and timeScale must be the ones the moves were generated from.
+    // barLength is in source seconds and only groups the worst-bar report.
+    PrintTimeReport estimate(const std::vector<ToolMove>& moves, const std::vector<MidiNote>& notes,
+                             double timeScale, double barLength = 2.0, size_t worstBarCount = 5) const;
+
+private:
+    double m_acceleration; // mm/s²
+    double m_jerk;         // mm/s
+    double m_maxSpeed;     // mm/s
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A serial device in raw 8N1 mode: a COM port on Windows, a tty elsewhere.
+// Pseudo-terminals work too, which is how the sender is exercised without
+// a printer.
+class SerialPort {
+public:
+    SerialPort() = default;
+    ~SerialPort();
+    SerialPort(const SerialPort&) = delete;
+    SerialPort& operator=(const SerialPort&) = delete;
+
+    // Returns false (and stays closed) if the device can't be opened or configured
+    bool open(const std::string& path, int baudRate);
+    void close();
+    bool isOpen() const;
+
+    // Writes everything or returns false
+    bool write(const char* data, size_t size);
+    // Waits up to timeout for input. Returns the bytes read, 0 on timeout, -1 on error.
+    int read(char* buffer, size_t size, std::chrono::milliseconds timeout);
+
+    // Devices that look like printer ports (COMn, ttyUSBn, ttyACMn, ...)
+    static std::vector<std::string> availablePorts();
+
+private:
+#ifdef _WIN32
+    void* m_handle = nullptr;
+    unsigned long m_readTimeoutMs = 0; // Last read timeout given to the driver
+#else
+    int m_descriptor = -1;
+#endif
+};
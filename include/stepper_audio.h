@@ -0,0 +1,48 @@
+#pragma once
+#include "gcode_generator.h"
+#include "app_settings.h"
+#include <string>
+#include <vector>
+
+struct StepperAudioConfig {
+    double stepsPerMm = 80.0;     // X and Y
+    double zStepsPerMm = 400.0;   // Profiles don't carry Z; this is the common leadscrew value
+    int sampleRate = 44100;
+    double resonanceHz = 1500.0;  // Body resonance of motor and frame
+    double resonanceQ = 3.0;
+    double resonanceGainDb = 9.0;
+    double gain = 0.25;           // Per axis
+
+    static StepperAudioConfig fromProfile(const PrinterProfile& profile);
+};
+
+struct StepperAudioReport {
+    double audioSeconds = 0.0;   // Length of the rendered program
+    double renderSeconds = 0.0;  // Wall time spent rendering
+    double peak = 0.0;           // Largest absolute sample of the mix
+    bool normalized = false;     // The peak exceeded full scale and the mix was scaled down
+
+    std::string summary() const;
+};
+
+// Renders what a program will sound like on the printer, offline and much
+// faster than real time. Moves are planned with the same trapezoidal model
+// as PrintTimeEstimator. Each axis plays an oscillator whose phase is the
+// axis position in steps, so it sounds one pulse per step at the step rate
+// the planner would produce. The axes are mixed through a resonance filter.
+class StepperAudioRenderer {
+public:
+    explicit StepperAudioRenderer(const PrinterProfile& profile);
+    StepperAudioRenderer(const PrinterProfile& profile, const StepperAudioConfig& config);
+
+    // Mono samples in [-1, 1]
+    std::vector<float> render(const std::vector<ToolMove>& moves, StepperAudioReport* report = nullptr) const;
+
+    // Render and write a 16-bit PCM WAV file
+    StepperAudioReport renderToFile(const std::vector<ToolMove>& moves, const std::string& path) const;
+    static void writeWav(const std::vector<float>& samples, int sampleRate, const std::string& path);
+
+private:
+    PrinterProfile m_profile;
+    StepperAudioConfig m_config;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct ToolMove;
+
+enum class ThumbnailFormat {
+    Png,
+    Qoi
+};
+
+// One preview image to embed, as slicers write them ("220x124/PNG")
+struct ThumbnailSpec {
+    int width;
+    int height;
+    ThumbnailFormat format;
+};
+
+// Parse a list such as "16x16/PNG, 220x124/QOI". The format defaults to PNG;
+// malformed entries are skipped.
+std::vector<ThumbnailSpec> parseThumbnailSpecs(const std::string& text);
+
+// 8-bit RGBA, rows top to bottom, straight (non-premultiplied) alpha
+struct ThumbnailImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+// Draws a toolpath into a small image without a GPU, so headless batch
+// conversions can embed previews. Lines are anti-aliased by exact coverage
+// along per-row spans; colour follows the height, which follows the pitch.
+class ThumbnailRenderer {
+public:
+    ThumbnailRenderer(int width, int height);
+
+    ThumbnailImage render(const std::vector<ToolMove>& moves);
+
+private:
+    struct Point {
+        float x, y; // Pixels
+        float t;    // 0 at the lowest Z, 1 at the highest
+    };
+
+    void project(const std::vector<ToolMove>& moves);
+    void drawSegment(const Point& a, const Point& b);
+    ThumbnailImage resolve() const;
+
+    int m_width;
+    int m_height;
+    float m_halfWidth; // Half the line width (px)
+    std::vector<Point> m_points;
+    // Premultiplied colour and coverage, one plane per channel so the span
+    // loops stay contiguous
+    std::vector<float> m_red;
+    std::vector<float> m_green;
+    std::vector<float> m_blue;
+    std::vector<float> m_alpha;
+};
+
+std::vector<uint8_t> encodePng(const ThumbnailImage& image);
+std::vector<uint8_t> encodeQoi(const ThumbnailImage& image);
+std::string encodeBase64(const std::vector<uint8_t>& data);
+
+// Write one "; thumbnail begin" block per spec, as PrusaSlicer does
+void writeThumbnails(std::ostream& out, const std::vector<ToolMove>& moves, const std::vector<ThumbnailSpec>& specs);
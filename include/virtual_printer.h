@@ -0,0 +1,60 @@
+#pragma once
+#include "app_settings.h"
+#include "gcode_dialect.h"
+#include <string>
+#include <vector>
+
+struct VirtualPrinterConfig {
+    double baudRate = 115200.0;        // Serial link speed, 10 bits per byte on the wire
+    double parseTimePerLine = 0.0005;  // Firmware time to parse one line (s)
+    size_t plannerDepth = 16;          // Blocks the motion planner can hold
+    size_t maxOutstandingLines = 1;    // Lines the host may send ahead of "ok"
+    double acceleration = 1000.0;      // mm/s²
+    double jerk = 10.0;                // mm/s
+    double maxSpeed = 100.0;           // mm/s
+    FirmwareDialect dialect = FirmwareDialect::Marlin; // Decides the unit of G4 P
+    double sampleInterval = 0.1;       // Width of an occupancy sample (s)
+
+    static VirtualPrinterConfig fromProfile(const PrinterProfile& profile);
+};
+
+// Planner occupancy seen over one sample interval
+struct OccupancySample {
+    double time;       // Start of the interval (s)
+    size_t minBlocks;  // Fewest queued blocks at any enqueue in the interval
+    size_t maxBlocks;  // Most queued blocks at any enqueue in the interval
+};
+
+// The planner ran dry and motion stopped until this line was enqueued
+struct StarvationEvent {
+    double time;        // When the planner ran empty (s)
+    double duration;    // How long motion was stalled (s)
+    size_t lineNumber;  // 1-based line in the input that arrived too late
+    std::string line;   // That line as sent
+};
+
+struct VirtualPrinterReport {
+    double totalTime = 0.0;     // Until the last block finished (s)
+    double starvedTime = 0.0;   // Sum of all stalls (s)
+    double serialBusyTime = 0.0; // Time the host link spent transmitting (s)
+    size_t linesSent = 0;
+    size_t bytesSent = 0;
+    std::vector<OccupancySample> occupancy;
+    std::vector<StarvationEvent> starvations;
+
+    std::string summary(size_t maxEvents = 10) const;
+};
+
+// Models a host streaming G-code to a firmware over a serial link with
+// ok-based flow control, a per-line parse cost and a bounded planner queue.
+// Block execution times come from PrintTimeEstimator's trapezoid planner
+// over the whole program. Homing and subroutine calls take no time.
+class VirtualPrinter {
+public:
+    explicit VirtualPrinter(const VirtualPrinterConfig& config);
+
+    VirtualPrinterReport run(const std::string& gcode) const;
+
+private:
+    VirtualPrinterConfig m_config;
+};
@@ -1,12 +1,47 @@
 #include "app_settings.h"
 #include <fstream>
+#define NOMINMAX
 #include <shlobj.h>
 #include <filesystem>
 #include <iostream>
+#include <algorithm>
+
+namespace {
+    // Write to a temporary file beside path, force it to disk and rename it
+    // over path, so a crash leaves either the old file or the new one
+    bool writeFileAtomically(const std::string& path, const std::string& contents, std::string& error) {
+        const std::filesystem::path target(path);
+        const std::filesystem::path temp = target.string() + ".tmp";
+        HANDLE file = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                  nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "Could not create " + temp.string();
+            return false;
+        }
+        DWORD written = 0;
+        const bool complete = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) &&
+                              written == contents.size() && FlushFileBuffers(file);
+        CloseHandle(file);
+        if (!complete) {
+            DeleteFileW(temp.c_str());
+            error = "Could not write " + temp.string();
+            return false;
+        }
+        if (!MoveFileExW(temp.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+            DeleteFileW(temp.c_str());
+            error = "Could not replace " + path;
+            return false;
+        }
+        return true;
+    }
+}
 
 AppSettings::AppSettings() 
     : currentPrinterIndex(0)
     , darkMode(true)
+    , writing(false)
+    , flushRequested(false)
+    , stopWriter(false)
 {
     // Set default output directory to Documents/MIDI2GCode
     char documentsPath[MAX_PATH];
@@ -21,7 +56,21 @@ AppSettings::AppSettings()
     std::filesystem::create_directories(outputDirectory);
     
     initializeDefaultProfiles();
+    settingsPath = getSettingsPath();
     loadSettings();
+    writer = std::thread(&AppSettings::writerLoop, this);
+}
+
+AppSettings::~AppSettings() {
+    // Whatever is still pending is written before the writer exits
+    {
+        std::lock_guard<std::mutex> lock(saveMutex);
+        stopWriter = true;
+    }
+    saveCondition.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
 }
 
 void AppSettings::initializeDefaultProfiles() {
@@ -37,8 +86,8 @@ void AppSettings::initializeDefaultProfiles() {
         {"CR-10", "Creality", 300, 300, 180, 500, 8, 80, false},
         
         // Other popular printers
-        {"Voron 2.4", "Voron Design", 350, 350, 300, 3000, 10, 80, false},
-        {"Rat Rig V-Core 3", "Rat Rig", 300, 300, 300, 3000, 10, 80, false},
+        {"Voron 2.4", "Voron Design", 350, 350, 300, 3000, 10, 80, false, FirmwareDialect::Klipper, 400, 0.005},
+        {"Rat Rig V-Core 3", "Rat Rig", 300, 300, 300, 3000, 10, 80, false, FirmwareDialect::Klipper, 400, 0.005},
         {"Artillery Sidewinder X1", "Artillery", 300, 300, 150, 1000, 8, 80, false},
         {"Flashforge Creator Pro", "Flashforge", 225, 145, 150, 1000, 8, 88, false}
     };
@@ -57,10 +106,10 @@ std::string AppSettings::getSettingsPath() const {
 
 void AppSettings::loadSettings() {
     try {
-        std::cout << "Loading settings from: " << getSettingsPath() << std::endl;
+        std::cout << "Loading settings from: " << settingsPath << std::endl;
         std::cout << "Number of default profiles: " << printerProfiles.size() << std::endl;
         
-        std::ifstream file(getSettingsPath());
+        std::ifstream file(settingsPath);
         if (file.is_open()) {
             nlohmann::json j;
             file >> j;
@@ -88,6 +137,18 @@ void AppSettings::loadSettings() {
                     profile.jerk = printer["jerk"];
                     profile.stepsPerMm = printer["stepsPerMm"];
                     profile.isCustom = true;
+                    if (printer.contains("dialect")) {
+                        profile.dialect = firmwareDialectFromName(printer["dialect"].get<std::string>());
+                    }
+                    if (printer.contains("maxCommandRate")) {
+                        profile.maxCommandRate = printer["maxCommandRate"];
+                    }
+                    if (printer.contains("minSegmentTime")) {
+                        profile.minSegmentTime = printer["minSegmentTime"];
+                    }
+                    if (printer.contains("thumbnails")) {
+                        profile.thumbnails = printer["thumbnails"];
+                    }
                     printerProfiles.push_back(profile);
                     std::cout << "Loaded custom printer: " << profile.name << std::endl;
                 }
@@ -102,33 +163,106 @@ void AppSettings::loadSettings() {
 }
 
 void AppSettings::saveSettings() {
+    scheduleSave();
+    flush();
+}
+
+void AppSettings::flush() {
+    std::unique_lock<std::mutex> lock(saveMutex);
+    flushRequested = true;
+    saveCondition.notify_all();
+    saveCondition.wait(lock, [this] { return !pendingSave && !writing; });
+    flushRequested = false;
+}
+
+std::string AppSettings::getSaveError() const {
+    std::lock_guard<std::mutex> lock(saveMutex);
+    return saveError;
+}
+
+void AppSettings::scheduleSave() {
+    Snapshot snapshot;
+    snapshot.outputDirectory = outputDirectory;
+    snapshot.darkMode = darkMode;
+    snapshot.currentPrinterIndex = currentPrinterIndex;
+    for (const auto& printer : printerProfiles) {
+        if (printer.isCustom) {
+            snapshot.customPrinters.push_back(printer);
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(saveMutex);
+        if (!pendingSave) {
+            firstChange = now;
+        }
+        lastChange = now;
+        pendingSave = std::move(snapshot);
+    }
+    saveCondition.notify_all();
+}
+
+void AppSettings::writerLoop() {
+    std::unique_lock<std::mutex> lock(saveMutex);
+    for (;;) {
+        saveCondition.wait(lock, [this] { return pendingSave || stopWriter; });
+        if (!pendingSave) break;
+
+        // Let a burst of changes settle, unless asked to hurry
+        while (pendingSave && !flushRequested && !stopWriter) {
+            const auto due = std::min(lastChange + kSaveDebounce, firstChange + kMaxSaveDelay);
+            if (std::chrono::steady_clock::now() >= due) break;
+            saveCondition.wait_until(lock, due);
+        }
+
+        Snapshot snapshot = std::move(*pendingSave);
+        pendingSave.reset();
+        writing = true;
+        lock.unlock();
+
+        std::string error;
+        if (!writeSnapshot(snapshot, error)) {
+            std::cerr << "Error saving settings: " << error << std::endl;
+        }
+
+        lock.lock();
+        writing = false;
+        saveError = error;
+        saveCondition.notify_all();
+    }
+}
+
+bool AppSettings::writeSnapshot(const Snapshot& snapshot, std::string& error) const {
     try {
         nlohmann::json j;
-        j["outputDirectory"] = outputDirectory;
-        j["darkMode"] = darkMode;
-        j["currentPrinterIndex"] = currentPrinterIndex;
+        j["outputDirectory"] = snapshot.outputDirectory;
+        j["darkMode"] = snapshot.darkMode;
+        j["currentPrinterIndex"] = snapshot.currentPrinterIndex;
         
         // Save custom printers
         nlohmann::json customPrinters = nlohmann::json::array();
-        for (const auto& printer : printerProfiles) {
-            if (printer.isCustom) {
-                nlohmann::json p;
-                p["name"] = printer.name;
-                p["manufacturer"] = printer.manufacturer;
-                p["bedSizeX"] = printer.bedSizeX;
-                p["bedSizeY"] = printer.bedSizeY;
-                p["maxSpeed"] = printer.maxSpeed;
-                p["acceleration"] = printer.acceleration;
-                p["jerk"] = printer.jerk;
-                p["stepsPerMm"] = printer.stepsPerMm;
-                customPrinters.push_back(p);
-            }
+        for (const auto& printer : snapshot.customPrinters) {
+            nlohmann::json p;
+            p["name"] = printer.name;
+            p["manufacturer"] = printer.manufacturer;
+            p["bedSizeX"] = printer.bedSizeX;
+            p["bedSizeY"] = printer.bedSizeY;
+            p["maxSpeed"] = printer.maxSpeed;
+            p["acceleration"] = printer.acceleration;
+            p["jerk"] = printer.jerk;
+            p["stepsPerMm"] = printer.stepsPerMm;
+            p["dialect"] = firmwareDialectName(printer.dialect);
+            p["maxCommandRate"] = printer.maxCommandRate;
+            p["minSegmentTime"] = printer.minSegmentTime;
+            p["thumbnails"] = printer.thumbnails;
+            customPrinters.push_back(p);
         }
         j["customPrinters"] = customPrinters;
         
-        std::ofstream file(getSettingsPath());
-        file << j.dump(4);
+        return writeFileAtomically(settingsPath, j.dump(4), error);
     } catch (const std::exception& e) {
-        // Handle saving error
+        error = e.what();
+        return false;
     }
 }
@@ -0,0 +1,150 @@
+#include "command_rate_governor.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace {
+    const double kWindowSeconds = 1.0; // Output time the rate is enforced over
+}
+
+CommandRateGovernor::CommandRateGovernor(double maxCommandsPerSecond, double minSegmentTime, double dwellThreshold)
+    : m_maxCommandsPerSecond(maxCommandsPerSecond)
+    , m_minSegmentTime(std::max(0.0, minSegmentTime))
+    , m_dwellThreshold(dwellThreshold)
+{
+}
+
+double CommandRateGovernor::priority(const MidiNote& note) const {
+    // Loud, long notes carry the music; short quiet ones go first
+    return (note.velocity + 1.0) * (note.duration + 0.01);
+}
+
+size_t CommandRateGovernor::commandCost(const MidiNote& note) const {
+    return note.duration > m_dwellThreshold ? 2 : 1; // Move plus optional dwell
+}
+
+GovernorResult CommandRateGovernor::apply(const std::vector<MidiNote>& notes, double timeScale) const {
+    GovernorResult result;
+    if (notes.empty() || m_maxCommandsPerSecond <= 0 || timeScale <= 0) {
+        result.notes = notes;
+        result.sourceIndices.resize(notes.size());
+        for (size_t i = 0; i < notes.size(); ++i) result.sourceIndices[i] = i;
+        return result;
+    }
+
+    // Merge pass: one note per minimum segment time, the most prominent wins.
+    // Spacing is measured from the note kept last, wherever it fell in its
+    // group, so no two survivors are closer than the minimum segment time.
+    std::vector<size_t> merged;
+    merged.reserve(notes.size());
+    double lastKept = -std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < notes.size();) {
+        if (notes[i].timestamp * timeScale - lastKept < m_minSegmentTime) {
+            ++result.mergedNotes;
+            ++i;
+            continue;
+        }
+        size_t best = i;
+        size_t j = i + 1;
+        const double groupStart = notes[i].timestamp * timeScale;
+        while (j < notes.size() && notes[j].timestamp * timeScale - groupStart < m_minSegmentTime) {
+            if (priority(notes[j]) > priority(notes[best])) best = j;
+            ++j;
+        }
+        merged.push_back(best);
+        result.mergedNotes += (j - i) - 1;
+        lastKept = notes[best].timestamp * timeScale;
+        i = j;
+    }
+
+    // Rate pass: no second of output time, wherever it starts, may need more
+    // commands than the budget. Walking forward in time, only the notes kept
+    // within the last second share a window with the next one; when they
+    // and it don't fit, the least prominent of them make room or it goes.
+    const size_t budget = std::max<size_t>(1, static_cast<size_t>(m_maxCommandsPerSecond * kWindowSeconds));
+    std::vector<char> keep(notes.size(), 0);
+    std::deque<size_t> recent; // Kept notes of the last second, oldest first
+    size_t used = 0;           // Commands of the notes in recent
+    for (size_t index : merged) {
+        const double time = notes[index].timestamp * timeScale;
+        while (!recent.empty() && notes[recent.front()].timestamp * timeScale <= time - kWindowSeconds) {
+            used -= commandCost(notes[recent.front()]);
+            recent.pop_front();
+        }
+
+        const size_t cost = commandCost(notes[index]);
+        size_t weakerCost = 0;
+        for (size_t other : recent) {
+            if (priority(notes[other]) < priority(notes[index])) weakerCost += commandCost(notes[other]);
+        }
+        if (used - weakerCost + cost > budget) {
+            ++result.droppedNotes;
+            continue;
+        }
+        while (used + cost > budget) {
+            auto weakest = std::min_element(recent.begin(), recent.end(), [&](size_t a, size_t b) {
+                return priority(notes[a]) < priority(notes[b]);
+            });
+            used -= commandCost(notes[*weakest]);
+            keep[*weakest] = 0;
+            recent.erase(weakest);
+            ++result.droppedNotes;
+        }
+        keep[index] = 1;
+        recent.push_back(index);
+        used += cost;
+    }
+
+    // Collect survivors and describe each output window that lost notes
+    ThinnedRegion region{0.0, 0.0, 0, 0};
+    double regionWindow = -1.0;
+    auto flushRegion = [&]() {
+        if (region.notesDemanded > region.notesKept) result.regions.push_back(region);
+    };
+    for (size_t i = 0; i < notes.size(); ++i) {
+        const double windowIndex = std::floor(notes[i].timestamp * timeScale / kWindowSeconds);
+        if (windowIndex != regionWindow) {
+            flushRegion();
+            regionWindow = windowIndex;
+            region = {windowIndex * kWindowSeconds / timeScale, (windowIndex + 1) * kWindowSeconds / timeScale, 0, 0};
+        }
+        ++region.notesDemanded;
+        if (keep[i]) {
+            ++region.notesKept;
+            result.notes.push_back(notes[i]);
+            result.sourceIndices.push_back(i);
+        }
+    }
+    flushRegion();
+
+    return result;
+}
+
+std::string CommandRateGovernor::summarize(const GovernorResult& result, size_t maxRegions) const {
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "; Rate governor: " << m_maxCommandsPerSecond << " commands/s, min segment "
+        << (m_minSegmentTime * 1000.0) << " ms\n";
+    if (result.regions.empty()) {
+        out << "; Rate governor: no notes thinned\n";
+        return out.str();
+    }
+
+    out << "; Rate governor: merged " << result.mergedNotes << " and dropped " << result.droppedNotes
+        << " notes in " << result.regions.size() << " regions\n";
+
+    // List the most heavily thinned regions first
+    std::vector<ThinnedRegion> worst = result.regions;
+    std::stable_sort(worst.begin(), worst.end(), [](const ThinnedRegion& a, const ThinnedRegion& b) {
+        return (a.notesDemanded - a.notesKept) > (b.notesDemanded - b.notesKept);
+    });
+    if (worst.size() > maxRegions) worst.resize(maxRegions);
+    for (const auto& region : worst) {
+        out << ";   " << std::setprecision(2) << region.startTime << "-" << region.endTime
+            << " s: kept " << region.notesKept << " of " << region.notesDemanded << " notes\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,80 @@
+#include "conversion_analyzer.h"
+#include "print_time_estimator.h"
+#include "stepper_audio.h"
+#include "virtual_printer.h"
+#include <exception>
+
+ConversionAnalyzer::ConversionAnalyzer()
+    : m_stopWorker(false)
+    , m_generation(0)
+    , m_reportGeneration(0)
+{
+    m_worker = std::thread(&ConversionAnalyzer::workerLoop, this);
+}
+
+ConversionAnalyzer::~ConversionAnalyzer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopWorker = true;
+    }
+    m_jobReady.notify_one();
+    // A job already running finishes first; the steps can't be interrupted
+    m_worker.join();
+}
+
+void ConversionAnalyzer::start(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = std::make_unique<Job>(std::move(job));
+        ++m_generation;
+        m_report.clear();
+    }
+    m_jobReady.notify_one();
+}
+
+bool ConversionAnalyzer::isBusy() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reportGeneration != m_generation;
+}
+
+std::string ConversionAnalyzer::report() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reportGeneration == m_generation ? m_report : std::string();
+}
+
+void ConversionAnalyzer::workerLoop() {
+    while (true) {
+        std::unique_ptr<Job> job;
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobReady.wait(lock, [this] { return m_stopWorker || m_pending; });
+            if (m_stopWorker) return;
+            job = std::move(m_pending);
+            generation = m_generation;
+        }
+
+        std::string report = analyze(*job);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (generation == m_generation) {
+            m_report = std::move(report);
+            m_reportGeneration = generation;
+        }
+    }
+}
+
+std::string ConversionAnalyzer::analyze(const Job& job) {
+    // Check whether the printer can keep time with the music
+    try {
+        std::string report = PrintTimeEstimator(job.printer).estimate(job.moves, job.notes, job.timeScale).summary();
+        report += VirtualPrinter(VirtualPrinterConfig::fromProfile(job.printer)).run(job.gcode).summary(3);
+        if (!job.audioPath.empty()) {
+            report += StepperAudioRenderer(job.printer).renderToFile(job.moves, job.audioPath).summary();
+        }
+        return report;
+    }
+    catch (const std::exception& e) {
+        return "Analysis failed: " + std::string(e.what()) + "\n";
+    }
+}
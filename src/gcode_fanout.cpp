@@ -0,0 +1,112 @@
+#include "gcode_fanout.h"
+#include "stepper_audio.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+FanOutGenerator::FanOutGenerator(std::shared_ptr<const std::vector<MidiNote>> notes)
+    : m_notes(std::move(notes))
+    , m_phraseDeduplication(false)
+    , m_audioPreview(false)
+{
+    if (!m_notes) {
+        throw std::invalid_argument("FanOutGenerator requires a note set");
+    }
+    m_analysis = GCodeGenerator::analyzeNotes(*m_notes);
+}
+
+std::shared_ptr<const std::vector<MidiNote>> FanOutGenerator::loadNotes(const std::string& inputFile) {
+    MidiParser parser;
+    auto notes = std::make_shared<std::vector<MidiNote>>();
+    if (!parser.parse(inputFile, *notes)) {
+        throw std::runtime_error("Failed to parse MIDI file");
+    }
+    return notes;
+}
+
+std::string FanOutGenerator::sanitizeFileName(const std::string& name) {
+    std::string result;
+    result.reserve(name.size());
+    for (char c : name) {
+        result += std::isalnum(static_cast<unsigned char>(c)) || c == '-' ? c : '_';
+    }
+    return result;
+}
+
+std::vector<FanOutResult> FanOutGenerator::run(const std::vector<PrinterProfile>& profiles,
+                                               const std::vector<GenerationVariant>& variants,
+                                               const std::string& outputDirectory,
+                                               const std::string& baseName,
+                                               unsigned int maxThreads) const {
+    // An empty variant list means "the default mapping only"
+    const std::vector<GenerationVariant> defaultVariants = {GenerationVariant{}};
+    const auto& variantList = variants.empty() ? defaultVariants : variants;
+
+    std::vector<FanOutResult> results(profiles.size() * variantList.size());
+    if (results.empty()) return results;
+
+    std::filesystem::create_directories(outputDirectory);
+
+    for (size_t p = 0; p < profiles.size(); ++p) {
+        for (size_t v = 0; v < variantList.size(); ++v) {
+            FanOutResult& result = results[p * variantList.size() + v];
+            result.printerName = profiles[p].name;
+            result.variantName = variantList[v].name;
+
+            std::string fileName = baseName + "_" + sanitizeFileName(profiles[p].name);
+            if (!variantList[v].name.empty()) {
+                fileName += "_" + sanitizeFileName(variantList[v].name);
+            }
+            result.outputFile = (std::filesystem::path(outputDirectory) / (fileName + ".gcode")).string();
+        }
+    }
+
+    unsigned int threadCount = maxThreads ? maxThreads : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned int>(threadCount, static_cast<unsigned int>(results.size())));
+
+    // Workers pull combinations from a shared counter; each owns its generator
+    // and writes only to its own result slot.
+    std::atomic<size_t> nextJob(0);
+    auto worker = [&]() {
+        for (size_t job = nextJob++; job < results.size(); job = nextJob++) {
+            FanOutResult& result = results[job];
+            const PrinterProfile& profile = profiles[job / variantList.size()];
+            const GenerationVariant& variant = variantList[job % variantList.size()];
+
+            try {
+                GCodeGenerator generator;
+                generator.setPrinterProfile(profile);
+                generator.setRadiusScale(variant.radiusScale);
+                generator.setZStepPerSemitone(variant.zStepPerSemitone);
+
+                generator.setPhraseDeduplication(m_phraseDeduplication);
+                generator.setSubroutinePrefix(std::filesystem::path(result.outputFile).stem().string());
+
+                GCodeProgram program = generator.generateProgram(*m_notes, m_analysis);
+                GCodeGenerator::writeProgram(program, result.outputFile);
+                if (m_audioPreview) {
+                    result.audioFile = std::filesystem::path(result.outputFile).replace_extension(".wav").string();
+                    StepperAudioRenderer(profile).renderToFile(program.moves, result.audioFile);
+                }
+                result.success = true;
+            } catch (const std::exception& e) {
+                result.error = e.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    return results;
+}
@@ -1,9 +1,15 @@
 #include "gcode_generator.h"
+#include "phrase_detector.h"
+#include "command_rate_governor.h"
+#include <cctype>
+#include <filesystem>
 #include <sstream>
 #include <cmath>
 #include <fstream>
 #include <algorithm>
 #include <iomanip>
+#include <iterator>
+#include <limits>
 
 #define M_PI 3.14159265358979323846
 
@@ -15,94 +21,458 @@ GCodeGenerator::GCodeGenerator()
     , m_visualizer(nullptr)
     , bedSizeX(220.0)    // Default bed size
     , bedSizeY(220.0)
+    , radiusScale(1.0)
+    , zStepPerSemitone(0.1) // 0.1mm per semitone
+    , dialect(FirmwareDialect::Marlin)
+    , phraseDeduplication(false)
+    , minPhraseNotes(8)
+    , subroutinePrefix("song")
+    , maxCommandRate(100.0)
+    , minSegmentTime(0.02)
 {}
 
+namespace {
+    // Coordinates are written with 3 decimals; relative moves are computed
+    // from rounded positions so they sum back to the absolute path exactly.
+    double roundToMicron(double value) {
+        return std::round(value * 1000.0) / 1000.0;
+    }
+
+    void writeNoteComment(std::ostream& gcode, const ToolMove& move) {
+        gcode << " ; Note " << (int)move.note
+              << " freq=" << std::fixed << std::setprecision(1) << move.frequency << "Hz\n";
+    }
+
+    void writeAbsoluteMove(std::ostream& gcode, const ToolMove& move) {
+        gcode << "G1"
+              << " X" << std::fixed << std::setprecision(3) << move.x
+              << " Y" << std::fixed << std::setprecision(3) << move.y
+              << " Z" << std::fixed << std::setprecision(3) << move.z
+              << " F" << move.feedrate;
+        writeNoteComment(gcode, move);
+    }
+
+    // One move of a phrase replay, relative to the note before
+    struct Step {
+        double x, y, z;
+    };
+
+    // Step into note j of a source phrase. Mirrored steps turn X and Y
+    // around, which keeps the length of the move and so its timing.
+    Step sourceStep(const std::vector<ToolMove>& moves, size_t j, bool mirrored) {
+        const double x = roundToMicron(moves[j].x) - roundToMicron(moves[j - 1].x);
+        const double y = roundToMicron(moves[j].y) - roundToMicron(moves[j - 1].y);
+        return {mirrored ? 0.0 - x : x, mirrored ? 0.0 - y : y,
+                roundToMicron(moves[j].z) - roundToMicron(moves[j - 1].z)};
+    }
+
+    void writeRelativeMove(std::ostream& gcode, const Step& step, const ToolMove& to) {
+        gcode << "G1"
+              << " X" << std::fixed << std::setprecision(3) << step.x
+              << " Y" << std::fixed << std::setprecision(3) << step.y
+              << " Z" << std::fixed << std::setprecision(3) << step.z
+              << " F" << to.feedrate;
+        writeNoteComment(gcode, to);
+    }
+
+    bool onBed(double x, double y, double bedSizeX, double bedSizeY) {
+        return x >= 0.0 && x <= bedSizeX && y >= 0.0 && y <= bedSizeY;
+    }
+
+    // Shifts that keep notes on the bed wherever the spiral has them on it
+    struct ShiftRange {
+        double minX = -std::numeric_limits<double>::infinity();
+        double maxX = std::numeric_limits<double>::infinity();
+        double minY = -std::numeric_limits<double>::infinity();
+        double maxY = std::numeric_limits<double>::infinity();
+
+        bool contains(double x, double y) const {
+            return x >= minX && x <= maxX && y >= minY && y <= maxY;
+        }
+    };
+
+    // ranges[i] holds for all notes from i on
+    std::vector<ShiftRange> suffixShiftRanges(const std::vector<ToolMove>& moves, double bedSizeX, double bedSizeY) {
+        std::vector<ShiftRange> ranges(moves.size() + 1);
+        for (size_t i = moves.size(); i-- > 0;) {
+            ranges[i] = ranges[i + 1];
+            if (onBed(moves[i].x, moves[i].y, bedSizeX, bedSizeY)) {
+                ranges[i].minX = std::max(ranges[i].minX, -moves[i].x);
+                ranges[i].maxX = std::min(ranges[i].maxX, bedSizeX - moves[i].x);
+                ranges[i].minY = std::max(ranges[i].minY, -moves[i].y);
+                ranges[i].maxY = std::min(ranges[i].maxY, bedSizeY - moves[i].y);
+            }
+        }
+        return ranges;
+    }
+
+    struct Replay {
+        PhraseRepeat repeat;
+        bool mirrored;          // X and Y turned around
+        std::string subroutine; // Body it calls
+    };
+
+    // A repeat replays its source's motion from its own first note, which
+    // copies the source's arc rather than following the spiral. The notes
+    // after it carry on from where the replay ends, shifted by as much, so
+    // every move keeps its length and timing. Mirrored replays walk back the
+    // other way, so a loop doesn't drift off in one direction. Of the plain
+    // and the mirrored replay, picks the one that stays on the bed, shifted
+    // rest included, with the smaller shift; false if neither does.
+    bool planReplay(const std::vector<ToolMove>& moves, const std::vector<ShiftRange>& suffixRanges,
+                    Replay& replay, double& shiftX, double& shiftY, double bedSizeX, double bedSizeY) {
+        const PhraseRepeat& repeat = replay.repeat;
+        bool found = false;
+        double bestX = 0.0;
+        double bestY = 0.0;
+        for (bool mirrored : {false, true}) {
+            double x = moves[repeat.start].x + shiftX;
+            double y = moves[repeat.start].y + shiftY;
+            bool fits = true;
+            for (size_t j = repeat.sourceStart + 1; fits && j < repeat.sourceStart + repeat.length; ++j) {
+                const Step step = sourceStep(moves, j, mirrored);
+                x += step.x;
+                y += step.y;
+                const ToolMove& spiral = moves[repeat.start + (j - repeat.sourceStart)];
+                fits = onBed(x, y, bedSizeX, bedSizeY) || !onBed(spiral.x, spiral.y, bedSizeX, bedSizeY);
+            }
+
+            const ToolMove& end = moves[repeat.start + repeat.length - 1];
+            const double nextX = x - end.x;
+            const double nextY = y - end.y;
+            if (!fits || !suffixRanges[repeat.start + repeat.length].contains(nextX, nextY)) continue;
+            if (!found || std::hypot(nextX, nextY) < std::hypot(bestX, bestY)) {
+                found = true;
+                replay.mirrored = mirrored;
+                bestX = nextX;
+                bestY = nextY;
+            }
+        }
+        if (!found) return false;
+        shiftX = bestX;
+        shiftY = bestY;
+        return true;
+    }
+
+    std::string sanitizeName(const std::string& name) {
+        std::string result;
+        for (char c : name) {
+            result += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+        }
+        return result.empty() ? "phrase" : result;
+    }
+}
+
+void GCodeGenerator::setPrinterProfile(const PrinterProfile& profile) {
+    maxSpeed = profile.maxSpeed;
+    stepsPerMm = profile.stepsPerMm;
+    acceleration = profile.acceleration;
+    jerk = profile.jerk;
+    bedSizeX = profile.bedSizeX;
+    bedSizeY = profile.bedSizeY;
+    dialect = profile.dialect;
+    maxCommandRate = profile.maxCommandRate;
+    minSegmentTime = profile.minSegmentTime;
+    thumbnails = parseThumbnailSpecs(profile.thumbnails);
+}
+
 double GCodeGenerator::noteToFreq(uint8_t note) {
     // A4 = 440Hz = MIDI note 69
     return 440.0 * std::pow(2.0, (note - 69.0) / 12.0);
 }
 
+NoteAnalysis GCodeGenerator::analyzeNotes(const std::vector<MidiNote>& notes) {
+    NoteAnalysis analysis;
+    for (const auto& note : notes) {
+        analysis.totalDuration = std::max(analysis.totalDuration, note.timestamp + note.duration);
+    }
+    if (analysis.totalDuration > 0) {
+        analysis.timeScale = 60.0 / analysis.totalDuration; // Scale to roughly 1 minute
+    }
+    return analysis;
+}
+
 std::string GCodeGenerator::generateGCode(const std::vector<MidiNote>& notes) {
-    if (notes.empty()) return "";
+    return generateGCode(notes, analyzeNotes(notes));
+}
 
-    std::stringstream gcode;
+std::string GCodeGenerator::generateGCode(const std::vector<MidiNote>& notes, const NoteAnalysis& analysis) const {
+    return generateProgram(notes, analysis).gcode;
+}
+
+std::vector<ToolMove> GCodeGenerator::planMoves(const std::vector<MidiNote>& notes, const NoteAnalysis& analysis) const {
+    std::vector<ToolMove> moves;
+    moves.reserve(notes.size());
+
+    for (size_t i = 0; i < notes.size(); ++i) {
+        ToolMove move = mapNote(notes[i], analysis.timeScale);
+        move.noteIndex = i;
+        moves.push_back(move);
+    }
+
+    return moves;
+}
+
+ToolMove GCodeGenerator::mapNote(const MidiNote& note, double timeScale) const {
+    const double baseRadius = std::min(bedSizeX, bedSizeY) * 0.4 * radiusScale; // 40% of bed size
+
+    // Map note properties to movement
+    double freq = noteToFreq(note.note);
+    double angle = (note.timestamp * timeScale * 360.0) / 60.0; // Convert time to degrees
+    double radius = baseRadius * (1.0 + (note.velocity / 127.0) * 0.5); // Vary radius by velocity
     
-    // Initial setup
-    gcode << "; MIDI to G-code conversion\n"
-          << "; Generated by MIDI2GCode Converter\n\n"
-          << "G21 ; Set units to millimeters\n"
-          << "G90 ; Use absolute coordinates\n"
-          << "M83 ; Use relative distances for extrusion\n"
-          << "M104 S0 ; Turn off hotend\n"
-          << "M140 S0 ; Turn off heated bed\n\n"
-          << "M204 P" << acceleration << " ; Set printing acceleration\n"
-          << "M205 X" << jerk << " Y" << jerk << " ; Set jerk\n\n";
+    // Calculate target position using polar coordinates
+    double angleRad = angle * M_PI / 180.0;
+    ToolMove move;
+    move.x = (bedSizeX/2) + radius * cos(angleRad);
+    move.y = (bedSizeY/2) + radius * sin(angleRad);
+    
+    // Map frequency to Z height (higher notes = higher Z)
+    move.z = 0.3 + (note.note - 21) * zStepPerSemitone; // Starting from A0 (21)
+    
+    // Calculate movement speed based on note properties
+    double speed = std::min(maxSpeed, freq * 0.2); // Scale frequency to reasonable speed
+    move.feedrate = speed * 60;
+
+    // Optional: add small pause for note duration
+    move.dwell = note.duration > kDwellThreshold ? note.duration * 0.5 : 0.0; // Only pause for long notes
+
+    move.frequency = freq;
+    move.note = note.note;
+    move.noteIndex = kNoSourceNote;
+    return move;
+}
+
+GCodeProgram GCodeGenerator::generateProgram(const std::vector<MidiNote>& notes, const NoteAnalysis& analysis) const {
+    GCodeProgram program;
+    if (notes.empty()) return program;
+
+    // Thin the piece down to what the firmware can execute in real time
+    CommandRateGovernor governor(maxCommandRate, minSegmentTime, kDwellThreshold);
+    GovernorResult governed = governor.apply(notes, analysis.timeScale);
+    std::string governorSummary = maxCommandRate > 0 ? governor.summarize(governed) : "";
+
+    std::vector<ToolMove> moves = planMoves(governed.notes, analysis);
+    for (auto& move : moves) {
+        move.noteIndex = governed.sourceIndices[move.noteIndex];
+    }
+    std::stringstream gcode;
+
+    // Resolve the dialect once; everything below is specialized per firmware
+    switch (dialect) {
+        case FirmwareDialect::Klipper:
+            emitProgram<KlipperDialect>(gcode, governed.notes, moves, governorSummary, program);
+            break;
+        case FirmwareDialect::RepRapFirmware:
+            emitProgram<RepRapFirmwareDialect>(gcode, governed.notes, moves, governorSummary, program);
+            break;
+        case FirmwareDialect::Grbl:
+            emitProgram<GrblDialect>(gcode, governed.notes, moves, governorSummary, program);
+            break;
+        case FirmwareDialect::Marlin:
+        default:
+            emitProgram<MarlinDialect>(gcode, governed.notes, moves, governorSummary, program);
+            break;
+    }
+
+    program.gcode = gcode.str();
+    return program;
+}
+
+template <typename Dialect>
+void GCodeGenerator::writeStartup(std::ostream& gcode) const {
+    Dialect::writeUnits(gcode);
+    gcode << "G90 ; Use absolute coordinates\n";
+    if constexpr (Dialect::hasHeaters) {
+        gcode << "M83 ; Use relative distances for extrusion\n"
+              << "M104 S0 ; Turn off hotend\n"
+              << "M140 S0 ; Turn off heated bed\n";
+    }
+    gcode << "\n";
+    Dialect::writeMotionLimits(gcode, acceleration, jerk);
+    gcode << "\n";
 
     // Home all axes
-    gcode << "G28 ; Home all axes\n\n";
+    Dialect::writeHome(gcode);
+    gcode << "\n";
 
     // Move to starting position
     gcode << "G1 Z5 F3000 ; Lift Z\n";
     gcode << "G1 X" << (bedSizeX/2) << " Y" << (bedSizeY/2) << " F3000 ; Move to center\n";
     gcode << "G1 Z0.3 F3000 ; Lower Z to starting height\n\n";
+}
 
-    // Calculate time scale to fit the piece into a reasonable duration
-    double totalDuration = 0;
-    for (const auto& note : notes) {
-        totalDuration = std::max(totalDuration, note.timestamp + note.duration);
+template <typename Dialect>
+void GCodeGenerator::writeFinish(std::ostream& gcode) const {
+    // Return to center and lift
+    gcode << "\n; Finish up\n"
+          << "G1 Z5 F3000 ; Lift Z\n"
+          << "G1 X" << (bedSizeX/2) << " Y" << (bedSizeY/2) << " F3000 ; Return to center\n";
+    Dialect::writeMotorsOff(gcode);
+}
+
+std::string GCodeGenerator::startupGCode() const {
+    std::stringstream gcode;
+    switch (dialect) {
+        case FirmwareDialect::Klipper:
+            writeStartup<KlipperDialect>(gcode);
+            break;
+        case FirmwareDialect::RepRapFirmware:
+            writeStartup<RepRapFirmwareDialect>(gcode);
+            break;
+        case FirmwareDialect::Grbl:
+            writeStartup<GrblDialect>(gcode);
+            break;
+        case FirmwareDialect::Marlin:
+        default:
+            writeStartup<MarlinDialect>(gcode);
+            break;
     }
-    
-    const double timeScale = 60.0 / totalDuration; // Scale to roughly 1 minute
-    const double baseRadius = std::min(bedSizeX, bedSizeY) * 0.4; // 40% of bed size
-    
-    // Track current position
-    double currentX = bedSizeX/2;
-    double currentY = bedSizeY/2;
-    double currentZ = 0.3;
-    
-    // Process each note
-    for (const auto& note : notes) {
-        // Map note properties to movement
-        double freq = noteToFreq(note.note);
-        double angle = (note.timestamp * timeScale * 360.0) / 60.0; // Convert time to degrees
-        double radius = baseRadius * (1.0 + (note.velocity / 127.0) * 0.5); // Vary radius by velocity
-        
-        // Calculate target position using polar coordinates
-        double angleRad = angle * M_PI / 180.0;
-        double targetX = (bedSizeX/2) + radius * cos(angleRad);
-        double targetY = (bedSizeY/2) + radius * sin(angleRad);
-        
-        // Map frequency to Z height (higher notes = higher Z)
-        double targetZ = 0.3 + (note.note - 21) * 0.1; // 0.1mm per semitone, starting from A0 (21)
-        
-        // Calculate movement speed based on note properties
-        double speed = std::min(maxSpeed, freq * 0.2); // Scale frequency to reasonable speed
-        
+    return gcode.str();
+}
+
+std::string GCodeGenerator::finishGCode() const {
+    std::stringstream gcode;
+    switch (dialect) {
+        case FirmwareDialect::Klipper:
+            writeFinish<KlipperDialect>(gcode);
+            break;
+        case FirmwareDialect::RepRapFirmware:
+            writeFinish<RepRapFirmwareDialect>(gcode);
+            break;
+        case FirmwareDialect::Grbl:
+            writeFinish<GrblDialect>(gcode);
+            break;
+        case FirmwareDialect::Marlin:
+        default:
+            writeFinish<MarlinDialect>(gcode);
+            break;
+    }
+    return gcode.str();
+}
+
+void GCodeGenerator::writeNoteMove(std::ostream& out, const ToolMove& move) {
+    writeAbsoluteMove(out, move);
+}
+
+template <typename Dialect>
+void GCodeGenerator::emitProgram(std::ostream& gcode, const std::vector<MidiNote>& notes,
+                                 const std::vector<ToolMove>& moves, const std::string& governorSummary,
+                                 GCodeProgram& program) const {
+    // Find repeated phrases and give each distinct body one subroutine.
+    // Firmwares without subroutines get the notes as they are.
+    std::vector<Replay> replays;
+    std::map<std::string, std::string> bodyNames;
+    if constexpr (Dialect::hasSubroutines) {
+        if (phraseDeduplication) {
+            const std::vector<ShiftRange> suffixRanges = suffixShiftRanges(moves, bedSizeX, bedSizeY);
+            double shiftX = 0.0;
+            double shiftY = 0.0;
+            for (const auto& repeat : PhraseDetector(minPhraseNotes).findRepeats(notes)) {
+                Replay replay{repeat, false, ""};
+                if (!planReplay(moves, suffixRanges, replay, shiftX, shiftY, bedSizeX, bedSizeY)) continue;
+
+                std::stringstream body;
+                for (size_t i = repeat.sourceStart + 1; i < repeat.sourceStart + repeat.length; ++i) {
+                    writeRelativeMove(body, sourceStep(moves, i, replay.mirrored), moves[i]);
+                    if (moves[i].dwell > 0) {
+                        Dialect::writeDwell(body, moves[i].dwell);
+                    }
+                }
+
+                auto [it, inserted] = bodyNames.emplace(body.str(), "");
+                if (inserted) {
+                    it->second = Dialect::subroutineName(sanitizeName(subroutinePrefix), bodyNames.size());
+                    std::stringstream definition;
+                    Dialect::writeSubroutine(definition, it->second, it->first);
+                    program.sideFiles[Dialect::subroutineFile(it->second)] += definition.str();
+                }
+                replay.subroutine = it->second;
+                replays.push_back(replay);
+            }
+        }
+    }
+
+    // The motion goes into its own buffer first so the header's thumbnails
+    // can draw the path as executed, replays included
+    std::stringstream motion;
+    writeStartup<Dialect>(motion);
+
+    // Keep a log of the motion as executed, for estimators and simulators
+    auto recordMove = [&program](double x, double y, double z, double feedrate) {
+        program.moves.push_back({x, y, z, feedrate, 0.0, 0.0, 0, kNoSourceNote});
+    };
+    program.moves.reserve(moves.size() + 4);
+    recordMove(bedSizeX/2, bedSizeY/2, 5.0, 3000.0);
+    recordMove(bedSizeX/2, bedSizeY/2, 0.3, 3000.0);
+
+    // Process each note, shifted by where the last replay ended
+    size_t nextRepeat = 0;
+    double shiftX = 0.0;
+    double shiftY = 0.0;
+    for (size_t i = 0; i < moves.size(); ++i) {
+        ToolMove move = moves[i];
+        move.x += shiftX;
+        move.y += shiftY;
+
         // Move to note position
-        gcode << "G1"
-              << " X" << std::fixed << std::setprecision(3) << targetX
-              << " Y" << std::fixed << std::setprecision(3) << targetY
-              << " Z" << std::fixed << std::setprecision(3) << targetZ
-              << " F" << (speed * 60) << " ; Note " << (int)note.note 
-              << " freq=" << std::fixed << std::setprecision(1) << freq << "Hz\n";
-        
-        // Optional: add small pause for note duration
-        if (note.duration > 0.1) { // Only pause for notes longer than 0.1s
-            gcode << "G4 P" << (note.duration * 1000 * 0.5) << " ; Hold note\n";
+        writeAbsoluteMove(motion, move);
+        program.mainNotes.push_back(move.noteIndex);
+        if (move.dwell > 0) {
+            Dialect::writeDwell(motion, move.dwell);
+        }
+        program.moves.push_back(move);
+
+        // A repeat is anchored at its own first note and then replays the
+        // earlier occurrence's relative motion
+        if (nextRepeat < replays.size() && replays[nextRepeat].repeat.start == i) {
+            const PhraseRepeat& repeat = replays[nextRepeat].repeat;
+            if constexpr (Dialect::hasSubroutines) {
+                Dialect::writeSubroutineCall(motion, replays[nextRepeat].subroutine);
+                motion << "G90 ; Back to absolute coordinates\n";
+            }
+            // The replay follows the source's rounded deltas from this anchor
+            for (size_t j = repeat.sourceStart + 1; j < repeat.sourceStart + repeat.length; ++j) {
+                ToolMove executed = moves[i + (j - repeat.sourceStart)];
+                const ToolMove& previous = program.moves.back();
+                const Step step = sourceStep(moves, j, replays[nextRepeat].mirrored);
+                executed.x = previous.x + step.x;
+                executed.y = previous.y + step.y;
+                executed.z = previous.z + step.z;
+                executed.feedrate = moves[j].feedrate;
+                executed.dwell = moves[j].dwell;
+                program.moves.push_back(executed);
+            }
+            i += repeat.length - 1;
+            shiftX = program.moves.back().x - moves[i].x;
+            shiftY = program.moves.back().y - moves[i].y;
+            ++nextRepeat;
         }
-        
-        currentX = targetX;
-        currentY = targetY;
-        currentZ = targetZ;
     }
     
-    // Return to center and lift
-    gcode << "\n; Finish up\n"
-          << "G1 Z5 F3000 ; Lift Z\n"
-          << "G1 X" << (bedSizeX/2) << " Y" << (bedSizeY/2) << " F3000 ; Return to center\n"
-          << "M84 ; Disable motors\n";
+    writeFinish<Dialect>(motion);
+    recordMove(program.moves.back().x, program.moves.back().y, 5.0, 3000.0);
+    recordMove(bedSizeX/2, bedSizeY/2, 5.0, 3000.0);
 
-    return gcode.str();
+    // Header, with the thumbnails drawn from the note moves as executed
+    gcode << "; MIDI to G-code conversion\n"
+          << "; Generated by MIDI2GCode Converter\n"
+          << "; Firmware: " << Dialect::name << "\n";
+    if (!replays.empty()) {
+        gcode << "; Phrases: " << replays.size() << " repeats call " << bodyNames.size() << " subroutines in";
+        for (const auto& file : program.sideFiles) {
+            gcode << " " << file.first;
+        }
+        gcode << "\n";
+    }
+    // After the short header lines, which readers look for near the top
+    std::vector<ToolMove> drawn;
+    drawn.reserve(moves.size());
+    std::copy_if(program.moves.begin(), program.moves.end(), std::back_inserter(drawn),
+                 [](const ToolMove& move) { return move.noteIndex != kNoSourceNote; });
+    writeThumbnails(gcode, drawn, thumbnails);
+    gcode << governorSummary << "\n";
+    gcode << motion.str();
 }
 
 void GCodeGenerator::generateGCodeToFile(const std::string& inputFile, const std::string& outputFile) {
@@ -113,17 +483,31 @@ void GCodeGenerator::generateGCodeToFile(const std::string& inputFile, const std
         throw std::runtime_error("Failed to parse MIDI file");
     }
     
-    std::string gcode = generateGCode(notes);
+    GCodeGenerator generator(*this);
+    generator.setSubroutinePrefix(std::filesystem::path(outputFile).stem().string());
+    GCodeProgram program = generator.generateProgram(notes, analyzeNotes(notes));
+    writeProgram(program, outputFile);
     
+    if (m_visualizer) {
+        m_visualizer->loadGCode(program.gcode);
+    }
+}
+
+void GCodeGenerator::writeProgram(const GCodeProgram& program, const std::string& outputFile) {
     std::ofstream outFile(outputFile);
     if (!outFile) {
         throw std::runtime_error("Failed to open output file");
     }
     
-    outFile << gcode;
+    outFile << program.gcode;
     outFile.close();
-    
-    if (m_visualizer) {
-        m_visualizer->loadGCode(gcode);
+
+    const std::filesystem::path directory = std::filesystem::path(outputFile).parent_path();
+    for (const auto& [name, contents] : program.sideFiles) {
+        std::ofstream sideFile(directory / name);
+        if (!sideFile) {
+            throw std::runtime_error("Failed to open subroutine file " + name);
+        }
+        sideFile << contents;
     }
 }
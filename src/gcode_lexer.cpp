@@ -0,0 +1,454 @@
+#include "gcode_lexer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define M2G_HAVE_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define M2G_HAVE_SSE2 0
+#endif
+
+namespace {
+    // Powers of ten that are exact in a double
+    const double kPow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline char upper(char c) { return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c; }
+    inline bool isLetter(char c) { c = upper(c); return c >= 'A' && c <= 'Z'; }
+
+#if M2G_HAVE_SSE2
+    inline unsigned int countTrailingZeros(unsigned int mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<unsigned int>(index);
+#else
+        return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+    }
+#endif
+
+    const char* parseNumberSlow(const char* begin, const char* end, double& value) {
+        std::string copy(begin, end);
+        char* stop = nullptr;
+        value = std::strtod(copy.c_str(), &stop);
+        return begin + (stop - copy.c_str());
+    }
+
+    // Generator comments look like "; Note 60 freq=261.6Hz"
+    int parseNoteComment(const char* p, const char* end) {
+        while (p < end && isSpace(*p)) ++p;
+        if (end - p < 5 || std::memcmp(p, "Note ", 5) != 0) return -1;
+        p += 5;
+        int note = 0;
+        const char* digits = p;
+        while (p < end && isDigit(*p)) note = note * 10 + (*p++ - '0');
+        return p > digits ? note : -1;
+    }
+}
+
+const char* parseGCodeNumber(const char* begin, const char* end, double& value) {
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fractionDigits = 0;
+    while (p < end && isDigit(*p)) {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*p++ - '0');
+        ++digits;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isDigit(*p)) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p++ - '0');
+            ++digits;
+            ++fractionDigits;
+        }
+    }
+    if (digits == 0) {
+        return begin;
+    }
+
+    // Exponents and mantissas beyond 2^53 need correct rounding
+    bool hasExponent = p < end && (*p == 'e' || *p == 'E') && p + 1 < end &&
+                       (isDigit(p[1]) || p[1] == '-' || p[1] == '+');
+    if (hasExponent || digits > 15 || fractionDigits > 22) {
+        return parseNumberSlow(begin, end, value);
+    }
+
+    value = static_cast<double>(mantissa) / kPow10[fractionDigits];
+    if (negative) value = -value;
+    return p;
+}
+
+bool parseGCodeLine(const char* begin, const char* end, GCodeLine& line) {
+    line = GCodeLine();
+    const char* p = begin;
+    bool hasContent = false;
+
+    while (p < end) {
+        char c = *p;
+        if (isSpace(c)) {
+            ++p;
+            continue;
+        }
+        if (c == ';') {
+            line.note = parseNoteComment(p + 1, end);
+            break;
+        }
+        if (c == '*') {
+            break; // Checksum ends the line
+        }
+        if (c == '(') {
+            while (p < end && *p != ')') ++p;
+            if (p < end) ++p;
+            continue;
+        }
+        if (!isLetter(c)) {
+            ++p;
+            continue;
+        }
+
+        // A letter followed by another letter starts a named command
+        if (!hasContent && p + 1 < end && isLetter(p[1])) {
+            line.extended = true;
+            hasContent = true;
+            while (p < end && *p != ';') ++p;
+            continue;
+        }
+
+        char letter = upper(c);
+        double value = 0.0;
+        const char* next = parseGCodeNumber(p + 1, end, value);
+        if (next == p + 1) {
+            ++p;
+            continue;
+        }
+        p = next;
+        hasContent = true;
+
+        switch (letter) {
+            case 'G': line.g = static_cast<int>(value); break;
+            case 'M': line.m = static_cast<int>(value); break;
+            case 'X': line.x = value; line.words |= GCodeLine::HasX; break;
+            case 'Y': line.y = value; line.words |= GCodeLine::HasY; break;
+            case 'Z': line.z = value; line.words |= GCodeLine::HasZ; break;
+            case 'E': line.e = value; line.words |= GCodeLine::HasE; break;
+            case 'F': line.f = value; line.words |= GCodeLine::HasF; break;
+            case 'P': line.p = value; line.words |= GCodeLine::HasP; break;
+            case 'S': line.s = value; line.words |= GCodeLine::HasS; break;
+            default: break; // N and anything else we don't track
+        }
+    }
+
+    return hasContent;
+}
+
+const char* findNewline(const char* begin, const char* end) {
+    const char* p = begin;
+#if M2G_HAVE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    const void* hit = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return hit ? static_cast<const char*>(hit) : end;
+}
+
+void findLineStarts(const char* data, size_t size, std::vector<size_t>& starts) {
+    starts.clear();
+    starts.push_back(0);
+    size_t i = 0;
+#if M2G_HAVE_SSE2
+    // Every newline of a block comes out of one mask, so dense short lines
+    // cost no more than sparse long ones
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; size - i >= 16; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        while (mask) {
+            starts.push_back(i + countTrailingZeros(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (data[i] == '\n') starts.push_back(i + 1);
+    }
+    // A trailing newline doesn't start another line
+    if (starts.size() > 1 && starts.back() == size) starts.pop_back();
+    starts.push_back(size + 1);
+}
+
+namespace {
+    // What a chunk needs to remember about a line once it has been lexed
+    struct LexRecord {
+        enum Flags : uint8_t {
+            Move = 1 << 0,
+            Dwell = 1 << 1,
+            SetAbsolute = 1 << 2,
+            SetRelative = 1 << 3,
+            SetExtruding = 1 << 4,
+            Extruding = 1 << 5,
+            SetFeedrate = 1 << 6
+        };
+
+        float x, y, z;
+        float feedrate;
+        float dwell;
+        uint32_t line;  // Chunk-relative, 0-based
+        int32_t note;
+        uint8_t axes;   // Bit 0..2 = X, Y, Z present
+        uint8_t flags;
+    };
+
+    // An axis after a chunk, either absolute or an offset from the chunk's entry
+    struct AxisSummary {
+        bool absolute = false;
+        float value = 0.0f;
+    };
+
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        std::vector<LexRecord> records;
+        uint32_t lineCount = 0;
+        size_t moveCount = 0;
+        int lastMode = -1;          // 90 or 91 if the chunk switches mode
+        AxisSummary axes[3];
+        bool setsFeedrate = false;
+        float feedrate = 0.0f;
+        bool setsExtruding = false;
+        bool extruding = false;
+        ToolpathParseState entry;
+        float leadingDwell = 0.0f;  // Dwell before the chunk's first move
+        size_t firstSegment = 0;
+    };
+
+    template <typename Function>
+    void parallelFor(size_t count, unsigned int threads, Function function) {
+        if (threads <= 1 || count <= 1) {
+            for (size_t i = 0; i < count; ++i) function(i);
+            return;
+        }
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t i = next++; i < count; i = next++) function(i);
+        };
+        std::vector<std::thread> pool;
+        for (unsigned int t = 1; t < std::min<size_t>(threads, count); ++t) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool) thread.join();
+    }
+
+    void lexChunk(Chunk& chunk, double dwellUnit) {
+        GCodeLine parsed;
+        const char* p = chunk.begin;
+        uint32_t line = 0;
+        while (p < chunk.end) {
+            const char* lineEnd = findNewline(p, chunk.end);
+            if (lineEnd > p && *p != ';' && parseGCodeLine(p, lineEnd, parsed)) {
+                LexRecord record{};
+                record.line = line;
+                record.note = parsed.note;
+                record.feedrate = static_cast<float>(parsed.f);
+                if (parsed.has(GCodeLine::HasF)) record.flags |= LexRecord::SetFeedrate;
+                if (parsed.has(GCodeLine::HasE)) {
+                    record.flags |= LexRecord::SetExtruding;
+                    if (parsed.e > 0) record.flags |= LexRecord::Extruding;
+                }
+                if (parsed.g == 90) record.flags |= LexRecord::SetAbsolute;
+                if (parsed.g == 91) record.flags |= LexRecord::SetRelative;
+                if (parsed.g == 4) {
+                    record.flags |= LexRecord::Dwell;
+                    record.dwell = static_cast<float>(parsed.has(GCodeLine::HasP) ? parsed.p * dwellUnit
+                                                    : parsed.has(GCodeLine::HasS) ? parsed.s : 0.0);
+                }
+                if (parsed.isMove()) {
+                    if (parsed.has(GCodeLine::HasX)) { record.axes |= 1; record.x = static_cast<float>(parsed.x); }
+                    if (parsed.has(GCodeLine::HasY)) { record.axes |= 2; record.y = static_cast<float>(parsed.y); }
+                    if (parsed.has(GCodeLine::HasZ)) { record.axes |= 4; record.z = static_cast<float>(parsed.z); }
+                    if (record.axes) {
+                        record.flags |= LexRecord::Move;
+                        ++chunk.moveCount;
+                    }
+                }
+                if (record.flags) {
+                    if (record.flags & LexRecord::SetAbsolute) chunk.lastMode = 90;
+                    if (record.flags & LexRecord::SetRelative) chunk.lastMode = 91;
+                    chunk.records.push_back(record);
+                }
+            }
+            ++line;
+            p = lineEnd < chunk.end ? lineEnd + 1 : chunk.end;
+        }
+        chunk.lineCount = line;
+    }
+
+    // How the chunk changes the modal state, as a function of its entry
+    // position (its entry positioning mode is already known)
+    void summarizeChunk(Chunk& chunk) {
+        bool relative = chunk.entry.relative;
+        for (const auto& record : chunk.records) {
+            if (record.flags & LexRecord::SetAbsolute) relative = false;
+            if (record.flags & LexRecord::SetRelative) relative = true;
+            if (record.flags & LexRecord::SetFeedrate) {
+                chunk.setsFeedrate = true;
+                chunk.feedrate = record.feedrate;
+            }
+            if (record.flags & LexRecord::SetExtruding) {
+                chunk.setsExtruding = true;
+                chunk.extruding = (record.flags & LexRecord::Extruding) != 0;
+            }
+            if (record.flags & LexRecord::Move) {
+                const float values[3] = {record.x, record.y, record.z};
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (!(record.axes & (1 << axis))) continue;
+                    if (relative) {
+                        chunk.axes[axis].value += values[axis];
+                    } else {
+                        chunk.axes[axis] = {true, values[axis]};
+                    }
+                }
+            }
+        }
+    }
+
+    void resolveChunk(const Chunk& chunk, ToolpathSegment* out, uint32_t firstLine, float& leadingDwell) {
+        ToolpathParseState state = chunk.entry;
+        ToolpathSegment* segment = out;
+        leadingDwell = 0.0f;
+        for (const auto& record : chunk.records) {
+            if (record.flags & LexRecord::SetAbsolute) state.relative = false;
+            if (record.flags & LexRecord::SetRelative) state.relative = true;
+            if (record.flags & LexRecord::SetFeedrate) state.feedrate = record.feedrate;
+            if (record.flags & LexRecord::SetExtruding) state.extruding = (record.flags & LexRecord::Extruding) != 0;
+            if (record.flags & LexRecord::Dwell) {
+                if (segment > out) segment[-1].dwellAfter += record.dwell;
+                else leadingDwell += record.dwell;
+            }
+            if (record.flags & LexRecord::Move) {
+                float target[3] = {state.x, state.y, state.z};
+                const float values[3] = {record.x, record.y, record.z};
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (record.axes & (1 << axis)) {
+                        target[axis] = state.relative ? target[axis] + values[axis] : values[axis];
+                    }
+                }
+                *segment++ = {{state.x, state.y, state.z}, {target[0], target[1], target[2]},
+                              state.feedrate, 0.0f, firstLine + record.line + 1, record.note, state.extruding};
+                state.x = target[0];
+                state.y = target[1];
+                state.z = target[2];
+            }
+        }
+    }
+}
+
+void parseToolpath(const char* data, size_t size, ToolpathParseState& state,
+                   std::vector<ToolpathSegment>& segments, const ToolpathParseOptions& options) {
+    const char* end = data + size;
+    unsigned int threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+    threads = std::max(1u, threads);
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads * 4, size / std::max<size_t>(1, options.minChunkBytes)));
+
+    // Split at line boundaries
+    std::vector<Chunk> chunks;
+    chunks.reserve(chunkCount);
+    const char* begin = data;
+    for (size_t i = 0; i < chunkCount && begin < end; ++i) {
+        const char* split = i + 1 == chunkCount ? end : data + size * (i + 1) / chunkCount;
+        if (split < begin) split = begin;
+        if (split < end) {
+            split = findNewline(split, end);
+            if (split < end) ++split;
+        }
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = split;
+        chunks.push_back(std::move(chunk));
+        begin = split;
+    }
+    if (chunks.empty()) return;
+
+    // Pass 1: lex every chunk independently
+    parallelFor(chunks.size(), threads, [&](size_t i) { lexChunk(chunks[i], options.dwellUnit); });
+
+    // Prefix: positioning mode at each chunk entry
+    bool relative = state.relative;
+    for (auto& chunk : chunks) {
+        chunk.entry.relative = relative;
+        if (chunk.lastMode == 90) relative = false;
+        if (chunk.lastMode == 91) relative = true;
+    }
+
+    // Pass 2: summarize each chunk's effect on the modal state
+    parallelFor(chunks.size(), threads, [&](size_t i) { summarizeChunk(chunks[i]); });
+
+    // Prefix: entry state, first line and output slot of each chunk
+    ToolpathParseState running = state;
+    size_t segmentCount = segments.size();
+    uint32_t firstLine = state.lines;
+    std::vector<uint32_t> firstLines(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        Chunk& chunk = chunks[i];
+        const bool entryRelative = chunk.entry.relative;
+        chunk.entry = running;
+        chunk.entry.relative = entryRelative;
+        chunk.firstSegment = segmentCount;
+        firstLines[i] = firstLine;
+
+        float* position[3] = {&running.x, &running.y, &running.z};
+        for (int axis = 0; axis < 3; ++axis) {
+            *position[axis] = chunk.axes[axis].absolute ? chunk.axes[axis].value
+                                                        : *position[axis] + chunk.axes[axis].value;
+        }
+        if (chunk.setsFeedrate) running.feedrate = chunk.feedrate;
+        if (chunk.setsExtruding) running.extruding = chunk.extruding;
+        if (chunk.lastMode == 90) running.relative = false;
+        if (chunk.lastMode == 91) running.relative = true;
+        segmentCount += chunk.moveCount;
+        firstLine += chunk.lineCount;
+    }
+    running.lines = firstLine;
+
+    // Pass 3: resolve segments straight into their final slots
+    segments.resize(segmentCount);
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        resolveChunk(chunks[i], segments.data() + chunks[i].firstSegment, firstLines[i], chunks[i].leadingDwell);
+    });
+
+    // Dwells at the top of a chunk belong to the move before it
+    for (const auto& chunk : chunks) {
+        if (chunk.leadingDwell > 0 && chunk.firstSegment > 0) {
+            segments[chunk.firstSegment - 1].dwellAfter += chunk.leadingDwell;
+        }
+    }
+
+    state = running;
+}
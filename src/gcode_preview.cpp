@@ -0,0 +1,316 @@
+#include "gcode_preview.h"
+#include "gcode_lexer.h"
+#include <imgui.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+namespace {
+    constexpr size_t kNone = static_cast<size_t>(-1);
+
+    // Text scanned between cancellation checks and result hand-offs
+    constexpr size_t kScanSliceBytes = 1 << 20;
+
+    struct CaseInsensitiveHash {
+        size_t operator()(char c) const {
+            return static_cast<size_t>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    };
+
+    struct CaseInsensitiveEqual {
+        bool operator()(char a, char b) const {
+            return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+        }
+    };
+
+    // Line containing offset, searching forward from line (offsets only grow)
+    size_t lineAt(const std::vector<size_t>& starts, size_t line, size_t offset) {
+        return static_cast<size_t>(std::upper_bound(starts.begin() + line, starts.end(), offset) - starts.begin()) - 1;
+    }
+}
+
+GCodePreview::GCodePreview()
+    : m_document(std::make_shared<Document>())
+    , m_jobNotes(false)
+    , m_stopWorker(false)
+    , m_textGeneration(0)
+    , m_searchGeneration(0)
+    , m_searchText{}
+    , m_gotoLine(1)
+    , m_gotoNote(1)
+    , m_currentMatch(kNone)
+    , m_highlightLine(kNone)
+    , m_scrollTarget(kNone)
+{
+    m_worker = std::thread(&GCodePreview::workerLoop, this);
+}
+
+GCodePreview::~GCodePreview() {
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        m_stopWorker = true;
+    }
+    ++m_textGeneration;
+    ++m_searchGeneration;
+    m_jobReady.notify_one();
+    m_worker.join();
+}
+
+void GCodePreview::setText(std::string text) {
+    auto document = std::make_shared<Document>();
+    document->text = std::move(text);
+    findLineStarts(document->text.data(), document->text.size(), document->lineStarts);
+    m_document = document;
+
+    {
+        // Generations change under the job lock, so the worker never pairs a
+        // job with the generation of a later one
+        std::lock_guard<std::mutex> jobLock(m_jobMutex);
+        const uint64_t textGeneration = ++m_textGeneration;
+        const uint64_t searchGeneration = ++m_searchGeneration;
+        {
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            m_results.noteGeneration = textGeneration;
+            m_results.noteLines.clear();
+            m_results.notesDone = false;
+            m_results.searchGeneration = searchGeneration;
+            m_results.matches.clear();
+            m_results.searchDone = m_searchText[0] == '\0';
+        }
+        m_jobDocument = document;
+        m_jobNotes = true;
+        m_jobPattern = m_searchText;
+    }
+    m_jobReady.notify_one();
+
+    m_currentMatch = kNone;
+    m_highlightLine = kNone;
+    m_scrollTarget = 0;
+}
+
+size_t GCodePreview::lineCount() const {
+    return m_document->text.empty() ? 0 : m_document->lineStarts.size() - 1;
+}
+
+std::string_view GCodePreview::line(size_t index) const {
+    const Document& document = *m_document;
+    const size_t begin = document.lineStarts[index];
+    size_t end = document.lineStarts[index + 1] - 1;
+    if (end > begin && document.text[end - 1] == '\r') --end;
+    return std::string_view(document.text.data() + begin, end - begin);
+}
+
+void GCodePreview::scrollToLine(size_t line) {
+    if (lineCount() == 0) return;
+    m_highlightLine = std::min(std::max<size_t>(line, 1), lineCount()) - 1;
+    m_scrollTarget = m_highlightLine;
+}
+
+void GCodePreview::startSearch() {
+    {
+        std::lock_guard<std::mutex> jobLock(m_jobMutex);
+        const uint64_t generation = ++m_searchGeneration;
+        {
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            m_results.searchGeneration = generation;
+            m_results.matches.clear();
+            m_results.searchDone = m_searchText[0] == '\0';
+        }
+        m_jobDocument = m_document;
+        m_jobPattern = m_searchText;
+    }
+    m_jobReady.notify_one();
+    m_currentMatch = kNone;
+}
+
+void GCodePreview::jumpToMatch(size_t match) {
+    size_t line;
+    {
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        if (match >= m_results.matches.size()) return;
+        line = m_results.matches[match];
+    }
+    m_currentMatch = match;
+    scrollToLine(line + 1);
+}
+
+void GCodePreview::workerLoop() {
+    while (true) {
+        std::shared_ptr<const Document> document;
+        bool notes;
+        std::string pattern;
+        uint64_t textGeneration, searchGeneration;
+        {
+            std::unique_lock<std::mutex> lock(m_jobMutex);
+            m_jobReady.wait(lock, [this] { return m_stopWorker || m_jobDocument; });
+            if (m_stopWorker) return;
+            document = std::move(m_jobDocument);
+            notes = m_jobNotes;
+            pattern = m_jobPattern;
+            m_jobNotes = false;
+            textGeneration = m_textGeneration;
+            searchGeneration = m_searchGeneration;
+        }
+
+        if (notes) findNoteLines(*document, textGeneration);
+        if (!pattern.empty()) findMatches(*document, pattern, searchGeneration);
+    }
+}
+
+void GCodePreview::findNoteLines(const Document& document, uint64_t generation) {
+    // Generator moves end in "; Note 60 freq=...", one per line
+    static const std::string_view marker("; Note ");
+    const std::string_view text(document.text);
+    std::vector<uint32_t> found;
+    size_t line = 0;
+    size_t offset = 0;
+    while (offset < text.size()) {
+        if (m_textGeneration != generation) return;
+        const size_t sliceEnd = std::min(text.size(), offset + kScanSliceBytes);
+        found.clear();
+        while (true) {
+            const size_t hit = text.find(marker, offset);
+            if (hit == std::string_view::npos || hit >= sliceEnd) {
+                offset = hit == std::string_view::npos ? text.size() : std::max(sliceEnd, offset);
+                break;
+            }
+            const size_t hitLine = lineAt(document.lineStarts, line, hit);
+            if (found.empty() || found.back() != hitLine) found.push_back(static_cast<uint32_t>(hitLine));
+            line = hitLine;
+            offset = hit + marker.size();
+        }
+
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        if (m_results.noteGeneration != generation) return;
+        m_results.noteLines.insert(m_results.noteLines.end(), found.begin(), found.end());
+        m_results.notesDone = offset >= text.size();
+    }
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    if (m_results.noteGeneration == generation) m_results.notesDone = true;
+}
+
+void GCodePreview::findMatches(const Document& document, const std::string& pattern, uint64_t generation) {
+    const std::boyer_moore_horspool_searcher<std::string::const_iterator, CaseInsensitiveHash, CaseInsensitiveEqual>
+        searcher(pattern.begin(), pattern.end());
+    const std::string& text = document.text;
+    std::vector<uint32_t> found;
+    size_t line = 0;
+    size_t offset = 0;
+    while (offset < text.size()) {
+        if (m_searchGeneration != generation) return;
+        // Overlap the next slice by the pattern length so no match is split
+        const size_t sliceEnd = std::min(text.size(), offset + kScanSliceBytes);
+        const auto limit = text.begin() + std::min(text.size(), sliceEnd + pattern.size() - 1);
+        found.clear();
+        auto from = text.begin() + offset;
+        while (true) {
+            const auto hit = searcher(from, limit).first;
+            const size_t position = static_cast<size_t>(hit - text.begin());
+            if (hit == limit || position >= sliceEnd) break;
+            line = lineAt(document.lineStarts, line, position);
+            found.push_back(static_cast<uint32_t>(line));
+            // One entry per line: carry on from the next line
+            from = text.begin() + std::min(document.lineStarts[line + 1], text.size());
+            if (from >= limit) break;
+        }
+        offset = std::max(sliceEnd, static_cast<size_t>(from - text.begin()));
+
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        if (m_results.searchGeneration != generation) return;
+        if (!found.empty() && !m_results.matches.empty() && m_results.matches.back() == found.front()) {
+            found.erase(found.begin());
+        }
+        m_results.matches.insert(m_results.matches.end(), found.begin(), found.end());
+    }
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    if (m_results.searchGeneration == generation) m_results.searchDone = true;
+}
+
+void GCodePreview::draw() {
+    size_t noteCount, matchCount;
+    bool notesDone, searchDone;
+    {
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        noteCount = m_results.noteLines.size();
+        notesDone = m_results.notesDone;
+        matchCount = m_results.matches.size();
+        searchDone = m_results.searchDone;
+    }
+
+    ImGui::SetNextItemWidth(100.0f);
+    bool go = ImGui::InputInt("##Line", &m_gotoLine, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if (ImGui::Button("Go to Line") || go) {
+        scrollToLine(static_cast<size_t>(std::max(m_gotoLine, 1)));
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(100.0f);
+    go = ImGui::InputInt("##Note", &m_gotoNote, 0, 0, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if (ImGui::Button("Go to Note") || go) {
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        const size_t note = static_cast<size_t>(std::max(m_gotoNote, 1)) - 1;
+        if (note < m_results.noteLines.size()) {
+            m_highlightLine = m_results.noteLines[note];
+            m_scrollTarget = m_highlightLine;
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Text("of %zu%s", noteCount, notesDone ? "" : "+");
+
+    ImGui::SetNextItemWidth(200.0f);
+    if (ImGui::InputText("##Find", m_searchText, sizeof(m_searchText))) {
+        startSearch();
+        matchCount = 0;
+        searchDone = m_searchText[0] == '\0';
+    }
+    // Incremental search: follow the first match as soon as it turns up
+    if (m_currentMatch == kNone && matchCount > 0) jumpToMatch(0);
+    ImGui::SameLine();
+    if (ImGui::Button("<") && matchCount > 0) {
+        jumpToMatch(m_currentMatch == kNone || m_currentMatch == 0 ? matchCount - 1 : m_currentMatch - 1);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(">") && matchCount > 0) {
+        jumpToMatch(m_currentMatch == kNone || m_currentMatch + 1 >= matchCount ? 0 : m_currentMatch + 1);
+    }
+    ImGui::SameLine();
+    if (m_searchText[0] != '\0') {
+        ImGui::Text("%zu/%zu%s", m_currentMatch == kNone ? 0 : m_currentMatch + 1, matchCount,
+                    searchDone ? "" : "+");
+    }
+
+    ImGui::BeginChild("PreviewText", ImVec2(0, 0), true, ImGuiWindowFlags_HorizontalScrollbar);
+    const size_t lines = lineCount();
+    const float lineHeight = ImGui::GetTextLineHeightWithSpacing();
+    if (m_scrollTarget != kNone) {
+        const float centre = m_scrollTarget * lineHeight - ImGui::GetContentRegionAvail().y * 0.5f;
+        ImGui::SetScrollY(std::max(0.0f, centre));
+        m_scrollTarget = kNone;
+    }
+
+    // Only the rows in view are laid out, whatever the length of the program
+    char number[24];
+    const int digits = std::snprintf(number, sizeof(number), "%zu", lines);
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(std::min<size_t>(lines, INT32_MAX)), lineHeight);
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+            if (static_cast<size_t>(row) == m_highlightLine) {
+                const ImVec2 corner = ImGui::GetCursorScreenPos();
+                drawList->AddRectFilled(corner, ImVec2(corner.x + ImGui::GetContentRegionAvail().x, corner.y + lineHeight),
+                                        IM_COL32(255, 200, 0, 60));
+            }
+            std::snprintf(number, sizeof(number), "%*d", digits, row + 1);
+            ImGui::TextDisabled("%s", number);
+            ImGui::SameLine();
+            const std::string_view text = line(static_cast<size_t>(row));
+            ImGui::TextUnformatted(text.data(), text.data() + text.size());
+        }
+    }
+    clipper.End();
+    ImGui::EndChild();
+}
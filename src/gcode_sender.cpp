@@ -0,0 +1,465 @@
+#include "gcode_sender.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace {
+    // Some boards take a couple of seconds to boot after the port resets them
+    constexpr std::chrono::milliseconds kProbeInterval{2000};
+    constexpr std::chrono::milliseconds kQuietPeriod{300};
+
+    std::string trim(const std::string& text) {
+        const size_t begin = text.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) return std::string();
+        const size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    std::string toLower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    bool startsWith(const std::string& text, const char* prefix) {
+        return text.rfind(prefix, 0) == 0;
+    }
+
+    // Append received bytes and move every complete line out of pending
+    void splitReplies(std::string& pending, const char* data, int count, std::vector<std::string>& replies) {
+        pending.append(data, static_cast<size_t>(count));
+        size_t start = 0;
+        size_t end;
+        while ((end = pending.find('\n', start)) != std::string::npos) {
+            std::string reply = trim(pending.substr(start, end - start));
+            if (!reply.empty()) replies.push_back(std::move(reply));
+            start = end + 1;
+        }
+        pending.erase(0, start);
+    }
+}
+
+GCodeSenderConfig GCodeSenderConfig::fromProfile(const PrinterProfile& profile) {
+    GCodeSenderConfig config;
+    switch (profile.dialect) {
+        case FirmwareDialect::Grbl:
+            // Grbl has no line numbers or checksums, and streams by character
+            // counting against its 128-byte serial buffer
+            config.checksums = false;
+            config.maxOutstandingLines = 32;
+            config.rxBufferBytes = 127;
+            break;
+        case FirmwareDialect::Klipper:
+        case FirmwareDialect::RepRapFirmware:
+            config.maxOutstandingLines = 8;
+            config.rxBufferBytes = 255;
+            break;
+        case FirmwareDialect::Marlin:
+        default:
+            // Marlin's defaults: BUFSIZE 4 and a 128-byte RX ring
+            config.maxOutstandingLines = 4;
+            config.rxBufferBytes = 127;
+            break;
+    }
+    return config;
+}
+
+std::string GCodeSenderStats::summary() const {
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "Sent " << linesSent << " lines, " << bytesSent << " bytes in " << elapsed << " s ("
+        << (elapsed > 0 ? linesSent / elapsed : 0.0) << " lines/s, "
+        << (elapsed > 0 ? bytesSent / elapsed : 0.0) << " B/s); "
+        << resends << " resends, " << errors << " errors\n"
+        << "Waited " << flowWaitTime << " s for the printer, " << stalls << " stalls (longest "
+        << std::setprecision(3) << longestStall << " s); starved " << std::setprecision(1) << starvedTime << " s\n";
+    return out.str();
+}
+
+GCodeSender::GCodeSender(const GCodeSenderConfig& config)
+    : m_config(config)
+    , m_state(SenderState::Connecting)
+    , m_cancelRequested(false)
+    , m_finishRequested(false)
+    , m_historyFirst(1)
+    , m_nextLine(1)
+    , m_inFlightBytes(0)
+    , m_swallowOks(0)
+    , m_duplicateResends(0)
+    , m_lastResend(0)
+{
+    m_config.maxOutstandingLines = std::max<size_t>(m_config.maxOutstandingLines, 1);
+}
+
+GCodeSender::~GCodeSender() {
+    cancel();
+}
+
+bool GCodeSender::open(const std::string& port) {
+    if (m_thread.joinable()) {
+        if (m_state == SenderState::Connecting || m_state == SenderState::Connected) return false;
+        m_thread.join();
+    }
+    m_port.close();
+    if (!m_port.open(port, m_config.baudRate)) {
+        return false;
+    }
+    // Start over, in case an earlier connection was cancelled or failed
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.clear();
+        m_finishRequested = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats = GCodeSenderStats();
+        m_error.clear();
+    }
+    m_history.clear();
+    m_historyFirst = 1;
+    m_nextLine = 1;
+    m_inFlight.clear();
+    m_inFlightBytes = 0;
+    m_swallowOks = 0;
+    m_duplicateResends = 0;
+    m_lastResend = 0;
+    m_replyBuffer.clear();
+    m_cancelRequested = false;
+    m_state = SenderState::Connecting;
+    m_thread = std::thread(&GCodeSender::run, this);
+    return true;
+}
+
+bool GCodeSender::acceptsLines() const {
+    return !m_cancelRequested && m_state != SenderState::Failed && m_state != SenderState::Finished;
+}
+
+void GCodeSender::writeLine(const std::string& line) {
+    // Checked under the lock, so nothing slips in after cancel empties the queue
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    if (!acceptsLines()) return;
+    m_queue.push_back(line);
+}
+
+void GCodeSender::send(const std::string& gcode) {
+    std::istringstream lines(gcode);
+    std::string line;
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    if (!acceptsLines()) return;
+    while (std::getline(lines, line)) {
+        m_queue.push_back(line);
+    }
+}
+
+void GCodeSender::finish() {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_finishRequested = true;
+}
+
+bool GCodeSender::wait() {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    return m_state == SenderState::Finished;
+}
+
+void GCodeSender::cancel() {
+    m_cancelRequested = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_port.close();
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_queue.clear();
+}
+
+std::string GCodeSender::error() const {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_error;
+}
+
+GCodeSenderStats GCodeSender::stats() const {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+uint8_t GCodeSender::checksum(const std::string& text) {
+    uint8_t sum = 0;
+    for (char c : text) {
+        sum ^= static_cast<uint8_t>(c);
+    }
+    return sum;
+}
+
+std::string GCodeSender::prepareLine(const std::string& line, size_t number) const {
+    // Comments cost buffer space and the firmware ignores them anyway
+    std::string text = trim(line.substr(0, line.find(';')));
+    if (text.empty()) return text;
+
+    if (m_config.checksums) {
+        text = "N" + std::to_string(number) + " " + text;
+        text += "*" + std::to_string(checksum(text));
+    }
+    text += '\n';
+    return text;
+}
+
+void GCodeSender::fail(const std::string& message) {
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_error = message;
+    }
+    m_state = SenderState::Failed;
+}
+
+bool GCodeSender::handshake() {
+    // M110 N0 also resets the firmware's line numbering; G4 P0 is a no-op
+    // every firmware answers
+    const std::string probe = m_config.checksums ? prepareLine("M110 N0", 0) : "G4 P0\n";
+    const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                             std::chrono::duration<double>(m_config.connectTimeout));
+    auto nextProbe = Clock::now();
+    std::vector<std::string> replies;
+    char buffer[256];
+    bool answered = false;
+    while (!answered) {
+        if (m_cancelRequested) return false;
+        const auto now = Clock::now();
+        if (now >= deadline) {
+            fail("The printer did not answer");
+            return false;
+        }
+        if (now >= nextProbe) {
+            if (!m_port.write(probe.data(), probe.size())) {
+                fail("Lost the connection to the printer");
+                return false;
+            }
+            nextProbe = now + kProbeInterval;
+        }
+        const int count = m_port.read(buffer, sizeof(buffer), std::chrono::milliseconds(100));
+        if (count < 0) {
+            fail("Lost the connection to the printer");
+            return false;
+        }
+        replies.clear();
+        splitReplies(m_replyBuffer, buffer, count, replies);
+        for (const auto& reply : replies) {
+            if (startsWith(toLower(reply), "ok")) answered = true;
+        }
+    }
+
+    // A board that was still booting may answer a repeated probe as well;
+    // let those replies go by before counting oks
+    const auto quietDeadline = Clock::now() + kProbeInterval;
+    while (Clock::now() < quietDeadline) {
+        const int count = m_port.read(buffer, sizeof(buffer), kQuietPeriod);
+        if (count <= 0) break;
+    }
+    m_replyBuffer.clear();
+    return true;
+}
+
+const std::string* GCodeSender::nextLine() {
+    if (m_nextLine < m_historyFirst + m_history.size()) {
+        return &m_history[m_nextLine - m_historyFirst];
+    }
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    while (!m_queue.empty()) {
+        std::string prepared = prepareLine(m_queue.front(), m_nextLine);
+        m_queue.pop_front();
+        if (prepared.empty()) continue;
+        m_history.push_back(std::move(prepared));
+        return &m_history.back();
+    }
+    return nullptr;
+}
+
+bool GCodeSender::fits(const std::string& line) const {
+    // A line longer than the whole buffer still goes, alone
+    if (m_inFlight.empty()) return true;
+    return m_inFlight.size() < m_config.maxOutstandingLines &&
+           m_inFlightBytes + line.size() <= m_config.rxBufferBytes;
+}
+
+void GCodeSender::rewind(size_t lineNumber) {
+    // The firmware drops what it had buffered after the bad line, so
+    // nothing sent is outstanding any more
+    m_nextLine = lineNumber;
+    m_inFlight.clear();
+    m_inFlightBytes = 0;
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++m_stats.resends;
+}
+
+void GCodeSender::handleReply(const std::string& reply) {
+    m_lastReply = Clock::now();
+    const std::string lower = toLower(reply);
+
+    bool acknowledged = false;
+    if (startsWith(lower, "ok")) {
+        if (m_swallowOks > 0) {
+            --m_swallowOks;
+            return;
+        }
+        acknowledged = true;
+    } else if (startsWith(lower, "resend") || startsWith(lower, "rs ")) {
+        // Without line numbers there is nothing to resend from
+        if (!m_config.checksums) return;
+        const size_t digits = lower.find_first_of("0123456789");
+        if (digits == std::string::npos) return;
+        const size_t lineNumber = std::strtoull(lower.c_str() + digits, nullptr, 10);
+
+        ++m_swallowOks;
+        // Lines that were already on their way when the firmware flushed
+        // its buffer each ask for the same line again
+        if (lineNumber == m_lastResend && m_duplicateResends > 0) {
+            --m_duplicateResends;
+            return;
+        }
+        if (lineNumber < m_historyFirst || lineNumber > m_historyFirst + m_history.size()) {
+            fail("The printer asked for line " + std::to_string(lineNumber) + ", which is no longer buffered");
+            return;
+        }
+        m_duplicateResends = m_nextLine > lineNumber + 1 ? m_nextLine - lineNumber - 1 : 0;
+        m_lastResend = lineNumber;
+        rewind(lineNumber);
+        return;
+    } else if (startsWith(lower, "!!") || startsWith(lower, "alarm") || lower.find("halted") != std::string::npos ||
+               lower.find("kill() called") != std::string::npos) {
+        fail("Printer stopped: " + reply);
+        return;
+    } else if (startsWith(lower, "error")) {
+        // Checksum and line number errors come with a resend request
+        if (lower.find("checksum") != std::string::npos || lower.find("line number") != std::string::npos) return;
+        std::cerr << "Printer: " << reply << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            ++m_stats.errors;
+        }
+        // Grbl answers a rejected line with error:<code> in place of ok
+        acknowledged = lower.size() > 6 && std::isdigit(static_cast<unsigned char>(lower[6]));
+    }
+    if (!acknowledged || m_inFlight.empty()) return;
+
+    m_inFlightBytes -= m_inFlight.front();
+    m_inFlight.pop_front();
+    m_duplicateResends = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        ++m_stats.linesAcknowledged;
+    }
+    const size_t firstUnacknowledged = m_nextLine - m_inFlight.size();
+    while (!m_history.empty() && m_historyFirst + kResendHistory < firstUnacknowledged) {
+        m_history.pop_front();
+        ++m_historyFirst;
+    }
+}
+
+void GCodeSender::run() {
+    if (!handshake()) {
+        if (m_cancelRequested) fail("Cancelled");
+        return;
+    }
+    m_state = SenderState::Connected;
+
+    const auto responseTimeout = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(m_config.responseTimeout));
+    const auto start = Clock::now();
+    auto lastTick = start;
+    auto blockedSince = start;
+    bool blocked = false;
+    bool starved = false;
+    m_lastReply = start;
+
+    std::vector<std::string> replies;
+    char buffer[256];
+    while (!m_cancelRequested) {
+        // Charge the time since the last pass to what the sender was waiting on
+        const auto now = Clock::now();
+        const double elapsed = std::chrono::duration<double>(now - lastTick).count();
+        lastTick = now;
+
+        const bool wasBlocked = blocked;
+        bool sent = false;
+        blocked = false;
+        starved = false;
+        for (;;) {
+            const std::string* line = nextLine();
+            if (!line) {
+                starved = true;
+                break;
+            }
+            if (!fits(*line)) {
+                blocked = true;
+                break;
+            }
+            if (m_inFlight.empty()) m_lastReply = now; // The response timeout starts with the first line
+            if (!m_port.write(line->data(), line->size())) {
+                fail("Lost the connection to the printer");
+                return;
+            }
+            m_inFlight.push_back(line->size());
+            m_inFlightBytes += line->size();
+            ++m_nextLine;
+            sent = true;
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            ++m_stats.linesSent;
+            m_stats.bytesSent += line->size();
+        }
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            done = m_finishRequested && m_queue.empty();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            m_stats.elapsed = std::chrono::duration<double>(now - start).count();
+            if (wasBlocked) {
+                m_stats.flowWaitTime += elapsed;
+            } else if (starved && !done) {
+                m_stats.starvedTime += elapsed;
+            }
+            // A stall is a long wait for the window to open, however often it opens
+            if (wasBlocked && sent) {
+                const double waited = std::chrono::duration<double>(now - blockedSince).count();
+                if (waited >= m_config.stallThreshold) {
+                    ++m_stats.stalls;
+                    m_stats.longestStall = std::max(m_stats.longestStall, waited);
+                }
+            }
+        }
+        if (blocked && (sent || !wasBlocked)) blockedSince = now;
+        if (starved && done && m_inFlight.empty()) {
+            m_state = SenderState::Finished;
+            return;
+        }
+
+        if (!m_inFlight.empty() && now - m_lastReply > responseTimeout) {
+            // Without line numbers a resend could run a line twice
+            if (!m_config.checksums) {
+                fail("The printer stopped answering");
+                return;
+            }
+            rewind(m_nextLine - m_inFlight.size());
+            m_lastReply = now;
+        }
+
+        const int count = m_port.read(buffer, sizeof(buffer), kPollInterval);
+        if (count < 0) {
+            fail("Lost the connection to the printer");
+            return;
+        }
+        replies.clear();
+        splitReplies(m_replyBuffer, buffer, count, replies);
+        for (const auto& reply : replies) {
+            handleReply(reply);
+            if (m_state == SenderState::Failed) return;
+        }
+    }
+    fail("Cancelled");
+}
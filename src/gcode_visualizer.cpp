@@ -1,19 +1,30 @@
 #include "gcode_visualizer.h"
 #include <glad/glad.h>
-#include <sstream>
-#include <regex>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
 
 static const char* vertexShaderSource = R"(
     #version 330 core
     layout (location = 0) in vec3 aPos;
-    layout (location = 1) in vec3 aColor;
+    layout (location = 1) in uint aAttributes;
     uniform mat4 view;
     uniform mat4 proj;
+    uniform vec3 origin;
+    uniform vec3 step;
+    uniform vec3 palette[3];
     out vec3 fragColor;
     void main() {
-        gl_Position = proj * view * vec4(aPos, 1.0);
-        fragColor = aColor;
+        gl_Position = proj * view * vec4(origin + aPos * step, 1.0);
+        fragColor = palette[min(aAttributes, 2u)];
     }
 )";
 
@@ -30,11 +41,47 @@ GCodeVisualizer::GCodeVisualizer()
     : m_vao(0)
     , m_vbo(0)
     , m_shader(0)
+    , m_vertexCapacity(0)
+    , m_uploadedVertices(0)
+    , m_frame{glm::vec3(0.0f), glm::vec3(1.0f)}
+    , m_lodVao(0)
+    , m_lodVbo(0)
+    , m_lodBufferVertices(0)
+    , m_indexReady(false)
+    , m_cancelIndex(false)
+    , m_boundsMin(0.0f)
+    , m_boundsMax(0.0f)
+    , m_currentLod(0)
+    , m_visibleChunks(0)
+    , m_playbackActive(false)
+    , m_playbackTime(0.0)
+    , m_completedSegments(0)
+    , m_markerSegment(static_cast<size_t>(-1))
+    , m_markerEnds{}
+    , m_markerVao(0)
+    , m_markerVbo(0)
     , m_scale(1.0f)
-    , m_currentX(0.0f)
-    , m_currentY(0.0f)
-    , m_currentZ(0.0f)
-    , m_isExtruding(false)
+    , m_loaderDone(true)
+    , m_loadedMin(0.0f)
+    , m_loadedMax(0.0f)
+    , m_cancelLoad(false)
+    , m_bytesParsed(0)
+    , m_bytesTotal(0)
+    , m_uploadBudgetMs(2.0)
+    , m_indexing(false)
+    , m_memoryBudget(kDefaultMemoryBudget)
+    , m_residentLevel(static_cast<size_t>(-1))
+    , m_frameNumber(0)
+    , m_fbo(0)
+    , m_colorTexture(0)
+    , m_targetWidth(0)
+    , m_targetHeight(0)
+    , m_revision(1)
+    , m_renderedRevision(0)
+    , m_renderedScale(0.0f)
+    , m_interactiveScale(0.5f)
+    , m_renderIncomplete(false)
+    , m_renderedExtent(1.0f)
 {
     m_center = glm::vec3(0.0f);
     
@@ -42,9 +89,16 @@ GCodeVisualizer::GCodeVisualizer()
 }
 
 GCodeVisualizer::~GCodeVisualizer() {
+    cancelLoad();
     if (m_vao) glDeleteVertexArrays(1, &m_vao);
     if (m_vbo) glDeleteBuffers(1, &m_vbo);
+    if (m_lodVao) glDeleteVertexArrays(1, &m_lodVao);
+    if (m_lodVbo) glDeleteBuffers(1, &m_lodVbo);
+    if (m_markerVao) glDeleteVertexArrays(1, &m_markerVao);
+    if (m_markerVbo) glDeleteBuffers(1, &m_markerVbo);
     if (m_shader) glDeleteProgram(m_shader);
+    if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
+    if (m_colorTexture) glDeleteTextures(1, &m_colorTexture);
 }
 
 void GCodeVisualizer::initializeGL() {
@@ -96,6 +150,15 @@ void GCodeVisualizer::initializeGL() {
     // Create VAO and VBO
     glGenVertexArrays(1, &m_vao);
     glGenBuffers(1, &m_vbo);
+    glGenVertexArrays(1, &m_lodVao);
+    glGenBuffers(1, &m_lodVbo);
+
+    // Toolhead marker: the partial segment plus a three-axis cross
+    glGenVertexArrays(1, &m_markerVao);
+    glGenBuffers(1, &m_markerVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_markerVbo);
+    glBufferData(GL_ARRAY_BUFFER, 8 * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+    configureVertexLayout(m_markerVao, m_markerVbo);
 
     // Initialize view matrix
     m_view = glm::lookAt(
@@ -109,80 +172,1089 @@ void GCodeVisualizer::initializeGL() {
     m_proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 1000.0f);
 }
 
+GCodeVisualizer::Vertex GCodeVisualizer::QuantizationFrame::encode(const float position[3], uint16_t attributes,
+                                                                   size_t& clamped) const {
+    Vertex vertex;
+    bool outside = false;
+    for (int axis = 0; axis < 3; ++axis) {
+        float q = std::round((position[axis] - origin[axis]) / step[axis]);
+        if (q < 0.0f || q > 65535.0f) {
+            outside = true;
+            q = std::min(65535.0f, std::max(0.0f, q));
+        }
+        vertex.position[axis] = static_cast<uint16_t>(q);
+    }
+    vertex.attributes = attributes;
+    if (outside) ++clamped;
+    return vertex;
+}
+
+glm::vec3 GCodeVisualizer::QuantizationFrame::decode(const Vertex& vertex) const {
+    return glm::vec3(origin.x + vertex.position[0] * step.x,
+                     origin.y + vertex.position[1] * step.y,
+                     origin.z + vertex.position[2] * step.z);
+}
+
+GCodeVisualizer::QuantizationFrame GCodeVisualizer::QuantizationFrame::forBounds(const glm::vec3& min,
+                                                                                 const glm::vec3& max) {
+    QuantizationFrame frame{min, glm::vec3(0.0f)};
+    for (int axis = 0; axis < 3; ++axis) {
+        frame.step[axis] = std::max(max[axis] - min[axis], 1e-3f) / 65535.0f;
+    }
+    return frame;
+}
+
+void GCodeVisualizer::encodeSegments(const std::vector<ToolpathSegment>& segments, const QuantizationFrame& frame,
+                                     std::vector<Vertex>& vertices, size_t& clamped) {
+    vertices.reserve(vertices.size() + segments.size() * 2);
+    for (const auto& segment : segments) {
+        const uint16_t attributes = segment.extruding ? kExtruding : kTravel;
+        vertices.push_back(frame.encode(segment.start, attributes, clamped));
+        vertices.push_back(frame.encode(segment.end, attributes, clamped));
+    }
+}
+
+void GCodeVisualizer::SegmentTimeline::append(const SegmentTimeline& other) {
+    starts.insert(starts.end(), other.starts.begin(), other.starts.end());
+    ends.insert(ends.end(), other.ends.begin(), other.ends.end());
+    lines.insert(lines.end(), other.lines.begin(), other.lines.end());
+    notes.insert(notes.end(), other.notes.begin(), other.notes.end());
+    noteSegments.insert(noteSegments.end(), other.noteSegments.begin(), other.noteSegments.end());
+}
+
+void GCodeVisualizer::SegmentTimeline::clear() {
+    starts.clear();
+    ends.clear();
+    lines.clear();
+    notes.clear();
+    noteSegments.clear();
+}
+
+void GCodeVisualizer::recordSegments(const std::vector<ToolpathSegment>& segments, size_t firstSegment,
+                                     double& clock, SegmentTimeline& timeline) {
+    timeline.starts.reserve(timeline.starts.size() + segments.size());
+    timeline.ends.reserve(timeline.ends.size() + segments.size());
+    timeline.lines.reserve(timeline.lines.size() + segments.size());
+    timeline.notes.reserve(timeline.notes.size() + segments.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const ToolpathSegment& segment = segments[i];
+        const float dx = segment.end[0] - segment.start[0];
+        const float dy = segment.end[1] - segment.start[1];
+        const float dz = segment.end[2] - segment.start[2];
+        const float feedrate = segment.feedrate > 0.0f ? segment.feedrate : kDefaultFeedrate;
+        timeline.starts.push_back(static_cast<float>(clock));
+        clock += std::sqrt(dx * dx + dy * dy + dz * dz) / (feedrate / 60.0f);
+        timeline.ends.push_back(static_cast<float>(clock));
+        clock += segment.dwellAfter;
+
+        timeline.lines.push_back(segment.line);
+        timeline.notes.push_back(static_cast<int8_t>(segment.note >= 0 && segment.note < 128 ? segment.note : -1));
+        if (segment.note >= 0) timeline.noteSegments.push_back(static_cast<uint32_t>(firstSegment + i));
+    }
+}
+
 void GCodeVisualizer::loadGCode(const std::string& gcode) {
-    m_lines.clear();
-    parseGCode(gcode);
-    updateBuffers();
+    cancelLoad();
+    closeIndex();
+    m_parseState = ToolpathParseState();
+    std::vector<ToolpathSegment> segments = parseGCode(gcode);
+    m_timeline.clear();
+    m_markerSegment = static_cast<size_t>(-1);
+    double clock = 0.0;
+    recordSegments(segments, 0, clock, m_timeline);
+
+    glm::vec3 min(0.0f), max(0.0f);
+    if (!segments.empty()) {
+        min = max = glm::vec3(segments.front().start[0], segments.front().start[1], segments.front().start[2]);
+    }
+    for (const auto& segment : segments) {
+        for (const float* point : {segment.start, segment.end}) {
+            const glm::vec3 p(point[0], point[1], point[2]);
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+    }
+    m_frame = QuantizationFrame::forBounds(min, max);
+    m_boundsMin = min;
+    m_boundsMax = max;
+
+    std::vector<Vertex> vertices;
+    size_t clamped = 0;
+    encodeSegments(segments, m_frame, vertices, clamped);
+    std::vector<ToolpathSegment>().swap(segments);
+    updateBuffers(vertices);
+    startIndexBuild(std::move(vertices));
 }
 
-void GCodeVisualizer::parseGCode(const std::string& gcode) {
-    std::istringstream stream(gcode);
-    std::string line;
+ToolpathParseOptions GCodeVisualizer::optionsFor(const std::string& gcode) {
+    // GRBL takes G4 P in seconds, everything else in milliseconds
+    ToolpathParseOptions options;
+    if (gcode.substr(0, 4096).find("; Firmware: GRBL") != std::string::npos) {
+        options.dwellUnit = 1.0;
+    }
+    return options;
+}
+
+std::vector<ToolpathSegment> GCodeVisualizer::parseGCode(const std::string& gcode) {
+    std::vector<ToolpathSegment> segments;
+    parseToolpath(gcode.data(), gcode.size(), m_parseState, segments, optionsFor(gcode));
+    return segments;
+}
+
+void GCodeVisualizer::configureVertexLayout(unsigned int vao, unsigned int vbo) {
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    // Quantized position, scaled into the frame by the shader
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(0);
     
-    while (std::getline(stream, line)) {
-        if (line.empty() || line[0] == ';') continue;
-        
-        std::smatch match;
-        std::regex coords("([GXYZEF])(-?\\d*\\.?\\d+)");
-        
-        int command = -1;
-        float x = m_currentX;
-        float y = m_currentY;
-        float z = m_currentZ;
-        bool hasMove = false;
-        
-        std::string::const_iterator searchStart(line.cbegin());
-        while (std::regex_search(searchStart, line.cend(), match, coords)) {
-            char type = match[1].str()[0];
-            float value = std::stof(match[2]);
-            
-            switch (type) {
-                case 'G': command = static_cast<int>(value); break;
-                case 'X': x = value; hasMove = true; break;
-                case 'Y': y = value; hasMove = true; break;
-                case 'Z': z = value; hasMove = true; break;
-                case 'E': m_isExtruding = value > 0; break;
+    // Palette index
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(Vertex), (void*)(3 * sizeof(uint16_t)));
+    glEnableVertexAttribArray(1);
+}
+
+void GCodeVisualizer::updateBuffers(const std::vector<Vertex>& vertices) {
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    m_vertexCapacity = vertices.size();
+    m_uploadedVertices = vertices.size();
+    configureVertexLayout(m_vao, m_vbo);
+    invalidate();
+}
+
+void GCodeVisualizer::loadGCodeProgressive(std::string gcode) {
+    cancelLoad();
+    closeIndex();
+    m_uploadedVertices = 0;
+    m_parseState = ToolpathParseState();
+    m_timeline.clear();
+    m_markerSegment = static_cast<size_t>(-1);
+
+    // A move line is rarely shorter than ~24 bytes; the buffer grows if it is
+    reserveVertices(std::max<size_t>(gcode.size() / 24 * 2, 1024));
+
+    m_bytesTotal = gcode.size();
+    m_bytesParsed = 0;
+    m_cancelLoad = false;
+    m_loaderDone = false;
+    ToolpathParseOptions options = optionsFor(gcode);
+    m_loader = std::thread(&GCodeVisualizer::produceChunks, this, std::move(gcode), options);
+}
+
+void GCodeVisualizer::produceChunks(std::string gcode, ToolpathParseOptions options) {
+    // Each slice is small enough to parse on this thread alone
+    options.threads = 1;
+    ToolpathParseState state;
+    std::vector<ToolpathSegment> segments;
+    std::vector<Vertex> all;
+    QuantizationFrame frame{glm::vec3(0.0f), glm::vec3(kStreamingStep)};
+    bool haveFrame = false;
+    bool haveBounds = false;
+    size_t clamped = 0;
+    glm::vec3 min(0.0f), max(0.0f);
+    double clock = 0.0;
+
+    const char* begin = gcode.data();
+    const char* end = begin + gcode.size();
+    while (begin < end && !m_cancelLoad) {
+        const char* sliceEnd = end - begin > static_cast<ptrdiff_t>(kChunkBytes) ? begin + kChunkBytes : end;
+        sliceEnd = findNewline(sliceEnd, end);
+        if (sliceEnd < end) ++sliceEnd;
+
+        segments.clear();
+        parseToolpath(begin, static_cast<size_t>(sliceEnd - begin), state, segments, options);
+        for (const auto& segment : segments) {
+            for (const float* point : {segment.start, segment.end}) {
+                const glm::vec3 p(point[0], point[1], point[2]);
+                min = haveBounds ? glm::min(min, p) : p;
+                max = haveBounds ? glm::max(max, p) : p;
+                haveBounds = true;
             }
-            
-            searchStart = match.suffix().first;
         }
-        
-        if (hasMove && (command == 0 || command == 1)) {
-            glm::vec3 color = m_isExtruding ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
-            m_lines.push_back({
-                glm::vec3(m_currentX, m_currentY, m_currentZ),
-                glm::vec3(x, y, z),
-                color
-            });
-            
-            m_currentX = x;
-            m_currentY = y;
-            m_currentZ = z;
+
+        LoadedChunk chunk{{}, {}, false, frame};
+        if (!haveFrame && !segments.empty()) {
+            const glm::vec3 center = (min + max) * 0.5f;
+            frame.origin = center - glm::vec3(32767.5f * kStreamingStep);
+            chunk.hasFrame = true;
+            chunk.frame = frame;
+            haveFrame = true;
         }
+        encodeSegments(segments, frame, chunk.vertices, clamped);
+        recordSegments(segments, all.size() / 2, clock, chunk.timeline);
+        all.insert(all.end(), chunk.vertices.begin(), chunk.vertices.end());
+
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        m_queueSpace.wait(lock, [this] { return m_queue.size() < kMaxQueuedChunks || m_cancelLoad; });
+        if (m_cancelLoad) break;
+        m_queue.push_back(std::move(chunk));
+        m_bytesParsed = static_cast<size_t>(sliceEnd - gcode.data());
+        begin = sliceEnd;
+    }
+    if (clamped > 0) {
+        std::cerr << "G-code preview: " << clamped << " vertices lie outside the preview volume" << std::endl;
     }
+
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_parseState = state;
+    m_loadedVertices = std::move(all);
+    m_loadedMin = min;
+    m_loadedMax = max;
+    m_loaderDone = true;
 }
 
-void GCodeVisualizer::updateBuffers() {
-    m_vertices.clear();
-    for (const auto& line : m_lines) {
-        m_vertices.push_back({line.start, line.color});
-        m_vertices.push_back({line.end, line.color});
+void GCodeVisualizer::cancelLoad() {
+    cancelIndexBuild();
+    if (!m_loader.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_cancelLoad = true;
+    }
+    m_queueSpace.notify_all();
+    m_loader.join();
+    m_queue.clear();
+    std::vector<Vertex>().swap(m_loadedVertices);
+    m_loaderDone = true;
+    m_indexing = false;
+}
+
+void GCodeVisualizer::reserveVertices(size_t count) {
+    if (count <= m_vertexCapacity) return;
+
+    // Grow into a new buffer and copy what has been uploaded so far
+    unsigned int buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, count * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+    if (m_uploadedVertices > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_uploadedVertices * sizeof(Vertex));
+    }
+    if (m_vbo) glDeleteBuffers(1, &m_vbo);
+    m_vbo = buffer;
+    m_vertexCapacity = count;
+    configureVertexLayout(m_vao, m_vbo);
+}
+
+void GCodeVisualizer::appendVertices(const std::vector<Vertex>& vertices) {
+    const size_t first = m_uploadedVertices;
+    const size_t total = first + vertices.size();
+    if (total > m_vertexCapacity) {
+        reserveVertices(std::max(total, m_vertexCapacity * 2));
     }
-    
-    glBindVertexArray(m_vao);
     glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Vertex), m_vertices.data(), GL_STATIC_DRAW);
-    
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(0);
-    
-    // Color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+    m_uploadedVertices = total;
+    invalidate();
+}
+
+void GCodeVisualizer::uploadPending() {
+    if (m_indexReady) {
+        installIndex();
+    }
+    if (!m_loader.joinable()) return;
+
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(m_uploadBudgetMs));
+    bool finished = false;
+    do {
+        LoadedChunk chunk;
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (m_queue.empty()) {
+                finished = m_loaderDone;
+                break;
+            }
+            chunk = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_queueSpace.notify_one();
+        if (chunk.hasFrame) m_frame = chunk.frame;
+        appendVertices(chunk.vertices);
+        m_timeline.append(chunk.timeline);
+    } while (std::chrono::steady_clock::now() < deadline);
+
+    if (finished) {
+        m_loader.join();
+        if (m_indexing) {
+            m_indexing = false;
+            if (!m_indexPath.empty()) openIndex(m_indexPath);
+            return;
+        }
+        m_boundsMin = m_loadedMin;
+        m_boundsMax = m_loadedMax;
+        startIndexBuild(std::move(m_loadedVertices));
+        m_loadedVertices.clear();
+    }
+}
+
+bool GCodeVisualizer::isLoading() const {
+    return m_loader.joinable();
+}
+
+float GCodeVisualizer::loadProgress() const {
+    if (!isLoading() || m_bytesTotal == 0) return 1.0f;
+    return static_cast<float>(m_bytesParsed.load()) / static_cast<float>(m_bytesTotal);
+}
+
+namespace {
+    const char kIndexMagic[8] = {'M', '2', 'G', 'I', 'N', 'D', 'E', 'X'};
+
+    uint64_t alignedSize(uint64_t bytes) {
+        return (bytes + 7) & ~uint64_t(7);
+    }
+
+    int64_t modifiedTime(const std::string& path) {
+        std::error_code error;
+        const auto time = std::filesystem::last_write_time(path, error);
+        return error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+    // One index section, collected in its own temporary file until the sizes
+    // of all sections are known
+    class SectionWriter {
+    public:
+        explicit SectionWriter(std::string path)
+            : m_path(std::move(path)), m_out(m_path, std::ios::binary | std::ios::trunc), m_bytes(0) {}
+
+        ~SectionWriter() {
+            m_out.close();
+            std::error_code ignored;
+            std::filesystem::remove(m_path, ignored);
+        }
+
+        bool good() const { return m_out.good(); }
+        uint64_t bytes() const { return m_bytes; }
+
+        template <typename T>
+        void append(const T* items, size_t count) {
+            m_out.write(reinterpret_cast<const char*>(items), static_cast<std::streamsize>(count * sizeof(T)));
+            m_bytes += count * sizeof(T);
+        }
+
+        // Copy the section to out, padded to the next 8 bytes
+        bool copyTo(std::ostream& out, std::vector<char>& buffer) {
+            m_out.close();
+            std::ifstream in(m_path, std::ios::binary);
+            uint64_t left = m_bytes;
+            while (left > 0) {
+                const size_t count = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+                if (!in.read(buffer.data(), static_cast<std::streamsize>(count))) return false;
+                out.write(buffer.data(), static_cast<std::streamsize>(count));
+                left -= count;
+            }
+            static const char padding[8] = {};
+            out.write(padding, static_cast<std::streamsize>(alignedSize(m_bytes) - m_bytes));
+            return out.good();
+        }
+
+    private:
+        std::string m_path;
+        std::ofstream m_out;
+        uint64_t m_bytes;
+    };
+}
+
+bool GCodeVisualizer::loadGCodeFile(const std::string& path, size_t memoryBudget) {
+    cancelLoad();
+    closeIndex();
+    m_uploadedVertices = 0;
+    m_timeline.clear();
+    m_markerSegment = static_cast<size_t>(-1);
+    m_memoryBudget = memoryBudget;
+
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        std::cerr << "G-code preview: cannot open " << path << std::endl;
+        return false;
+    }
+    const int64_t modified = modifiedTime(path);
+
+    // Next to the file, or in the temp directory when that isn't writable
+    std::vector<std::string> candidates{path + ".m2gidx"};
+    const std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+    if (!error) {
+        std::stringstream name;
+        name << std::filesystem::path(path).filename().string() << "-" << std::hex
+             << std::hash<std::string>()(std::filesystem::absolute(path, error).string()) << ".m2gidx";
+        candidates.push_back((temp / name.str()).string());
+    }
+
+    for (const auto& candidate : candidates) {
+        MappedFile index;
+        if (index.open(candidate) && indexMatches(index, size, modified)) {
+            return openIndex(candidate);
+        }
+    }
+
+    m_bytesTotal = static_cast<size_t>(size);
+    m_bytesParsed = 0;
+    m_cancelLoad = false;
+    m_loaderDone = false;
+    m_indexing = true;
+    m_indexPath.clear();
+    m_loader = std::thread(&GCodeVisualizer::produceIndex, this, path, std::move(candidates));
+    return true;
+}
+
+void GCodeVisualizer::produceIndex(std::string gcodePath, std::vector<std::string> indexPaths) {
+    std::string written;
+    MappedFile source;
+    if (!source.open(gcodePath)) {
+        std::cerr << "G-code preview: cannot map " << gcodePath << std::endl;
+    } else {
+        const int64_t modified = modifiedTime(gcodePath);
+        for (const auto& indexPath : indexPaths) {
+            if (m_cancelLoad) break;
+            if (writeFileIndex(source, modified, indexPath, m_cancelLoad, m_bytesParsed)) {
+                written = indexPath;
+                break;
+            }
+        }
+        if (written.empty() && !m_cancelLoad) {
+            std::cerr << "G-code preview: cannot write an index for " << gcodePath << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_indexPath = written;
+    m_loaderDone = true;
+}
+
+bool GCodeVisualizer::writeFileIndex(const MappedFile& source, int64_t sourceModified, const std::string& indexPath,
+                                     const std::atomic<bool>& cancel, std::atomic<size_t>& progress) {
+    // Written under a temporary name and renamed, so a cancelled or failed
+    // build never leaves a header that claims to be complete
+    const std::string partial = indexPath + ".partial";
+    std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    struct RemovePartial {
+        const std::string& path;
+        bool keep = false;
+        ~RemovePartial() {
+            if (keep) return;
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        }
+    } removePartial{partial};
+
+    SectionWriter vertexSection(partial + ".vertices");
+    SectionWriter startSection(partial + ".starts");
+    SectionWriter endSection(partial + ".ends");
+    SectionWriter lineSection(partial + ".lines");
+    SectionWriter noteSection(partial + ".notes");
+    SectionWriter noteSegmentSection(partial + ".noteSegments");
+    SectionWriter chunkSection(partial + ".chunks");
+    std::vector<std::unique_ptr<SectionWriter>> levelVertexSections;
+    std::vector<std::unique_ptr<SectionWriter>> levelReachedSections;
+    for (size_t level = 0; level < kMaxLodLevels; ++level) {
+        levelVertexSections.push_back(std::make_unique<SectionWriter>(partial + ".lod" + std::to_string(level)));
+        levelReachedSections.push_back(std::make_unique<SectionWriter>(partial + ".reached" + std::to_string(level)));
+    }
+    std::vector<float> levelErrors(kMaxLodLevels, 0.0f);
+
+    const char* data = source.data();
+    const size_t size = source.size();
+    const ToolpathParseOptions options = optionsFor(std::string(data, std::min<size_t>(size, 4096)));
+    ToolpathParseState state;
+    std::vector<ToolpathSegment> segments;
+    std::vector<Vertex> vertices;
+    std::vector<SegmentChunk> chunks;
+    SegmentTimeline timeline;
+    QuantizationFrame frame{glm::vec3(0.0f), glm::vec3(kStreamingStep)};
+    bool haveFrame = false;
+    bool haveBounds = false;
+    size_t clamped = 0;
+    glm::vec3 min(0.0f), max(0.0f);
+    double clock = 0.0;
+    uint64_t segmentTotal = 0;
+    uint64_t noteTotal = 0;
+    uint64_t chunkTotal = 0;
+
+    // Slices are parsed on all cores, then encoded and simplified on their
+    // own, so only one slice of the path is ever in memory
+    const char* begin = data;
+    const char* end = data + size;
+    while (begin < end) {
+        if (cancel) return false;
+        const char* sliceEnd = end - begin > static_cast<ptrdiff_t>(kIndexSliceBytes) ? begin + kIndexSliceBytes : end;
+        sliceEnd = findNewline(sliceEnd, end);
+        if (sliceEnd < end) ++sliceEnd;
+
+        segments.clear();
+        parseToolpath(begin, static_cast<size_t>(sliceEnd - begin), state, segments, options);
+        for (const auto& segment : segments) {
+            for (const float* point : {segment.start, segment.end}) {
+                const glm::vec3 p(point[0], point[1], point[2]);
+                min = haveBounds ? glm::min(min, p) : p;
+                max = haveBounds ? glm::max(max, p) : p;
+                haveBounds = true;
+            }
+        }
+        if (!haveFrame && !segments.empty()) {
+            frame.origin = (min + max) * 0.5f - glm::vec3(32767.5f * kStreamingStep);
+            haveFrame = true;
+        }
+
+        vertices.clear();
+        encodeSegments(segments, frame, vertices, clamped);
+        timeline.clear();
+        recordSegments(segments, static_cast<size_t>(segmentTotal), clock, timeline);
+        vertexSection.append(vertices.data(), vertices.size());
+        startSection.append(timeline.starts.data(), timeline.starts.size());
+        endSection.append(timeline.ends.data(), timeline.ends.size());
+        lineSection.append(timeline.lines.data(), timeline.lines.size());
+        noteSection.append(timeline.notes.data(), timeline.notes.size());
+        noteSegmentSection.append(timeline.noteSegments.data(), timeline.noteSegments.size());
+
+        chunks.clear();
+        splitChunks(vertices, frame, kFileChunkExtent, static_cast<uint32_t>(segmentTotal), chunks);
+        chunkSection.append(chunks.data(), chunks.size());
+
+        std::vector<LodLevel> levels = buildLodLevels(vertices, frame, cancel, false);
+        for (size_t level = 0; level < levels.size(); ++level) {
+            for (auto& reached : levels[level].reached) reached += static_cast<uint32_t>(segmentTotal);
+            levelVertexSections[level]->append(levels[level].vertices.data(), levels[level].vertices.size());
+            levelReachedSections[level]->append(levels[level].reached.data(), levels[level].reached.size());
+            levelErrors[level] = levels[level].maxError;
+        }
+
+        segmentTotal += segments.size();
+        noteTotal += timeline.noteSegments.size();
+        chunkTotal += chunks.size();
+        progress = static_cast<size_t>(sliceEnd - data);
+        begin = sliceEnd;
+    }
+    if (clamped > 0) {
+        std::cerr << "G-code preview: " << clamped << " vertices lie outside the preview volume" << std::endl;
+    }
+
+    // Keep the levels that still shrink the path, as buildLodLevels does
+    uint32_t levelCount = 0;
+    uint64_t previousCount = segmentTotal * 2;
+    for (size_t level = 0; level < kMaxLodLevels; ++level) {
+        const uint64_t count = levelVertexSections[level]->bytes() / sizeof(Vertex);
+        if (count > previousCount * 3 / 4) {
+            if (count < previousCount) ++levelCount;
+            break;
+        }
+        ++levelCount;
+        previousCount = count;
+    }
+
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+    header.version = kIndexVersion;
+    header.levelCount = levelCount;
+    header.sourceSize = size;
+    header.sourceModified = sourceModified;
+    header.dwellUnit = options.dwellUnit;
+    header.segmentCount = segmentTotal;
+    header.noteCount = noteTotal;
+    header.chunkCount = chunkTotal;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.origin[axis] = frame.origin[axis];
+        header.step[axis] = frame.step[axis];
+        header.boundsMin[axis] = min[axis];
+        header.boundsMax[axis] = max[axis];
+    }
+
+    SectionWriter* sections[] = {&vertexSection, &startSection, &endSection, &lineSection,
+                                 &noteSection, &noteSegmentSection, &chunkSection};
+    uint64_t* offsets[] = {&header.vertices, &header.starts, &header.ends, &header.lines,
+                           &header.notes, &header.noteSegments, &header.chunks};
+    uint64_t offset = alignedSize(sizeof(IndexHeader));
+    for (size_t i = 0; i < 7; ++i) {
+        *offsets[i] = offset;
+        offset += alignedSize(sections[i]->bytes());
+    }
+    header.levels = offset;
+    offset += alignedSize(levelCount * sizeof(IndexLevel));
+    std::vector<IndexLevel> levelTable(levelCount);
+    for (size_t level = 0; level < levelCount; ++level) {
+        IndexLevel& entry = levelTable[level];
+        entry = {levelErrors[level], 0, levelVertexSections[level]->bytes() / sizeof(Vertex), offset, 0};
+        offset += alignedSize(levelVertexSections[level]->bytes());
+        entry.reached = offset;
+        offset += alignedSize(levelReachedSections[level]->bytes());
+    }
+
+    static const char padding[8] = {};
+    std::vector<char> buffer(1 << 20);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(padding, static_cast<std::streamsize>(alignedSize(sizeof(header)) - sizeof(header)));
+    for (SectionWriter* section : sections) {
+        if (!section->copyTo(out, buffer)) return false;
+    }
+    out.write(reinterpret_cast<const char*>(levelTable.data()),
+              static_cast<std::streamsize>(levelTable.size() * sizeof(IndexLevel)));
+    for (size_t level = 0; level < levelCount; ++level) {
+        if (cancel) return false;
+        if (!levelVertexSections[level]->copyTo(out, buffer)) return false;
+        if (!levelReachedSections[level]->copyTo(out, buffer)) return false;
+    }
+    out.close();
+    if (!out) return false;
+
+    std::error_code error;
+    std::filesystem::rename(partial, indexPath, error);
+    if (error) return false;
+    removePartial.keep = true;
+    return true;
+}
+
+bool GCodeVisualizer::indexMatches(const MappedFile& index, uint64_t sourceSize, int64_t sourceModified) {
+    const uint64_t size = index.size();
+    if (size < sizeof(IndexHeader)) return false;
+    const IndexHeader& header = *reinterpret_cast<const IndexHeader*>(index.data());
+    if (std::memcmp(header.magic, kIndexMagic, sizeof(header.magic)) != 0 || header.version != kIndexVersion ||
+        header.sourceSize != sourceSize || header.sourceModified != sourceModified) {
+        return false;
+    }
+
+    // Every section has to lie inside the file
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t itemSize) {
+        return offset <= size && count <= (size - offset) / itemSize;
+    };
+    const uint64_t segments = header.segmentCount;
+    if (!fits(header.vertices, segments, 2 * sizeof(Vertex)) || !fits(header.starts, segments, sizeof(float)) ||
+        !fits(header.ends, segments, sizeof(float)) || !fits(header.lines, segments, sizeof(uint32_t)) ||
+        !fits(header.notes, segments, sizeof(int8_t)) ||
+        !fits(header.noteSegments, header.noteCount, sizeof(uint32_t)) ||
+        !fits(header.chunks, header.chunkCount, sizeof(SegmentChunk)) ||
+        !fits(header.levels, header.levelCount, sizeof(IndexLevel))) {
+        return false;
+    }
+    const IndexLevel* levels = reinterpret_cast<const IndexLevel*>(index.data() + header.levels);
+    for (uint32_t i = 0; i < header.levelCount; ++i) {
+        if (!fits(levels[i].vertices, levels[i].vertexCount, sizeof(Vertex)) ||
+            !fits(levels[i].reached, levels[i].vertexCount / 2, sizeof(uint32_t))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GCodeVisualizer::openIndex(const std::string& path) {
+    closeIndex();
+    if (!m_index.open(path) || m_index.size() < sizeof(IndexHeader)) {
+        std::cerr << "G-code preview: cannot map " << path << std::endl;
+        m_index.close();
+        return false;
+    }
+
+    const IndexHeader& header = indexHeader();
+    m_frame = {glm::vec3(header.origin[0], header.origin[1], header.origin[2]),
+               glm::vec3(header.step[0], header.step[1], header.step[2])};
+    m_boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    m_boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    const SegmentChunk* chunks = reinterpret_cast<const SegmentChunk*>(m_index.data() + header.chunks);
+    m_chunks.assign(chunks, chunks + header.chunkCount);
+    buildBvh(m_chunks, m_chunkOrder, m_bvh);
+
+    const IndexLevel* levels = reinterpret_cast<const IndexLevel*>(m_index.data() + header.levels);
+    m_indexLevels.assign(levels, levels + header.levelCount);
+    for (const auto& level : m_indexLevels) {
+        m_lodLevels.push_back({{}, {}, level.maxError, 0, static_cast<size_t>(level.vertexCount)});
+    }
+    m_currentLod = 0;
+
+    // Slots get what is left of half the budget after the tables; the
+    // resident LOD level gets the other half
+    const size_t tables = m_chunks.size() * (sizeof(SegmentChunk) + sizeof(uint32_t) + sizeof(int32_t)) +
+                          m_bvh.size() * sizeof(BvhNode);
+    const size_t slotBytes = kSlotVertices * sizeof(Vertex);
+    const size_t slotBudget = m_memoryBudget / 2 > tables ? m_memoryBudget / 2 - tables : 0;
+    const size_t slots = std::min(std::max(kMinSlots, slotBudget / slotBytes), std::max<size_t>(m_chunks.size(), 1));
+    m_slotChunks.assign(slots, -1);
+    m_slotUsed.assign(slots, 0);
+    m_chunkSlots.assign(m_chunks.size(), -1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, slots * slotBytes, nullptr, GL_DYNAMIC_DRAW);
+    m_vertexCapacity = slots * kSlotVertices;
+    m_uploadedVertices = 0;
+    configureVertexLayout(m_vao, m_vbo);
+    configureVertexLayout(m_lodVao, m_lodVbo);
+    invalidate();
+    return true;
+}
+
+void GCodeVisualizer::closeIndex() {
+    m_index.close();
+    m_indexLevels.clear();
+    m_slotChunks.clear();
+    m_slotUsed.clear();
+    m_chunkSlots.clear();
+    m_residentLevel = static_cast<size_t>(-1);
+
+    // Tables of the previous path, whichever way it was loaded
+    m_lodLevels.clear();
+    m_chunks.clear();
+    m_chunkOrder.clear();
+    m_bvh.clear();
+    invalidate();
+}
+
+size_t GCodeVisualizer::segmentCount() const {
+    return m_index.isOpen() ? static_cast<size_t>(indexHeader().segmentCount) : m_uploadedVertices / 2;
+}
+
+GCodeVisualizer::TimelineView GCodeVisualizer::timelineView() const {
+    if (m_index.isOpen()) {
+        const IndexHeader& header = indexHeader();
+        const char* base = m_index.data();
+        return {reinterpret_cast<const float*>(base + header.starts),
+                reinterpret_cast<const float*>(base + header.ends),
+                reinterpret_cast<const uint32_t*>(base + header.lines),
+                reinterpret_cast<const int8_t*>(base + header.notes),
+                reinterpret_cast<const uint32_t*>(base + header.noteSegments),
+                static_cast<size_t>(header.segmentCount), static_cast<size_t>(header.noteCount)};
+    }
+    return {m_timeline.starts.data(), m_timeline.ends.data(), m_timeline.lines.data(), m_timeline.notes.data(),
+            m_timeline.noteSegments.data(), m_timeline.starts.size(), m_timeline.noteSegments.size()};
+}
+
+size_t GCodeVisualizer::residentBytes() const {
+    size_t bytes = (m_vertexCapacity + m_lodBufferVertices) * sizeof(Vertex);
+    bytes += m_chunks.size() * sizeof(SegmentChunk) + m_chunkOrder.size() * sizeof(uint32_t) +
+             m_bvh.size() * sizeof(BvhNode);
+    bytes += m_chunkSlots.size() * sizeof(int32_t) + m_slotChunks.size() * (sizeof(int32_t) + sizeof(uint64_t));
+    bytes += m_timeline.starts.size() * (2 * sizeof(float) + sizeof(uint32_t) + sizeof(int8_t)) +
+             m_timeline.noteSegments.size() * sizeof(uint32_t);
+    for (const auto& level : m_lodLevels) {
+        bytes += level.reached.size() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+namespace {
+    // Douglas-Peucker, marking the vertices to keep. Long runs are cut into
+    // spans with fixed endpoints so a near-closed spiral cannot go quadratic.
+    void simplifyPolyline(const std::vector<glm::vec3>& points, float tolerance, std::vector<char>& keep) {
+        constexpr size_t kMaxSpan = 4096;
+        keep.assign(points.size(), 0);
+        keep.front() = keep.back() = 1;
+        std::vector<std::pair<size_t, size_t>> stack;
+        for (size_t first = 0; first + 1 < points.size(); first += kMaxSpan) {
+            const size_t last = std::min(first + kMaxSpan, points.size() - 1);
+            keep[last] = 1;
+            stack.emplace_back(first, last);
+        }
+        const float toleranceSq = tolerance * tolerance;
+        while (!stack.empty()) {
+            const size_t first = stack.back().first;
+            const size_t last = stack.back().second;
+            stack.pop_back();
+
+            const glm::vec3 a = points[first];
+            const glm::vec3 ab = points[last] - a;
+            const float abLengthSq = glm::dot(ab, ab);
+            float worstSq = 0.0f;
+            size_t worst = first;
+            for (size_t i = first + 1; i < last; ++i) {
+                glm::vec3 ap = points[i] - a;
+                float t = abLengthSq > 0.0f ? std::min(1.0f, std::max(0.0f, glm::dot(ap, ab) / abLengthSq)) : 0.0f;
+                glm::vec3 offset = ap - ab * t;
+                float distanceSq = glm::dot(offset, offset);
+                if (distanceSq > worstSq) {
+                    worstSq = distanceSq;
+                    worst = i;
+                }
+            }
+            if (worstSq > toleranceSq) {
+                keep[worst] = 1;
+                if (worst - first > 1) stack.emplace_back(first, worst);
+                if (last - worst > 1) stack.emplace_back(worst, last);
+            }
+        }
+    }
+}
+
+std::vector<GCodeVisualizer::LodLevel> GCodeVisualizer::buildLodLevels(const std::vector<Vertex>& vertices,
+                                                                       const QuantizationFrame& frame,
+                                                                       const std::atomic<bool>& cancel,
+                                                                       bool adaptive) {
+    // Split the path into connected runs of one attribute. Quantized
+    // positions compare exactly, so joins are found without a tolerance.
+    struct Run {
+        std::vector<glm::vec3> points;
+        std::vector<uint32_t> reached; // Source segments done on arriving at each point
+        uint16_t attributes;
+    };
+    auto samePosition = [](const Vertex& a, const Vertex& b) {
+        return a.position[0] == b.position[0] && a.position[1] == b.position[1] && a.position[2] == b.position[2];
+    };
+    std::vector<Run> runs;
+    const Vertex* previousEnd = nullptr;
+    for (size_t i = 0; i + 1 < vertices.size(); i += 2) {
+        const Vertex& start = vertices[i];
+        const Vertex& end = vertices[i + 1];
+        if (samePosition(start, end)) continue;
+        const uint32_t segment = static_cast<uint32_t>(i / 2);
+        if (!previousEnd || !samePosition(*previousEnd, start) || runs.back().attributes != start.attributes) {
+            runs.push_back({{frame.decode(start)}, {segment}, start.attributes});
+        }
+        runs.back().points.push_back(frame.decode(end));
+        runs.back().reached.push_back(segment + 1);
+        previousEnd = &end;
+    }
+
+    // Each level simplifies the one before it, so its error bound is the sum
+    // of the tolerances used so far plus the rounding back onto the grid
+    std::vector<LodLevel> levels;
+    size_t previousCount = vertices.size();
+    float tolerance = kLodBaseError;
+    float maxError = glm::length(frame.step) * 0.5f;
+    std::vector<char> keep;
+    size_t clamped = 0;
+    for (size_t level = 0; level < kMaxLodLevels && !cancel; ++level) {
+        maxError += tolerance;
+        LodLevel lod{{}, {}, maxError, 0, 0};
+        for (auto& run : runs) {
+            if (run.points.size() > 2) {
+                simplifyPolyline(run.points, tolerance, keep);
+                size_t kept = 0;
+                for (size_t i = 0; i < run.points.size(); ++i) {
+                    if (keep[i]) {
+                        run.points[kept] = run.points[i];
+                        run.reached[kept] = run.reached[i];
+                        ++kept;
+                    }
+                }
+                run.points.resize(kept);
+                run.reached.resize(kept);
+            }
+            for (size_t i = 1; i < run.points.size(); ++i) {
+                lod.vertices.push_back(frame.encode(&run.points[i - 1].x, run.attributes, clamped));
+                lod.vertices.push_back(frame.encode(&run.points[i].x, run.attributes, clamped));
+                lod.reached.push_back(run.reached[i]);
+            }
+        }
+        // Stop once simplifying further barely pays
+        if (adaptive && lod.vertices.size() > previousCount * 3 / 4) {
+            if (lod.vertices.size() >= previousCount) break;
+            previousCount = lod.vertices.size();
+            levels.push_back(std::move(lod));
+            break;
+        }
+        previousCount = lod.vertices.size();
+        levels.push_back(std::move(lod));
+        tolerance *= kLodErrorGrowth;
+    }
+    return levels;
+}
+
+void GCodeVisualizer::buildChunkIndex(const std::vector<Vertex>& vertices, const QuantizationFrame& frame,
+                                      std::vector<SegmentChunk>& chunks, std::vector<uint32_t>& order,
+                                      std::vector<BvhNode>& nodes) {
+    if (vertices.size() < 2) return;
+
+    glm::vec3 pathMin = frame.decode(vertices[0]);
+    glm::vec3 pathMax = pathMin;
+    for (const auto& vertex : vertices) {
+        const glm::vec3 p = frame.decode(vertex);
+        pathMin = glm::min(pathMin, p);
+        pathMax = glm::max(pathMax, p);
+    }
+    const float maxExtent = std::max(1.0f, glm::length(pathMax - pathMin) * kMaxChunkExtent);
+    splitChunks(vertices, frame, maxExtent, 0, chunks);
+    buildBvh(chunks, order, nodes);
+}
+
+void GCodeVisualizer::splitChunks(const std::vector<Vertex>& vertices, const QuantizationFrame& frame,
+                                  float maxExtent, uint32_t firstSegment, std::vector<SegmentChunk>& chunks) {
+    const size_t segments = vertices.size() / 2;
+    if (segments == 0) return;
+
+    // Cut the path into consecutive runs that stay inside a small box
+    SegmentChunk chunk{};
+    for (size_t i = 0; i < segments; ++i) {
+        const glm::vec3 a = frame.decode(vertices[2 * i]);
+        const glm::vec3 b = frame.decode(vertices[2 * i + 1]);
+        const glm::vec3 segmentMin = glm::min(a, b);
+        const glm::vec3 segmentMax = glm::max(a, b);
+        if (i > 0) {
+            const glm::vec3 grownMin = glm::min(chunk.min, segmentMin);
+            const glm::vec3 grownMax = glm::max(chunk.max, segmentMax);
+            const glm::vec3 extent = grownMax - grownMin;
+            if (chunk.segmentCount < kMaxChunkSegments &&
+                std::max(extent.x, std::max(extent.y, extent.z)) <= maxExtent) {
+                chunk.min = grownMin;
+                chunk.max = grownMax;
+                ++chunk.segmentCount;
+                continue;
+            }
+            chunks.push_back(chunk);
+        }
+        chunk = {segmentMin, segmentMax, static_cast<uint32_t>(firstSegment + i), 1};
+    }
+    chunks.push_back(chunk);
+}
+
+void GCodeVisualizer::buildBvh(const std::vector<SegmentChunk>& chunks, std::vector<uint32_t>& order,
+                               std::vector<BvhNode>& nodes) {
+    order.clear();
+    nodes.clear();
+    if (chunks.empty()) return;
+
+    // Top-down median split on the longest axis of the chunk centres. Nodes
+    // are laid out depth first so a left child always follows its parent.
+    constexpr uint32_t kLeafChunks = 4;
+    order.resize(chunks.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    struct Pending {
+        uint32_t begin, end;
+        size_t parent; // Node whose right link this fills, or npos for left children and the root
+    };
+    const size_t npos = static_cast<size_t>(-1);
+    std::vector<Pending> stack{{0, static_cast<uint32_t>(order.size()), npos}};
+    nodes.reserve(chunks.size() / 2 + 1);
+    while (!stack.empty()) {
+        const Pending pending = stack.back();
+        stack.pop_back();
+        const size_t index = nodes.size();
+        if (pending.parent != npos) nodes[pending.parent].first = static_cast<uint32_t>(index);
+
+        BvhNode node{chunks[order[pending.begin]].min, chunks[order[pending.begin]].max, 0, 0};
+        glm::vec3 centreMin = (node.min + node.max) * 0.5f;
+        glm::vec3 centreMax = centreMin;
+        for (uint32_t i = pending.begin; i < pending.end; ++i) {
+            const SegmentChunk& c = chunks[order[i]];
+            node.min = glm::min(node.min, c.min);
+            node.max = glm::max(node.max, c.max);
+            const glm::vec3 centre = (c.min + c.max) * 0.5f;
+            centreMin = glm::min(centreMin, centre);
+            centreMax = glm::max(centreMax, centre);
+        }
+        if (pending.end - pending.begin <= kLeafChunks) {
+            node.first = pending.begin;
+            node.count = pending.end - pending.begin;
+            nodes.push_back(node);
+            continue;
+        }
+        nodes.push_back(node);
+
+        const glm::vec3 spread = centreMax - centreMin;
+        const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+        const uint32_t middle = pending.begin + (pending.end - pending.begin) / 2;
+        std::nth_element(order.begin() + pending.begin, order.begin() + middle, order.begin() + pending.end,
+                         [&](uint32_t a, uint32_t b) {
+                             return chunks[a].min[axis] + chunks[a].max[axis] < chunks[b].min[axis] + chunks[b].max[axis];
+                         });
+        stack.push_back({middle, pending.end, index});
+        stack.push_back({pending.begin, middle, npos});
+    }
+}
+
+void GCodeVisualizer::startIndexBuild(std::vector<Vertex> vertices) {
+    cancelIndexBuild();
+    m_lodLevels.clear();
+    m_chunks.clear();
+    m_chunkOrder.clear();
+    m_bvh.clear();
+    m_currentLod = 0;
+    if (vertices.empty()) return;
+
+    // The builder owns the only CPU copy of the path and frees it when done
+    m_cancelIndex = false;
+    m_indexReady = false;
+    m_indexBuilder = std::thread([this, frame = m_frame, path = std::move(vertices)]() mutable {
+        std::vector<SegmentChunk> chunks;
+        std::vector<uint32_t> order;
+        std::vector<BvhNode> nodes;
+        buildChunkIndex(path, frame, chunks, order, nodes);
+        std::vector<LodLevel> levels = buildLodLevels(path, frame, m_cancelIndex);
+        std::vector<Vertex>().swap(path);
+        if (m_cancelIndex) return;
+        m_builtLodLevels = std::move(levels);
+        m_builtChunks = std::move(chunks);
+        m_builtChunkOrder = std::move(order);
+        m_builtBvh = std::move(nodes);
+        m_indexReady = true;
+    });
+}
+
+void GCodeVisualizer::cancelIndexBuild() {
+    if (!m_indexBuilder.joinable()) return;
+    m_cancelIndex = true;
+    m_indexBuilder.join();
+    m_indexReady = false;
+    m_builtLodLevels.clear();
+    m_builtChunks.clear();
+    m_builtChunkOrder.clear();
+    m_builtBvh.clear();
+}
+
+void GCodeVisualizer::installIndex() {
+    m_indexBuilder.join();
+    m_indexReady = false;
+    m_lodLevels = std::move(m_builtLodLevels);
+    m_builtLodLevels.clear();
+    m_chunks = std::move(m_builtChunks);
+    m_chunkOrder = std::move(m_builtChunkOrder);
+    m_bvh = std::move(m_builtBvh);
+
+    size_t total = 0;
+    for (auto& level : m_lodLevels) {
+        level.first = total;
+        level.count = level.vertices.size();
+        total += level.count;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_lodVbo);
+    glBufferData(GL_ARRAY_BUFFER, total * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+    for (auto& level : m_lodLevels) {
+        glBufferSubData(GL_ARRAY_BUFFER, level.first * sizeof(Vertex), level.count * sizeof(Vertex),
+                        level.vertices.data());
+        std::vector<Vertex>().swap(level.vertices);
+    }
+    m_lodBufferVertices = total;
+    configureVertexLayout(m_lodVao, m_lodVbo);
+    invalidate();
+}
+
+float GCodeVisualizer::pixelWorldSize(float viewportHeight, bool nearestPoint) const {
+    if (viewportHeight <= 0.0f) return 0.0f;
+
+    // The view matrix carries the zoom (m_scale) as a uniform scale
+    const glm::vec3 center = (m_boundsMin + m_boundsMax) * 0.5f;
+    const float radius = nearestPoint ? glm::length(m_boundsMax - m_boundsMin) * 0.5f : 0.0f;
+    const float viewScale = glm::length(glm::vec3(m_view[0][0], m_view[0][1], m_view[0][2]));
+    if (viewScale <= 0.0f || m_proj[1][1] <= 0.0f) return 0.0f;
+    float pixelSize;
+    if (m_proj[3][3] == 1.0f) {
+        // Orthographic
+        pixelSize = 2.0f / (m_proj[1][1] * viewportHeight);
+    } else {
+        const glm::vec4 viewCenter = m_view * glm::vec4(center, 1.0f);
+        const float depth = -viewCenter.z - radius * viewScale;
+        if (depth <= 0.0f) return 0.0f;
+        pixelSize = 2.0f * depth / (m_proj[1][1] * viewportHeight);
+    }
+    return pixelSize / viewScale;
+}
+
+size_t GCodeVisualizer::selectLodLevel() const {
+    if (m_lodLevels.empty() || m_indexReady || isLoading()) return 0;
+
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const float pixelSize = pixelWorldSize(static_cast<float>(viewport[3]), true);
+    if (pixelSize <= 0.0f) return 0;
+    const float allowedError = kLodPixelTolerance * pixelSize;
+
+    size_t selected = 0;
+    for (size_t i = 0; i < m_lodLevels.size(); ++i) {
+        if (m_lodLevels[i].maxError <= allowedError) selected = i + 1;
+    }
+    return selected;
 }
 
 void GCodeVisualizer::render() {
+    uploadPending();
     glUseProgram(m_shader);
     
     // Set uniforms
@@ -190,16 +1262,540 @@ void GCodeVisualizer::render() {
     int projLoc = glGetUniformLocation(m_shader, "proj");
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &m_view[0][0]);
     glUniformMatrix4fv(projLoc, 1, GL_FALSE, &m_proj[0][0]);
+    glUniform3fv(glGetUniformLocation(m_shader, "origin"), 1, &m_frame.origin[0]);
+    glUniform3fv(glGetUniformLocation(m_shader, "step"), 1, &m_frame.step[0]);
+
+    // Travel moves blue, extruding moves red, toolhead marker yellow
+    const float palette[] = {0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.9f, 0.0f};
+    glUniform3fv(glGetUniformLocation(m_shader, "palette"), 3, palette);
     
-    glBindVertexArray(m_vao);
-    glDrawArrays(GL_LINES, 0, m_vertices.size());
+    const size_t segments = segmentCount();
+    const size_t completed = m_playbackActive ? std::min(m_completedSegments, segments) : segments;
+    if (m_index.isOpen()) {
+        renderPaged(completed);
+    } else {
+        m_currentLod = selectLodLevel();
+        m_visibleChunks = m_chunks.size();
+        if (m_currentLod == 0) {
+            glBindVertexArray(m_vao);
+            if (m_bvh.empty() || m_indexReady) {
+                glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(completed * 2));
+            } else {
+                drawVisibleChunks(completed);
+            }
+        } else {
+            const LodLevel& level = m_lodLevels[m_currentLod - 1];
+            glBindVertexArray(m_lodVao);
+            glDrawArrays(GL_LINES, static_cast<GLint>(level.first),
+                         static_cast<GLsizei>(visibleLodVertices(level, completed)));
+        }
+    }
+
+    if (m_playbackActive && m_markerSegment < segments) {
+        glBindVertexArray(m_markerVao);
+        glDrawArrays(GL_LINES, 0, 8);
+    }
+}
+
+unsigned int GCodeVisualizer::renderToTexture(int width, int height, bool interacting) {
+    uploadPending();
+    const auto now = std::chrono::steady_clock::now();
+    const double frameSeconds = std::chrono::duration<double>(now - m_lastTargetFrame).count();
+    m_lastTargetFrame = now;
+    if (width <= 0 || height <= 0) return m_colorTexture;
+
+    if (width != m_targetWidth || height != m_targetHeight) {
+        if (!m_fbo) {
+            glGenFramebuffers(1, &m_fbo);
+            glGenTextures(1, &m_colorTexture);
+            glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        GLint previous;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "G-code preview: offscreen framebuffer is incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previous));
+        m_targetWidth = width;
+        m_targetHeight = height;
+        m_renderedScale = 0.0f;
+    }
+
+    // Trade resolution for frame rate while the view moves
+    if (interacting) {
+        if (frameSeconds > kSlowFrameSeconds) {
+            m_interactiveScale = std::max(kMinInteractiveScale, m_interactiveScale * 0.8f);
+        } else if (frameSeconds < kFastFrameSeconds) {
+            m_interactiveScale = std::min(1.0f, m_interactiveScale * 1.05f);
+        }
+    }
+    const float scale = interacting ? m_interactiveScale : 1.0f;
+    const bool stale = m_renderedRevision != m_revision || m_renderIncomplete || m_renderedScale == 0.0f;
+    if (!stale && (interacting || m_renderedScale == 1.0f)) return m_colorTexture;
+
+    const int renderWidth = std::max(1, static_cast<int>(width * scale + 0.5f));
+    const int renderHeight = std::max(1, static_cast<int>(height * scale + 0.5f));
+    GLint previousFramebuffer;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glViewport(0, 0, renderWidth, renderHeight);
+    glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Anything render() itself changes (late uploads) marks the next frame stale
+    const uint64_t revision = m_revision;
+    m_renderIncomplete = false;
+    render();
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFramebuffer));
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    m_renderedRevision = revision;
+    m_renderedScale = scale;
+    m_renderedExtent = glm::vec2(static_cast<float>(renderWidth) / width, static_cast<float>(renderHeight) / height);
+    return m_colorTexture;
+}
+
+size_t GCodeVisualizer::visibleLodVertices(const LodLevel& level, size_t completed) const {
+    if (!m_playbackActive) return level.count;
+    // LOD segments that end before the toolhead's last completed segment
+    auto end = std::upper_bound(level.reached.begin(), level.reached.end(), static_cast<uint32_t>(completed));
+    return static_cast<size_t>(end - level.reached.begin()) * 2;
+}
+
+void GCodeVisualizer::setPlaybackTime(double seconds) {
+    if (!m_playbackActive || seconds != m_playbackTime) invalidate();
+    m_playbackActive = true;
+    m_playbackTime = seconds;
+
+    // Last segment that has started by now; it is complete once its motion ends
+    const TimelineView timeline = timelineView();
+    const float* started = std::upper_bound(timeline.starts, timeline.starts + timeline.segments,
+                                            static_cast<float>(seconds));
+    if (started == timeline.starts) {
+        m_completedSegments = 0;
+        m_markerSegment = static_cast<size_t>(-1);
+        return;
+    }
+    const size_t current = static_cast<size_t>(started - timeline.starts) - 1;
+    m_completedSegments = seconds >= timeline.ends[current] ? current + 1 : current;
+    updateMarker(current, seconds);
+}
+
+void GCodeVisualizer::clearPlaybackTime() {
+    if (m_playbackActive) invalidate();
+    m_playbackActive = false;
+}
+
+double GCodeVisualizer::totalPrintTime() const {
+    const TimelineView timeline = timelineView();
+    return timeline.segments == 0 ? 0.0 : timeline.ends[timeline.segments - 1];
+}
+
+void GCodeVisualizer::setSongTime(double songSeconds) {
+    // Find the note sounding now and run from its move's start at print speed
+    // until the next note's move begins
+    const TimelineView timeline = timelineView();
+    const uint32_t* noteSegments = timeline.noteSegments;
+    const size_t notes = std::min(m_noteOnsets.size(), timeline.noteCount);
+    auto next = std::upper_bound(m_noteOnsets.begin(), m_noteOnsets.begin() + notes, songSeconds);
+    if (next == m_noteOnsets.begin()) {
+        setPlaybackTime(notes > 0 ? timeline.starts[noteSegments[0]] : songSeconds);
+        return;
+    }
+    const size_t note = static_cast<size_t>(next - m_noteOnsets.begin()) - 1;
+    double printTime = timeline.starts[noteSegments[note]] + (songSeconds - m_noteOnsets[note]);
+    if (note + 1 < notes) {
+        printTime = std::min<double>(printTime, timeline.starts[noteSegments[note + 1]]);
+    }
+    setPlaybackTime(printTime);
+}
+
+void GCodeVisualizer::updateMarker(size_t segment, double seconds) {
+    if (segment >= segmentCount()) {
+        m_markerSegment = static_cast<size_t>(-1);
+        return;
+    }
+
+    // The path only lives on the GPU or in the index; fetch the two vertices
+    // of a new segment
+    if (segment != m_markerSegment) {
+        if (m_index.isOpen()) {
+            std::copy(indexVertices() + segment * 2, indexVertices() + segment * 2 + 2, m_markerEnds);
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glGetBufferSubData(GL_ARRAY_BUFFER, segment * 2 * sizeof(Vertex), 2 * sizeof(Vertex), m_markerEnds);
+        }
+        m_markerSegment = segment;
+    }
+
+    const TimelineView timeline = timelineView();
+    const float start = timeline.starts[segment];
+    const float duration = timeline.ends[segment] - start;
+    const float t = duration > 0.0f ? std::min(1.0f, std::max(0.0f, static_cast<float>(seconds - start) / duration)) : 1.0f;
+    const glm::vec3 a = m_frame.decode(m_markerEnds[0]);
+    const glm::vec3 b = m_frame.decode(m_markerEnds[1]);
+    const glm::vec3 head = a + (b - a) * t;
+    const float arm = std::max(1.0f, glm::length(m_boundsMax - m_boundsMin) * 0.01f);
+
+    size_t clamped = 0;
+    const glm::vec3 points[8] = {
+        a, head,
+        head - glm::vec3(arm, 0.0f, 0.0f), head + glm::vec3(arm, 0.0f, 0.0f),
+        head - glm::vec3(0.0f, arm, 0.0f), head + glm::vec3(0.0f, arm, 0.0f),
+        head - glm::vec3(0.0f, 0.0f, arm), head + glm::vec3(0.0f, 0.0f, arm)
+    };
+    Vertex vertices[8];
+    for (int i = 0; i < 8; ++i) {
+        vertices[i] = m_frame.encode(&points[i].x, i < 2 ? m_markerEnds[0].attributes : static_cast<uint16_t>(kMarker), clamped);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_markerVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+}
+
+namespace {
+    // Frustum planes (a, b, c, d) with the inside where dot(n, p) + d >= 0
+    void extractFrustumPlanes(const glm::mat4& clip, glm::vec4 planes[6]) {
+        const glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+        const glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+        const glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+        const glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+    }
+
+    enum class Containment { Outside, Partial, Inside };
+
+    Containment classifyBox(const glm::vec4 planes[6], const glm::vec3& min, const glm::vec3& max) {
+        Containment result = Containment::Inside;
+        for (int i = 0; i < 6; ++i) {
+            const glm::vec4& plane = planes[i];
+            // Corner furthest along the plane normal, and the one opposite
+            const glm::vec3 far(plane.x >= 0 ? max.x : min.x, plane.y >= 0 ? max.y : min.y, plane.z >= 0 ? max.z : min.z);
+            const glm::vec3 near(plane.x >= 0 ? min.x : max.x, plane.y >= 0 ? min.y : max.y, plane.z >= 0 ? min.z : max.z);
+            if (plane.x * far.x + plane.y * far.y + plane.z * far.z + plane.w < 0.0f) return Containment::Outside;
+            if (plane.x * near.x + plane.y * near.y + plane.z * near.z + plane.w < 0.0f) result = Containment::Partial;
+        }
+        return result;
+    }
+
+    // Entry distance of a ray into a box, or a negative value on a miss
+    float intersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection,
+                       const glm::vec3& min, const glm::vec3& max, float limit) {
+        float enter = 0.0f;
+        float exit = limit;
+        for (int axis = 0; axis < 3; ++axis) {
+            float t0 = (min[axis] - origin[axis]) * inverseDirection[axis];
+            float t1 = (max[axis] - origin[axis]) * inverseDirection[axis];
+            if (t0 > t1) std::swap(t0, t1);
+            enter = std::max(enter, t0);
+            exit = std::min(exit, t1);
+            if (enter > exit) return -1.0f;
+        }
+        return enter;
+    }
+
+    // Distance between a ray (unit direction) and a segment, with the ray
+    // parameter and the closest point on the segment
+    float raySegmentDistance(const glm::vec3& origin, const glm::vec3& direction,
+                             const glm::vec3& a, const glm::vec3& b, float& rayT, glm::vec3& closest) {
+        const glm::vec3 u = b - a;
+        const glm::vec3 w = a - origin;
+        const float uu = glm::dot(u, u);
+        const float ud = glm::dot(u, direction);
+        const float uw = glm::dot(u, w);
+        const float dw = glm::dot(direction, w);
+        const float denominator = uu - ud * ud;
+        float s = denominator > 1e-9f ? std::min(1.0f, std::max(0.0f, (ud * dw - uw) / denominator)) : 0.0f;
+        rayT = glm::dot(a + u * s - origin, direction);
+        if (rayT < 0.0f) {
+            rayT = 0.0f;
+            s = uu > 0.0f ? std::min(1.0f, std::max(0.0f, glm::dot(origin - a, u) / uu)) : 0.0f;
+        }
+        closest = a + u * s;
+        return glm::length(closest - (origin + direction * rayT));
+    }
+}
+
+void GCodeVisualizer::collectVisibleChunks() {
+    glm::vec4 planes[6];
+    extractFrustumPlanes(m_proj * m_view, planes);
+
+    // Collect visible chunks, then restore file order so the draw ranges
+    // merge and the playback prefix can cut them
+    m_visibleScratch.clear();
+    std::vector<std::pair<uint32_t, bool>>& stack = m_bvhStack;
+    stack.assign(1, {0u, false});
+    while (!stack.empty()) {
+        const uint32_t index = stack.back().first;
+        const bool inside = stack.back().second;
+        stack.pop_back();
+        const BvhNode& node = m_bvh[index];
+        const Containment containment = inside ? Containment::Inside : classifyBox(planes, node.min, node.max);
+        if (containment == Containment::Outside) continue;
+        const bool all = containment == Containment::Inside;
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                const SegmentChunk& chunk = m_chunks[m_chunkOrder[i]];
+                if (all || classifyBox(planes, chunk.min, chunk.max) != Containment::Outside) {
+                    m_visibleScratch.push_back(m_chunkOrder[i]);
+                }
+            }
+        } else {
+            stack.push_back({node.first, all});
+            stack.push_back({index + 1, all});
+        }
+    }
+    std::sort(m_visibleScratch.begin(), m_visibleScratch.end());
+    m_visibleChunks = m_visibleScratch.size();
+}
+
+void GCodeVisualizer::drawVisibleChunks(size_t completed) {
+    collectVisibleChunks();
+    m_drawFirsts.clear();
+    m_drawCounts.clear();
+    for (uint32_t index : m_visibleScratch) {
+        const SegmentChunk& chunk = m_chunks[index];
+        if (chunk.firstSegment >= completed) break;
+        const int first = static_cast<int>(chunk.firstSegment * 2);
+        const int count = static_cast<int>(std::min<size_t>(chunk.segmentCount, completed - chunk.firstSegment) * 2);
+        if (!m_drawFirsts.empty() && m_drawFirsts.back() + m_drawCounts.back() == first) {
+            m_drawCounts.back() += count;
+        } else {
+            m_drawFirsts.push_back(first);
+            m_drawCounts.push_back(count);
+        }
+    }
+    if (!m_drawFirsts.empty()) {
+        glMultiDrawArrays(GL_LINES, m_drawFirsts.data(), m_drawCounts.data(), static_cast<GLsizei>(m_drawFirsts.size()));
+    }
+}
+
+void GCodeVisualizer::renderPaged(size_t completed) {
+    ++m_frameNumber;
+    m_visibleChunks = m_chunks.size();
+    size_t level = selectLodLevel();
+    if (level == 0) {
+        if (m_bvh.empty()) return;
+        collectVisibleChunks();
+        if (m_visibleScratch.size() <= m_slotChunks.size() || m_lodLevels.empty()) {
+            m_currentLod = 0;
+            glBindVertexArray(m_vao);
+            drawPagedChunks(completed);
+            return;
+        }
+        // More chunks in view than slots: draw a simplified level instead
+        level = 1;
+    }
+
+    // The finest level from here on that fits in its half of the budget
+    auto levelBytes = [this](size_t index) {
+        return m_indexLevels[index].vertexCount * (sizeof(Vertex) + sizeof(uint32_t) / 2);
+    };
+    while (level < m_lodLevels.size() && levelBytes(level - 1) > m_memoryBudget / 2) ++level;
+    m_currentLod = level;
+    makeLevelResident(level - 1);
+    glBindVertexArray(m_lodVao);
+    glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(visibleLodVertices(m_lodLevels[level - 1], completed)));
+}
+
+void GCodeVisualizer::drawPagedChunks(size_t completed) {
+    // Page in missing chunks for as long as the upload budget allows; the
+    // rest are drawn once later frames bring them in
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(m_uploadBudgetMs));
+    m_drawFirsts.clear();
+    m_drawCounts.clear();
+    for (uint32_t index : m_visibleScratch) {
+        const SegmentChunk& chunk = m_chunks[index];
+        if (chunk.firstSegment >= completed) break;
+        int slot = m_chunkSlots[index];
+        if (slot < 0) {
+            m_renderIncomplete = true;
+            if (std::chrono::steady_clock::now() >= deadline) continue;
+            slot = pageInChunk(index);
+            if (slot < 0) continue;
+            m_renderIncomplete = false;
+        }
+        m_slotUsed[slot] = m_frameNumber;
+
+        const int first = static_cast<int>(slot * kSlotVertices);
+        const int count = static_cast<int>(std::min<size_t>(chunk.segmentCount, completed - chunk.firstSegment) * 2);
+        if (!m_drawFirsts.empty() && m_drawFirsts.back() + m_drawCounts.back() == first) {
+            m_drawCounts.back() += count;
+        } else {
+            m_drawFirsts.push_back(first);
+            m_drawCounts.push_back(count);
+        }
+    }
+    if (!m_drawFirsts.empty()) {
+        glMultiDrawArrays(GL_LINES, m_drawFirsts.data(), m_drawCounts.data(), static_cast<GLsizei>(m_drawFirsts.size()));
+    }
+}
+
+int GCodeVisualizer::pageInChunk(uint32_t chunk) {
+    // A free slot, else the one drawn longest ago but not this frame
+    size_t victim = m_slotChunks.size();
+    uint64_t oldest = m_frameNumber;
+    for (size_t slot = 0; slot < m_slotChunks.size(); ++slot) {
+        if (m_slotChunks[slot] < 0) {
+            victim = slot;
+            break;
+        }
+        if (m_slotUsed[slot] < oldest) {
+            oldest = m_slotUsed[slot];
+            victim = slot;
+        }
+    }
+    if (victim == m_slotChunks.size()) return -1;
+    if (m_slotChunks[victim] >= 0) m_chunkSlots[m_slotChunks[victim]] = -1;
+
+    const SegmentChunk& source = m_chunks[chunk];
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, victim * kSlotVertices * sizeof(Vertex), source.segmentCount * 2 * sizeof(Vertex),
+                    indexVertices() + source.firstSegment * 2);
+    m_slotChunks[victim] = static_cast<int32_t>(chunk);
+    m_chunkSlots[chunk] = static_cast<int32_t>(victim);
+    return static_cast<int>(victim);
+}
+
+void GCodeVisualizer::makeLevelResident(size_t level) {
+    if (m_residentLevel == level) return;
+    if (m_residentLevel < m_lodLevels.size()) {
+        std::vector<uint32_t>().swap(m_lodLevels[m_residentLevel].reached);
+    }
+
+    const IndexLevel& source = m_indexLevels[level];
+    glBindBuffer(GL_ARRAY_BUFFER, m_lodVbo);
+    glBufferData(GL_ARRAY_BUFFER, source.vertexCount * sizeof(Vertex), m_index.data() + source.vertices,
+                 GL_STATIC_DRAW);
+    m_lodBufferVertices = static_cast<size_t>(source.vertexCount);
+    const uint32_t* reached = reinterpret_cast<const uint32_t*>(m_index.data() + source.reached);
+    m_lodLevels[level].reached.assign(reached, reached + source.vertexCount / 2);
+    m_residentLevel = level;
+}
+
+GCodeVisualizer::PickResult GCodeVisualizer::pick(const glm::vec3& origin, const glm::vec3& direction, float tolerance) {
+    PickResult result;
+    if (m_bvh.empty() || glm::length(direction) <= 0.0f) return result;
+
+    const glm::vec3 dir = glm::normalize(direction);
+    const glm::vec3 inverse(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+    const glm::vec3 pad(tolerance);
+    const size_t pickable = m_playbackActive ? std::min(m_completedSegments, segmentCount()) : segmentCount();
+    float best = std::numeric_limits<float>::max();
+    size_t bestSegment = 0;
+    std::vector<Vertex> vertices;
+
+    // Visit boxes nearest first and skip any that start beyond the best hit
+    const float rootEnter = intersectBox(origin, inverse, m_bvh[0].min - pad, m_bvh[0].max + pad, best);
+    if (rootEnter < 0.0f) return result;
+    std::vector<std::pair<float, uint32_t>> stack{{rootEnter, 0u}};
+    while (!stack.empty()) {
+        const float enter = stack.back().first;
+        const BvhNode& node = m_bvh[stack.back().second];
+        const uint32_t index = stack.back().second;
+        stack.pop_back();
+        if (enter > best) continue;
+
+        if (node.count == 0) {
+            const uint32_t children[2] = {index + 1, node.first};
+            float t[2];
+            for (int i = 0; i < 2; ++i) {
+                t[i] = intersectBox(origin, inverse, m_bvh[children[i]].min - pad, m_bvh[children[i]].max + pad, best);
+            }
+            const int nearFirst = t[0] >= 0.0f && (t[1] < 0.0f || t[0] <= t[1]) ? 0 : 1;
+            if (t[1 - nearFirst] >= 0.0f) stack.push_back({t[1 - nearFirst], children[1 - nearFirst]});
+            if (t[nearFirst] >= 0.0f) stack.push_back({t[nearFirst], children[nearFirst]});
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+            const SegmentChunk& chunk = m_chunks[m_chunkOrder[i]];
+            if (chunk.firstSegment >= pickable) continue;
+            if (intersectBox(origin, inverse, chunk.min - pad, chunk.max + pad, best) < 0.0f) continue;
+
+            // Read the chunk from the index, or back from the GPU which
+            // holds the only copy of an in-memory path
+            const size_t count = std::min<size_t>(chunk.segmentCount, pickable - chunk.firstSegment);
+            const Vertex* chunkVertices;
+            if (m_index.isOpen()) {
+                chunkVertices = indexVertices() + chunk.firstSegment * 2;
+            } else {
+                vertices.resize(count * 2);
+                glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+                glGetBufferSubData(GL_ARRAY_BUFFER, chunk.firstSegment * 2 * sizeof(Vertex),
+                                   count * 2 * sizeof(Vertex), vertices.data());
+                chunkVertices = vertices.data();
+            }
+            for (size_t s = 0; s < count; ++s) {
+                float t;
+                glm::vec3 closest;
+                const float distance = raySegmentDistance(origin, dir, m_frame.decode(chunkVertices[2 * s]),
+                                                          m_frame.decode(chunkVertices[2 * s + 1]), t, closest);
+                if (distance <= tolerance && t < best) {
+                    best = t;
+                    bestSegment = chunk.firstSegment + s;
+                    result.point = closest;
+                    result.hit = true;
+                }
+            }
+        }
+    }
+
+    if (result.hit) {
+        const TimelineView timeline = timelineView();
+        result.segment = bestSegment;
+        if (bestSegment < timeline.segments) {
+            result.line = timeline.lines[bestSegment];
+            result.note = timeline.notes[bestSegment];
+        }
+        const uint32_t* noteSegments = timeline.noteSegments;
+        result.noteIndex = static_cast<size_t>(std::lower_bound(noteSegments, noteSegments + timeline.noteCount,
+                                                                static_cast<uint32_t>(bestSegment)) - noteSegments);
+    }
+    return result;
+}
+
+GCodeVisualizer::PickResult GCodeVisualizer::pickScreen(float x, float y, float width, float height,
+                                                        float pixelTolerance) {
+    if (width <= 0.0f || height <= 0.0f) return PickResult();
+
+    // Unproject the cursor onto the near and far planes
+    const glm::mat4 inverse = glm::inverse(m_proj * m_view);
+    const float ndcX = 2.0f * x / width - 1.0f;
+    const float ndcY = 1.0f - 2.0f * y / height;
+    glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    nearPoint = nearPoint * (1.0f / nearPoint.w);
+    farPoint = farPoint * (1.0f / farPoint.w);
+    const glm::vec3 origin(nearPoint.x, nearPoint.y, nearPoint.z);
+    const glm::vec3 target(farPoint.x, farPoint.y, farPoint.z);
+
+    const float tolerance = pixelTolerance * std::max(pixelWorldSize(height, false), 1e-4f);
+    return pick(origin, target - origin, tolerance);
 }
 
 void GCodeVisualizer::setViewMatrix(const glm::mat4& view) {
+    if (view != m_view) invalidate();
     m_view = view;
 }
 
 void GCodeVisualizer::setProjMatrix(const glm::mat4& proj) {
+    if (proj != m_proj) invalidate();
     m_proj = proj;
 }
 
@@ -210,18 +1806,23 @@ void GCodeVisualizer::resetView() {
         glm::vec3(0.0f, 0.0f, 1.0f)
     );
     m_scale = 1.0f;
+    invalidate();
 }
 
 void GCodeVisualizer::pan(float dx, float dy) {
     m_view = glm::translate(m_view, glm::vec3(dx, 0.0f, dy));
+    invalidate();
 }
 
 void GCodeVisualizer::rotate(float dx, float dy) {
     m_view = glm::rotate(m_view, glm::radians(dx), glm::vec3(0.0f, 0.0f, 1.0f));
     m_view = glm::rotate(m_view, glm::radians(dy), glm::vec3(1.0f, 0.0f, 0.0f));
+    invalidate();
 }
 
 void GCodeVisualizer::zoom(float delta) {
+    // Scale by this step only; m_scale keeps the running total
     m_scale *= (1.0f + delta);
-    m_view = glm::scale(m_view, glm::vec3(m_scale));
+    m_view = glm::scale(m_view, glm::vec3(1.0f + delta));
+    invalidate();
 }
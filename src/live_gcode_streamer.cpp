@@ -0,0 +1,249 @@
+#include "live_gcode_streamer.h"
+#include "porttime.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    bool isChannelMessage(uint8_t status) {
+        return status >= 0x80 && status < 0xF0;
+    }
+}
+
+PortMidiInputSource::PortMidiInputSource(int deviceIndex)
+    : m_stream(nullptr)
+{
+    PmError err = Pm_OpenInput(&m_stream, deviceIndex, nullptr, 256, nullptr, nullptr);
+    if (err != pmNoError) {
+        std::cerr << "Failed to open MIDI input: " << Pm_GetErrorText(err) << std::endl;
+        m_stream = nullptr;
+        return;
+    }
+    // Only channel messages matter; clock and active sensing would just fill the buffer
+    Pm_SetFilter(m_stream, PM_FILT_ACTIVE | PM_FILT_CLOCK | PM_FILT_SYSEX);
+}
+
+PortMidiInputSource::~PortMidiInputSource() {
+    if (m_stream) {
+        Pm_Close(m_stream);
+    }
+}
+
+std::vector<std::pair<int, std::string>> PortMidiInputSource::inputDevices() {
+    std::vector<std::pair<int, std::string>> devices;
+    int numDevices = Pm_CountDevices();
+    for (int i = 0; i < numDevices; i++) {
+        const PmDeviceInfo* info = Pm_GetDeviceInfo(i);
+        if (info && info->input) {
+            devices.emplace_back(i, info->name);
+        }
+    }
+    return devices;
+}
+
+bool PortMidiInputSource::read(std::vector<LiveInputEvent>& events, std::chrono::microseconds timeout) {
+    if (!m_stream) return false;
+
+    // PortMidi input can only be polled; a short sleep between polls keeps
+    // the added latency well under a millisecond
+    const auto deadline = Clock::now() + timeout;
+    PmEvent buffer[64];
+    for (;;) {
+        if (Pm_Poll(m_stream) == pmGotData) {
+            const int count = Pm_Read(m_stream, buffer, 64);
+            if (count < 0) {
+                std::cerr << "MIDI input error: " << Pm_GetErrorText(static_cast<PmError>(count)) << std::endl;
+                return false;
+            }
+            // PortMidi stamps input with Pt_Time on arrival
+            const auto now = Clock::now();
+            const PtTimestamp ptNow = Pt_Time();
+            for (int i = 0; i < count; ++i) {
+                const uint8_t status = static_cast<uint8_t>(Pm_MessageStatus(buffer[i].message));
+                if (!isChannelMessage(status)) continue;
+                const auto age = std::chrono::milliseconds(std::max<PtTimestamp>(ptNow - buffer[i].timestamp, 0));
+                events.push_back({status, static_cast<uint8_t>(Pm_MessageData1(buffer[i].message)),
+                                  static_cast<uint8_t>(Pm_MessageData2(buffer[i].message)), now - age});
+            }
+            if (!events.empty()) return true;
+        }
+        if (Clock::now() >= deadline) return true;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+ReplaySource::ReplaySource(std::shared_ptr<const std::vector<MidiEvent>> events)
+    : m_events(std::move(events))
+    , m_next(0)
+    , m_started(false)
+{
+}
+
+bool ReplaySource::read(std::vector<LiveInputEvent>& events, std::chrono::microseconds timeout) {
+    if (!m_events) return false;
+    if (!m_started) {
+        m_start = Clock::now();
+        m_started = true;
+    }
+
+    // Release each event at its song time, stamped when it is released
+    const auto deadline = Clock::now() + timeout;
+    while (m_next < m_events->size()) {
+        const MidiEvent& event = (*m_events)[m_next];
+        const auto due = m_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(event.time));
+        if (due > deadline) break;
+        std::this_thread::sleep_until(due);
+        events.push_back({event.status, event.data1, event.data2, Clock::now()});
+        ++m_next;
+    }
+    if (events.empty() && m_next < m_events->size()) {
+        std::this_thread::sleep_until(deadline);
+    }
+    return m_next < m_events->size();
+}
+
+FileLineSink::FileLineSink(const std::string& path)
+    : m_file(path)
+{
+    if (!m_file) {
+        std::cerr << "Could not open live output file: " << path << std::endl;
+    }
+}
+
+void FileLineSink::writeLine(const std::string& line) {
+    m_file << line << '\n';
+    m_file.flush();
+}
+
+std::string LiveLatencyStats::summary() const {
+    std::stringstream out;
+    out << "Live: " << notes << " notes";
+    if (thinned > 0) {
+        out << " (" << thinned << " thinned)";
+    }
+    out << std::fixed << std::setprecision(3)
+        << ", note-on to line mean " << meanMs << " ms, p99 " << p99Ms << " ms, max " << maxMs << " ms\n";
+    return out.str();
+}
+
+LiveGCodeStreamer::LiveGCodeStreamer(const PrinterProfile& profile, std::unique_ptr<LiveEventSource> source,
+                                     std::shared_ptr<GCodeLineSink> sink)
+    : m_minInterval(profile.maxCommandRate > 0 ? 1.0 / profile.maxCommandRate : 0.0)
+    , m_source(std::move(source))
+    , m_sink(std::move(sink))
+    , m_running(false)
+    , m_stopRequested(false)
+    , m_histogram(kBucketCount, 0)
+    , m_notes(0)
+    , m_thinned(0)
+    , m_totalMs(0.0)
+    , m_maxMs(0.0)
+{
+    if (!m_source || !m_sink) {
+        throw std::invalid_argument("LiveGCodeStreamer requires a source and a sink");
+    }
+    m_generator.setPrinterProfile(profile);
+}
+
+LiveGCodeStreamer::~LiveGCodeStreamer() {
+    stop();
+}
+
+void LiveGCodeStreamer::start() {
+    stop();
+    m_stopRequested = false;
+    m_running = true;
+    m_thread = std::thread(&LiveGCodeStreamer::streamLoop, this);
+}
+
+void LiveGCodeStreamer::stop() {
+    m_stopRequested = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+LiveLatencyStats LiveGCodeStreamer::latency() const {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    LiveLatencyStats stats;
+    stats.notes = m_notes;
+    stats.thinned = m_thinned;
+    stats.maxMs = m_maxMs;
+    if (m_notes == 0) return stats;
+
+    stats.meanMs = m_totalMs / m_notes;
+    const size_t target = m_notes - m_notes / 100; // Notes at or below the p99
+    size_t seen = 0;
+    for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+        seen += m_histogram[bucket];
+        if (seen >= target) {
+            stats.p99Ms = std::min((bucket + 1) * kBucketMs, m_maxMs);
+            break;
+        }
+    }
+    return stats;
+}
+
+void LiveGCodeStreamer::record(double latencyMs) {
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    ++m_notes;
+    m_totalMs += latencyMs;
+    m_maxMs = std::max(m_maxMs, latencyMs);
+    ++m_histogram[std::min(static_cast<size_t>(latencyMs / kBucketMs), kBucketCount - 1)];
+}
+
+void LiveGCodeStreamer::writeLines(const std::string& text) {
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty()) m_sink->writeLine(line);
+    }
+}
+
+void LiveGCodeStreamer::streamLoop() {
+    writeLines(m_generator.startupGCode());
+
+    const auto start = Clock::now();
+    double lastNoteTime = -1e9;
+    std::vector<LiveInputEvent> events;
+    std::ostringstream line;
+    std::string text;
+    while (!m_stopRequested) {
+        events.clear();
+        const bool more = m_source->read(events, kReadTimeout);
+        for (const auto& event : events) {
+            if ((event.status & 0xF0) != 0x90 || event.data2 == 0) continue;
+
+            const double time = std::chrono::duration<double>(event.arrival - start).count();
+            if (time - lastNoteTime < m_minInterval) {
+                std::lock_guard<std::mutex> lock(m_statsMutex);
+                ++m_thinned;
+                continue;
+            }
+            lastNoteTime = time;
+
+            // The length is unknown at note-on, so the move has no dwell
+            MidiNote note;
+            note.note = event.data1;
+            note.velocity = event.data2;
+            note.duration = 0.0;
+            note.timestamp = std::max(time, 0.0);
+            const ToolMove move = m_generator.mapNote(note, 1.0);
+
+            line.str(std::string());
+            GCodeGenerator::writeNoteMove(line, move);
+            text = line.str();
+            while (!text.empty() && text.back() == '\n') text.pop_back();
+            m_sink->writeLine(text);
+
+            record(std::chrono::duration<double, std::milli>(Clock::now() - event.arrival).count());
+        }
+        if (!more) break;
+    }
+
+    writeLines(m_generator.finishGCode());
+    m_running = false;
+}
@@ -1,5 +1,7 @@
 #include "midi_parser.h"
 #include "gcode_generator.h"
+#include "gcode_fanout.h"
+#include "conversion_analyzer.h"
 #include "file_dialog.h"
 #include "app_settings.h"
 #include <imgui.h>
@@ -16,15 +18,19 @@
 #include <vector>
 #include <filesystem>
 #include <sstream>
+#include <algorithm>
 #include "gcode_visualizer.h"
+#include "gcode_preview.h"
+#include "piano_roll.h"
 #include "midi_player.h"
+#include "live_gcode_streamer.h"
+#include "gcode_sender.h"
 
 // Global state
 static char inputPath[256] = "";
 static char outputPath[256] = "";
 static bool conversionSuccess = false;
 static std::string statusMessage;
-static std::string previewText;
 static bool showPreview = false;
 static bool showSettings = false;
 static ImVec2 mainWindowSize(1024, 768);
@@ -38,22 +44,60 @@ static double newPrinterMaxSpeed = 200.0;
 static double newPrinterAccel = 1000.0;
 static double newPrinterJerk = 8.0;
 static double newPrinterSteps = 80.0;
+static int newPrinterDialect = static_cast<int>(FirmwareDialect::Marlin);
+static double newPrinterCommandRate = 100.0;
+static double newPrinterMinSegmentMs = 20.0;
+static char newPrinterThumbnails[128] = "16x16/PNG, 220x124/PNG";
 
 static std::unique_ptr<GCodeVisualizer> m_visualizer;
+static std::unique_ptr<GCodePreview> m_gcodePreview;
+static std::unique_ptr<ConversionAnalyzer> m_conversionAnalyzer;
+static std::unique_ptr<PianoRoll> m_pianoRoll;
 static std::unique_ptr<MidiPlayer> m_midiPlayer;
+static std::shared_ptr<const std::vector<MidiNote>> m_midiNotes; // Of the selected file, null if it failed to parse
 static bool m_showVisualizerWindow = true;
 static bool m_showMidiPlayerWindow = true;
 static float m_playbackTempo = 1.0f;
+static bool m_deduplicatePhrases = false;
+static bool m_renderPrinterAudio = false;
+static std::unique_ptr<LiveGCodeStreamer> m_liveStreamer;
+static int m_liveInputDevice = -1;
+static std::shared_ptr<GCodeSender> m_printerSender; // Open while connected to a printer
+static int m_serialPort = -1;
+static int m_baudRate = 0;
+static std::string m_lastGCode; // Of the last conversion, for sending
 
 static void glfw_error_callback(int error, const char* description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-void updatePreview(const std::string& gcode) {
-    previewText = gcode;
+void updatePreview(std::string gcode) {
+    m_gcodePreview->setText(std::move(gcode));
     showPreview = true;
 }
 
+// Decode the selected file once; the piano roll, playback and conversion
+// all work from the same notes and events, so they share one timing
+void loadMidiFile() {
+    MidiParser parser;
+    if (parser.loadFile(inputPath)) {
+        m_midiNotes = std::make_shared<const std::vector<MidiNote>>(parser.getNotes());
+        m_pianoRoll->setNotes(*m_midiNotes);
+        m_midiPlayer->setEvents(parser.getEvents());
+    } else {
+        m_midiNotes.reset();
+        m_pianoRoll->clear();
+        m_midiPlayer->setEvents(nullptr);
+    }
+    if (m_visualizer) m_visualizer->clearPlaybackTime();
+}
+
+// Narrow the notes to the range selected in the piano roll, if any
+std::vector<MidiNote> selectedNotes(const std::vector<MidiNote>& notes) {
+    if (!m_pianoRoll->hasSelection()) return notes;
+    return notesInRange(notes, m_pianoRoll->selectionStart(), m_pianoRoll->selectionEnd());
+}
+
 bool convertMidiToGcode() {
     if (strlen(inputPath) == 0 || strlen(outputPath) == 0) {
         statusMessage = "Please select both input and output files.";
@@ -61,20 +105,57 @@ bool convertMidiToGcode() {
     }
 
     try {
-        std::vector<MidiNote> notes;
-        MidiParser parser;
-        if (!parser.parse(inputPath, notes)) {
+        if (!m_midiNotes) {
             statusMessage = "Failed to parse MIDI file.";
             return false;
         }
+        std::vector<MidiNote> notes = selectedNotes(*m_midiNotes);
+        if (notes.empty()) {
+            statusMessage = "No notes in the selected range.";
+            return false;
+        }
 
+        const PrinterProfile& printer = AppSettings::getInstance().getCurrentPrinter();
         GCodeGenerator generator;
+        generator.setPrinterProfile(printer);
+        generator.setPhraseDeduplication(m_deduplicatePhrases);
+        generator.setSubroutinePrefix(std::filesystem::path(outputPath).stem().string());
+
+        NoteAnalysis analysis = GCodeGenerator::analyzeNotes(notes);
+        GCodeProgram program = generator.generateProgram(notes, analysis);
+        GCodeGenerator::writeProgram(program, outputPath);
         if (m_visualizer) {
-            generator.setVisualizer(m_visualizer.get());
+            m_visualizer->loadGCodeProgressive(program.gcode);
+
+            // Song onset of every note move the preview shows, so playback can
+            // drive it. Notes replayed by subroutines are not in the main file,
+            // and a selection's notes start at 0 but play at their place in
+            // the song.
+            const double selectionOffset = m_pianoRoll->hasSelection() ? m_pianoRoll->selectionStart() : 0.0;
+            std::vector<double> onsets;
+            onsets.reserve(program.mainNotes.size());
+            for (size_t noteIndex : program.mainNotes) {
+                onsets.push_back(notes[noteIndex].timestamp + selectionOffset);
+            }
+            m_visualizer->setNoteOnsets(std::move(onsets));
         }
 
-        generator.generateGCodeToFile(inputPath, outputPath);
-        statusMessage = "Conversion successful!";
+        // Timing checks and audio take seconds on long programs; the report
+        // shows up when the worker is done
+        ConversionAnalyzer::Job job;
+        job.printer = printer;
+        job.moves = std::move(program.moves);
+        job.notes = std::move(notes);
+        job.timeScale = analysis.timeScale;
+        job.gcode = program.gcode;
+        if (m_renderPrinterAudio) {
+            job.audioPath = std::filesystem::path(outputPath).replace_extension(".wav").string();
+        }
+        m_conversionAnalyzer->start(std::move(job));
+        m_lastGCode = program.gcode;
+        updatePreview(std::move(program.gcode));
+        statusMessage = program.sideFiles.empty() ? "Conversion successful!"
+                                                  : "Conversion successful! Copy the subroutine files to the printer before sending.";
         return true;
     }
     catch (const std::exception& e) {
@@ -83,11 +164,49 @@ bool convertMidiToGcode() {
     }
 }
 
+bool convertForAllPrinters() {
+    if (strlen(inputPath) == 0) {
+        statusMessage = "Please select an input file.";
+        return false;
+    }
+
+    try {
+        auto notes = m_midiNotes;
+        if (!notes) {
+            statusMessage = "Failed to parse MIDI file.";
+            return false;
+        }
+        if (m_pianoRoll->hasSelection()) {
+            notes = std::make_shared<const std::vector<MidiNote>>(selectedNotes(*notes));
+        }
+        FanOutGenerator fanOut(notes);
+        fanOut.setPhraseDeduplication(m_deduplicatePhrases);
+        fanOut.setAudioPreview(m_renderPrinterAudio);
+        auto results = fanOut.run(AppSettings::getInstance().getPrinterProfiles(), {},
+                                  AppSettings::getInstance().getOutputDirectory(),
+                                  std::filesystem::path(inputPath).stem().string());
+
+        size_t failed = std::count_if(results.begin(), results.end(),
+                                      [](const FanOutResult& r) { return !r.success; });
+        statusMessage = "Generated " + std::to_string(results.size() - failed) + " of " +
+                        std::to_string(results.size()) + " printer outputs.";
+        return failed == 0;
+    }
+    catch (const std::exception& e) {
+        statusMessage = "Error: " + std::string(e.what());
+        return false;
+    }
+}
+
 void renderSettingsWindow() {
     if (!showSettings) return;
 
     ImGui::SetNextWindowSize(ImVec2(400, 400), ImGuiCond_FirstUseEver);
     if (ImGui::Begin("Settings", &showSettings)) {
+        const std::string saveError = AppSettings::getInstance().getSaveError();
+        if (!saveError.empty()) {
+            ImGui::TextWrapped("Settings could not be saved: %s", saveError.c_str());
+        }
         if (ImGui::CollapsingHeader("Appearance")) {
             static bool darkMode = AppSettings::getInstance().getDarkMode();
             if (ImGui::Checkbox("Dark Mode", &darkMode)) {
@@ -122,6 +241,16 @@ void renderSettingsWindow() {
             ImGui::InputDouble("Acceleration (mm/s²)", &newPrinterAccel, 10.0, 100.0);
             ImGui::InputDouble("Jerk (mm/s)", &newPrinterJerk, 0.1, 1.0);
             ImGui::InputDouble("Steps per mm", &newPrinterSteps, 1.0, 10.0);
+            const char* dialectNames[] = {
+                firmwareDialectName(FirmwareDialect::Marlin),
+                firmwareDialectName(FirmwareDialect::Klipper),
+                firmwareDialectName(FirmwareDialect::RepRapFirmware),
+                firmwareDialectName(FirmwareDialect::Grbl)
+            };
+            ImGui::Combo("Firmware", &newPrinterDialect, dialectNames, IM_ARRAYSIZE(dialectNames));
+            ImGui::InputDouble("Max Commands per Second", &newPrinterCommandRate, 10.0, 100.0);
+            ImGui::InputDouble("Min Segment Time (ms)", &newPrinterMinSegmentMs, 1.0, 5.0);
+            ImGui::InputText("Thumbnails", newPrinterThumbnails, sizeof(newPrinterThumbnails));
 
             if (ImGui::Button("Add Profile")) {
                 if (strlen(newPrinterName) > 0) {
@@ -135,6 +264,10 @@ void renderSettingsWindow() {
                     profile.jerk = newPrinterJerk;
                     profile.stepsPerMm = newPrinterSteps;
                     profile.isCustom = true;
+                    profile.dialect = static_cast<FirmwareDialect>(newPrinterDialect);
+                    profile.maxCommandRate = newPrinterCommandRate;
+                    profile.minSegmentTime = newPrinterMinSegmentMs / 1000.0;
+                    profile.thumbnails = newPrinterThumbnails;
 
                     AppSettings::getInstance().addCustomPrinter(profile);
 
@@ -147,6 +280,10 @@ void renderSettingsWindow() {
                     newPrinterAccel = 1000.0;
                     newPrinterJerk = 8.0;
                     newPrinterSteps = 80.0;
+                    newPrinterDialect = static_cast<int>(FirmwareDialect::Marlin);
+                    newPrinterCommandRate = 100.0;
+                    newPrinterMinSegmentMs = 20.0;
+                    strcpy(newPrinterThumbnails, "16x16/PNG, 220x124/PNG");
                 }
             }
 
@@ -161,6 +298,66 @@ void renderSettingsWindow() {
     }
 }
 
+void renderPreviewWindow() {
+    if (!showPreview) return;
+
+    ImGui::SetNextWindowSize(ImVec2(640, 480), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("G-code Preview", &showPreview)) {
+        m_gcodePreview->draw();
+    }
+    ImGui::End();
+}
+
+// The toolpath is drawn into a texture that is only redrawn when the view,
+// geometry or playback changes. Left-drag rotates, right- or middle-drag
+// pans, the wheel zooms and a click picks the move under the cursor.
+void renderVisualizerView() {
+    const ImVec2 size = ImGui::GetContentRegionAvail();
+    if (size.x < 1.0f || size.y < 1.0f) return;
+    ImGui::InvisibleButton("Toolpath", size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight |
+                                             ImGuiButtonFlags_MouseButtonMiddle);
+    const ImVec2 corner = ImGui::GetItemRectMin();
+    const ImGuiIO& io = ImGui::GetIO();
+    const bool hovered = ImGui::IsItemHovered();
+    const bool active = ImGui::IsItemActive();
+
+    if (active && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+        const ImVec2 delta = ImGui::GetMouseDragDelta(ImGuiMouseButton_Left);
+        m_visualizer->rotate(delta.x * 0.3f, delta.y * 0.3f);
+        ImGui::ResetMouseDragDelta(ImGuiMouseButton_Left);
+    }
+    for (ImGuiMouseButton button : {ImGuiMouseButton_Right, ImGuiMouseButton_Middle}) {
+        if (active && ImGui::IsMouseDragging(button)) {
+            const ImVec2 delta = ImGui::GetMouseDragDelta(button);
+            m_visualizer->pan(delta.x * 0.2f, -delta.y * 0.2f);
+            ImGui::ResetMouseDragDelta(button);
+        }
+    }
+    if (hovered && io.MouseWheel != 0.0f) {
+        m_visualizer->zoom(io.MouseWheel * 0.1f);
+    }
+    // A click rather than the end of a drag
+    if (hovered && ImGui::IsMouseReleased(ImGuiMouseButton_Left) &&
+        io.MouseDragMaxDistanceSqr[ImGuiMouseButton_Left] < 4.0f) {
+        GCodeVisualizer::PickResult hit = m_visualizer->pickScreen(io.MousePos.x - corner.x, io.MousePos.y - corner.y,
+                                                                   size.x, size.y);
+        if (hit.hit) {
+            m_gcodePreview->scrollToLine(hit.line);
+            statusMessage = "Line " + std::to_string(hit.line) +
+                            (hit.note >= 0 ? ", note " + std::to_string(hit.note) : std::string());
+        }
+    }
+
+    m_visualizer->setProjMatrix(glm::perspective(glm::radians(45.0f), size.x / size.y, 0.1f, 1000.0f));
+    const bool interacting = active || (hovered && io.MouseWheel != 0.0f);
+    const unsigned int texture = m_visualizer->renderToTexture(static_cast<int>(size.x), static_cast<int>(size.y),
+                                                               interacting);
+    const glm::vec2 extent = m_visualizer->renderedExtent();
+    ImGui::GetWindowDrawList()->AddImage(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(texture)), corner,
+                                         ImVec2(corner.x + size.x, corner.y + size.y),
+                                         ImVec2(0.0f, extent.y), ImVec2(extent.x, 0.0f));
+}
+
 void renderMainWindow() {
     ImGui::SetNextWindowPos(ImVec2(0, 0));
     ImGui::SetNextWindowSize(mainWindowSize);
@@ -180,6 +377,10 @@ void renderMainWindow() {
             }
             ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("View")) {
+            ImGui::MenuItem("G-code Preview", nullptr, &showPreview);
+            ImGui::EndMenu();
+        }
         ImGui::EndMenuBar();
     }
 
@@ -195,6 +396,7 @@ void renderMainWindow() {
         std::string file = FileDialog::OpenFile("MIDI Files\0*.mid;*.midi\0All Files\0*.*\0");
         if (!file.empty()) {
             strncpy_s(inputPath, file.c_str(), sizeof(inputPath) - 1);
+            loadMidiFile();
         }
     }
     ImGui::SameLine();
@@ -209,6 +411,14 @@ void renderMainWindow() {
     ImGui::SameLine();
     ImGui::Text(strlen(outputPath) > 0 ? outputPath : "No file selected");
 
+    ImGui::Checkbox("Deduplicate repeated phrases", &m_deduplicatePhrases);
+    const FirmwareDialect currentDialect = AppSettings::getInstance().getCurrentPrinter().dialect;
+    if (m_deduplicatePhrases && !firmwareDialectHasSubroutines(currentDialect)) {
+        ImGui::SameLine();
+        ImGui::Text("(%s has no subroutines; phrases stay inline)", firmwareDialectName(currentDialect));
+    }
+    ImGui::Checkbox("Render printer audio (.wav)", &m_renderPrinterAudio);
+
     // Convert Button
     if (ImGui::Button("Convert")) {
         if (convertMidiToGcode()) {
@@ -217,22 +427,175 @@ void renderMainWindow() {
             ImGui::OpenPopup("Conversion Failed");
         }
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Convert for All Printers")) {
+        if (convertForAllPrinters()) {
+            ImGui::OpenPopup("Conversion Success");
+        } else {
+            ImGui::OpenPopup("Conversion Failed");
+        }
+    }
+    if (!statusMessage.empty()) {
+        ImGui::TextWrapped("%s", statusMessage.c_str());
+    }
+    if (m_visualizer && m_visualizer->isLoading()) {
+        ImGui::ProgressBar(m_visualizer->loadProgress(), ImVec2(-1.0f, 0.0f), "Loading preview");
+    }
+    if (m_conversionAnalyzer->isBusy()) {
+        ImGui::TextUnformatted("Analyzing the conversion...");
+    } else {
+        const std::string timingReport = m_conversionAnalyzer->report();
+        if (!timingReport.empty()) ImGui::TextUnformatted(timingReport.c_str());
+    }
 
     // MIDI Player Section
     ImGui::Separator();
     ImGui::Text("MIDI Player");
     ImGui::Separator();
     
-    // Add MIDI player controls here
+    // Transport calls only queue a command for the player thread
     if (strlen(inputPath) > 0) {
-        if (ImGui::Button("Play")) {
-            // Add play functionality
+        const bool playing = m_midiPlayer->isPlaying();
+        if (ImGui::Button(playing ? "Pause" : "Play")) {
+            if (playing) {
+                m_midiPlayer->pause();
+            } else {
+                m_midiPlayer->play();
+            }
         }
         ImGui::SameLine();
         if (ImGui::Button("Stop")) {
-            // Add stop functionality
+            m_midiPlayer->stop();
+            m_visualizer->clearPlaybackTime();
+        }
+
+        float position = m_midiPlayer->getPlaybackPosition();
+        if (ImGui::SliderFloat("Position", &position, 0.0f, m_midiPlayer->getDuration(), "%.1f s")) {
+            m_midiPlayer->seek(position);
+        }
+        if (ImGui::SliderFloat("Tempo", &m_playbackTempo, 0.25f, 2.0f, "%.2fx")) {
+            m_midiPlayer->setTempo(m_playbackTempo);
+        }
+    }
+
+    // Stream the last conversion, or live input, to a printer over serial
+    ImGui::Separator();
+    ImGui::Text("Printer");
+    ImGui::Separator();
+
+    static std::vector<std::string> serialPorts = SerialPort::availablePorts();
+    static const char* baudRates[] = {"115200", "250000"};
+    const bool connected = m_printerSender && (m_printerSender->state() == SenderState::Connecting ||
+                                               m_printerSender->state() == SenderState::Connected);
+    if (ImGui::BeginCombo("Port", m_serialPort >= 0 && m_serialPort < static_cast<int>(serialPorts.size())
+                                      ? serialPorts[m_serialPort].c_str() : "None")) {
+        for (size_t i = 0; i < serialPorts.size(); ++i) {
+            if (ImGui::Selectable(serialPorts[i].c_str(), m_serialPort == static_cast<int>(i))) {
+                m_serialPort = static_cast<int>(i);
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Refresh")) {
+        serialPorts = SerialPort::availablePorts();
+        m_serialPort = -1;
+    }
+    ImGui::Combo("Baud Rate", &m_baudRate, baudRates, IM_ARRAYSIZE(baudRates));
+    if (ImGui::Button(connected ? "Disconnect" : "Connect")) {
+        if (connected) {
+            // Live input may be streaming into the sender; stop it first
+            if (m_liveStreamer && m_liveStreamer->sink() == m_printerSender) {
+                m_liveStreamer.reset();
+            }
+            m_printerSender->cancel();
+            m_printerSender.reset();
+        } else if (m_serialPort < 0 || m_serialPort >= static_cast<int>(serialPorts.size())) {
+            statusMessage = "Select a serial port to connect to.";
+        } else {
+            GCodeSenderConfig config = GCodeSenderConfig::fromProfile(AppSettings::getInstance().getCurrentPrinter());
+            config.baudRate = std::atoi(baudRates[m_baudRate]);
+            m_printerSender = std::make_shared<GCodeSender>(config);
+            if (!m_printerSender->open(serialPorts[m_serialPort])) {
+                statusMessage = "Failed to open " + serialPorts[m_serialPort];
+                m_printerSender.reset();
+            }
         }
     }
+    if (m_printerSender) {
+        const SenderState state = m_printerSender->state();
+        if (state == SenderState::Connected && !(m_liveStreamer && m_liveStreamer->isRunning())) {
+            ImGui::SameLine();
+            if (ImGui::Button("Send Output")) {
+                if (m_lastGCode.empty()) {
+                    statusMessage = "Convert a MIDI file before sending.";
+                } else {
+                    m_printerSender->send(m_lastGCode);
+                }
+            }
+        }
+        if (state == SenderState::Connecting) {
+            ImGui::Text("Connecting...");
+        } else if (state == SenderState::Failed) {
+            ImGui::TextWrapped("Printer: %s", m_printerSender->error().c_str());
+        }
+        ImGui::TextUnformatted(m_printerSender->stats().summary().c_str());
+    }
+
+    // Live mode streams a keyboard's notes to the printer, or to the output
+    // file, as they're played
+    ImGui::Separator();
+    ImGui::Text("Live Input");
+    ImGui::Separator();
+
+    const bool streaming = m_liveStreamer && m_liveStreamer->isRunning();
+    static std::vector<std::pair<int, std::string>> inputDevices = PortMidiInputSource::inputDevices();
+    const char* deviceName = "None";
+    for (const auto& device : inputDevices) {
+        if (device.first == m_liveInputDevice) deviceName = device.second.c_str();
+    }
+    if (ImGui::BeginCombo("Input Device", deviceName)) {
+        for (const auto& device : inputDevices) {
+            if (ImGui::Selectable(device.second.c_str(), device.first == m_liveInputDevice)) {
+                m_liveInputDevice = device.first;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    if (ImGui::Button(streaming ? "Stop Streaming" : "Stream Live")) {
+        if (streaming) {
+            m_liveStreamer->stop();
+        } else if (m_liveInputDevice < 0 || (!connected && strlen(outputPath) == 0)) {
+            statusMessage = "Select an input device, and a printer or an output file, to stream live.";
+        } else {
+            m_liveStreamer.reset();
+            auto source = std::make_unique<PortMidiInputSource>(m_liveInputDevice);
+            std::shared_ptr<GCodeLineSink> sink;
+            if (connected) {
+                sink = m_printerSender;
+            } else {
+                auto file = std::make_shared<FileLineSink>(outputPath);
+                if (file->isOpen()) sink = file;
+            }
+            if (!source->isOpen() || !sink) {
+                statusMessage = "Failed to open the live input or output.";
+            } else {
+                m_liveStreamer = std::make_unique<LiveGCodeStreamer>(
+                    AppSettings::getInstance().getCurrentPrinter(), std::move(source), sink);
+                m_liveStreamer->start();
+            }
+        }
+    }
+    if (m_liveStreamer) {
+        ImGui::TextUnformatted(m_liveStreamer->latency().summary().c_str());
+    }
+
+    // Piano roll of the parsed notes; a selection limits the conversion
+    ImGui::Separator();
+    ImGui::Text("Notes");
+    ImGui::Separator();
+    m_pianoRoll->setCursorTime(m_midiPlayer->isPlaying() ? m_midiPlayer->getPlaybackPosition() : -1.0);
+    m_pianoRoll->draw(160.0f);
     
     ImGui::EndChild();
 
@@ -242,20 +605,22 @@ void renderMainWindow() {
     ImGui::Text("G-code Visualizer");
     ImGui::Separator();
 
-    // Add G-code visualization here
     if (strlen(outputPath) > 0) {
-        // Render the G-code preview
-        ImGui::BeginChild("GCodeView", ImVec2(0, -30), true);
-        // Add visualization rendering here
+        ImGui::BeginChild("GCodeView", ImVec2(0, -30), true,
+                          ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+        renderVisualizerView();
         ImGui::EndChild();
 
         // Controls below visualization
         if (ImGui::Button("Reset View")) {
-            // Add reset view functionality
+            m_visualizer->resetView();
         }
         ImGui::SameLine();
         if (ImGui::Button("Load G-code")) {
-            // Add load G-code functionality
+            std::string file = FileDialog::OpenFile("G-code Files\0*.gcode;*.gco;*.g\0All Files\0*.*\0");
+            if (!file.empty() && !m_visualizer->loadGCodeFile(file)) {
+                statusMessage = "Failed to open " + file;
+            }
         }
     } else {
         ImGui::Text("Convert a MIDI file to see the G-code preview");
@@ -280,8 +645,9 @@ void renderMainWindow() {
         ImGui::EndPopup();
     }
 
-    // Render settings window if open
+    // Render settings and preview windows if open
     renderSettingsWindow();
+    renderPreviewWindow();
     
     ImGui::End();
 }
@@ -333,6 +699,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     ImGui_ImplOpenGL3_Init(glsl_version);
 
     m_visualizer = std::make_unique<GCodeVisualizer>();
+    m_gcodePreview = std::make_unique<GCodePreview>();
+    m_conversionAnalyzer = std::make_unique<ConversionAnalyzer>();
+    m_pianoRoll = std::make_unique<PianoRoll>();
     m_midiPlayer = std::make_unique<MidiPlayer>();
     if (!m_midiPlayer->initialize()) {
         std::cerr << "Failed to initialize MIDI playback system" << std::endl;
@@ -347,6 +716,10 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        m_visualizer->uploadPending();
+        if (m_midiPlayer->isPlaying()) {
+            m_visualizer->setSongTime(m_midiPlayer->getPlaybackPosition());
+        }
         renderMainWindow();
 
         // Rendering
@@ -362,6 +735,15 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     }
 
     // Cleanup
+    // Stopping writes the finish G-code before the input stream closes
+    m_liveStreamer.reset();
+    m_printerSender.reset();
+    // Lets a running analysis finish writing its audio file
+    m_conversionAnalyzer.reset();
+    AppSettings::getInstance().flush();
+    // These own GL objects, so they go while the context is current
+    m_pianoRoll.reset();
+    m_visualizer.reset();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
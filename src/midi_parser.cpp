@@ -2,10 +2,25 @@
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
-#include <map>
+#include <deque>
 #include <vector>
 #include <algorithm>
 
+namespace {
+
+uint32_t readBigEndian32(const std::vector<uint8_t>& data, size_t pos) {
+    return (uint32_t(data[pos]) << 24) | (uint32_t(data[pos+1]) << 16) |
+           (uint32_t(data[pos+2]) << 8) | uint32_t(data[pos+3]);
+}
+
+// Data bytes following a channel message status
+int dataLength(uint8_t status) {
+    const uint8_t type = status & 0xF0;
+    return type == 0xC0 || type == 0xD0 ? 1 : 2;
+}
+
+} // namespace
+
 bool MidiParser::parse(const std::string& filename, std::vector<MidiNote>& notes) {
     if (!notes.empty()) {
         notes.clear();
@@ -14,9 +29,6 @@ bool MidiParser::parse(const std::string& filename, std::vector<MidiNote>& notes
         return false;
     }
     notes = m_notes;
-    std::sort(notes.begin(), notes.end(), [](const MidiNote& a, const MidiNote& b) {
-        return a.timestamp < b.timestamp;
-    });
     return true;
 }
 
@@ -33,144 +45,207 @@ bool MidiParser::loadFile(const std::string& filename) {
     file.close();
 
     // Check MIDI header
-    if (data.size() < 14 || 
-        data[0] != 'M' || data[1] != 'T' || 
+    if (data.size() < 14 ||
+        data[0] != 'M' || data[1] != 'T' ||
         data[2] != 'h' || data[3] != 'd') {
         std::cerr << "Invalid MIDI file format" << std::endl;
         return false;
     }
 
     // Parse header
-    uint16_t format = (data[8] << 8) | data[9];
+    uint32_t headerLength = readBigEndian32(data, 4);
     uint16_t tracks = (data[10] << 8) | data[11];
-    uint16_t ticksPerQuarterNote = (data[12] << 8) | data[13];
+    uint16_t division = (data[12] << 8) | data[13];
 
     m_notes.clear();
-    size_t pos = 14;
+    m_events.reset();
+    size_t pos = 8 + std::max<uint32_t>(headerLength, 6);
+
+    // Every track is decoded on the same tick axis; tempo changes from any
+    // track (normally the first) apply to all of them
+    std::vector<MidiEvent> events;
+    std::vector<TempoChange> tempos;
+    uint32_t endTick = 0;
+    uint16_t track = 0;
+    while (track < tracks && pos + 8 <= data.size()) {
+        const uint32_t length = readBigEndian32(data, pos + 4);
+        const size_t start = pos + 8;
+        // A truncated last track is read as far as it goes
+        const size_t end = std::min<size_t>(data.size(), start + size_t(length));
 
-    // Parse each track
-    for (uint16_t i = 0; i < tracks && pos < data.size(); ++i) {
-        if (pos + 8 >= data.size()) break;
-        
-        if (data[pos] == 'M' && data[pos+1] == 'T' && 
+        if (data[pos] == 'M' && data[pos+1] == 'T' &&
             data[pos+2] == 'r' && data[pos+3] == 'k') {
-            
-            // Get track length
-            uint32_t trackLength = (data[pos+4] << 24) | (data[pos+5] << 16) | 
-                                 (data[pos+6] << 8) | data[pos+7];
-            pos += 8;
-            
-            if (pos + trackLength <= data.size()) {
-                parseTrack(data, pos, ticksPerQuarterNote);
-            }
-        } else {
-            // Skip unknown chunk
-            if (pos + 4 < data.size()) {
-                uint32_t length = (data[pos+4] << 24) | (data[pos+5] << 16) | 
-                                (data[pos+6] << 8) | data[pos+7];
-                pos += 8 + length;
-            } else {
-                break;
-            }
+            const uint8_t trackIndex = static_cast<uint8_t>(std::min<uint16_t>(track, 255));
+            endTick = std::max(endTick, parseTrack(data, start, end, trackIndex, events, tempos));
+            ++track;
         }
+        // Unknown chunks are skipped
+        pos = end;
     }
 
+    // Merge the tracks; ties keep track order, then file order
+    std::stable_sort(events.begin(), events.end(), [](const MidiEvent& a, const MidiEvent& b) {
+        return a.tick < b.tick;
+    });
+    const double endTime = applyTempoMap(events, std::move(tempos), division, endTick);
+    buildNotes(events, endTime);
+    m_events = std::make_shared<const std::vector<MidiEvent>>(std::move(events));
+
     return true;
 }
 
-void MidiParser::parseTrack(const std::vector<uint8_t>& data, size_t& pos, 
-                           uint16_t ticksPerQuarterNote) {
-    uint32_t tempo = 500000; // Default tempo (120 BPM)
+uint32_t MidiParser::parseTrack(const std::vector<uint8_t>& data, size_t pos, size_t end, uint8_t track,
+                                std::vector<MidiEvent>& events, std::vector<TempoChange>& tempos) {
     uint32_t absoluteTime = 0;
-    std::map<uint8_t, uint32_t> noteStarts; // note -> start time
+    uint8_t runningStatus = 0;
 
-    while (pos < data.size()) {
-        uint32_t deltaTime = readVarLen(data, pos);
+    while (pos < end) {
+        uint32_t deltaTime = readVarLen(data, pos, end);
         absoluteTime += deltaTime;
 
-        if (pos >= data.size()) break;
-        
-        uint8_t status = data[pos++];
-        
+        if (pos >= end) break;
+
+        uint8_t status = data[pos];
+        if (status & 0x80) {
+            ++pos;
+        } else if (runningStatus) {
+            status = runningStatus; // Running status: the byte is the first data byte
+        } else {
+            break; // Data byte without a status to run on
+        }
+
         if (status == 0xFF) { // Meta event
-            if (pos >= data.size()) break;
+            runningStatus = 0;
+            if (pos >= end) break;
             uint8_t type = data[pos++];
-            uint32_t length = readVarLen(data, pos);
-            
-            if (type == 0x51 && length == 3 && pos + 2 < data.size()) { // Tempo change
-                tempo = (data[pos] << 16) | (data[pos+1] << 8) | data[pos+2];
+            uint32_t length = readVarLen(data, pos, end);
+
+            if (type == 0x51 && length == 3 && pos + 3 <= end) { // Tempo change
+                tempos.push_back({absoluteTime, (uint32_t(data[pos]) << 16) | (uint32_t(data[pos+1]) << 8) | data[pos+2]});
             }
-            pos += length;
+            if (type == 0x2F) break; // End of track
+            pos += std::min<size_t>(length, end - pos);
         }
-        else if ((status & 0xF0) == 0x90) { // Note on
-            if (pos + 1 >= data.size()) break;
-            
-            uint8_t note = data[pos++];
-            uint8_t velocity = data[pos++];
-            
-            if (velocity > 0) {
-                noteStarts[note] = absoluteTime;
-            } else {
-                // Note off (note-on with velocity 0)
-                auto it = noteStarts.find(note);
-                if (it != noteStarts.end()) {
-                    MidiNote midiNote;
-                    midiNote.note = note;
-                    midiNote.velocity = velocity;
-                    midiNote.timestamp = ticksToSeconds(it->second, ticksPerQuarterNote, tempo);
-                    midiNote.duration = ticksToSeconds(absoluteTime - it->second, ticksPerQuarterNote, tempo);
-                    m_notes.push_back(midiNote);
-                    noteStarts.erase(it);
-                }
-            }
+        else if (status == 0xF0 || status == 0xF7) { // System exclusive
+            runningStatus = 0;
+            uint32_t length = readVarLen(data, pos, end);
+            pos += std::min<size_t>(length, end - pos);
         }
-        else if ((status & 0xF0) == 0x80) { // Note off
-            if (pos + 1 >= data.size()) break;
-            
-            uint8_t note = data[pos++];
-            uint8_t velocity = data[pos++];
-            
-            auto it = noteStarts.find(note);
-            if (it != noteStarts.end()) {
-                MidiNote midiNote;
-                midiNote.note = note;
-                midiNote.velocity = velocity;
-                midiNote.timestamp = ticksToSeconds(it->second, ticksPerQuarterNote, tempo);
-                midiNote.duration = ticksToSeconds(absoluteTime - it->second, ticksPerQuarterNote, tempo);
-                m_notes.push_back(midiNote);
-                noteStarts.erase(it);
-            }
+        else if (status >= 0xF0) { // System common/real-time messages don't belong in a file
+            break;
+        }
+        else { // Channel message
+            runningStatus = status;
+            const int length = dataLength(status);
+            if (pos + length > end) break;
+
+            MidiEvent event;
+            event.time = 0.0;
+            event.tick = absoluteTime;
+            event.status = status;
+            event.data1 = data[pos] & 0x7F;
+            event.data2 = length == 2 ? data[pos+1] & 0x7F : 0;
+            event.track = track;
+            events.push_back(event);
+            pos += length;
         }
-        else if ((status & 0x80) == 0) { // Running status
-            pos--; // Rewind to reread the data byte
-            // Handle running status here if needed
+    }
+
+    return absoluteTime;
+}
+
+double MidiParser::applyTempoMap(std::vector<MidiEvent>& events, std::vector<TempoChange> tempos,
+                                 uint16_t division, uint32_t endTick) {
+    if (division & 0x8000) {
+        // SMPTE timing: frames per second (negative, 29 meaning 29.97) × ticks per frame,
+        // independent of tempo
+        const int framesPerSecond = -static_cast<int8_t>(division >> 8);
+        const double fps = framesPerSecond == 29 ? 29.97 : framesPerSecond;
+        const double secondsPerTick = 1.0 / (std::max(fps, 1.0) * std::max(division & 0xFF, 1));
+        for (auto& event : events) {
+            event.time = event.tick * secondsPerTick;
         }
+        return endTick * secondsPerTick;
     }
-    
-    // Close any open notes at the end of track
-    for (const auto& [note, startTime] : noteStarts) {
+
+    std::stable_sort(tempos.begin(), tempos.end(), [](const TempoChange& a, const TempoChange& b) {
+        return a.tick < b.tick;
+    });
+
+    // Walk the events and tempo changes together, accumulating seconds
+    // segment by segment so later changes don't rescale earlier time
+    const double ticksPerQuarterNote = std::max<uint16_t>(division, 1);
+    uint32_t tempo = 500000; // Default tempo (120 BPM)
+    uint32_t segmentTick = 0;
+    double segmentTime = 0.0;
+    size_t nextTempo = 0;
+    auto secondsAt = [&](uint32_t tick) {
+        while (nextTempo < tempos.size() && tempos[nextTempo].tick <= tick) {
+            segmentTime += (tempos[nextTempo].tick - segmentTick) * tempo / (ticksPerQuarterNote * 1000000.0);
+            segmentTick = tempos[nextTempo].tick;
+            tempo = tempos[nextTempo].tempo;
+            ++nextTempo;
+        }
+        return segmentTime + (tick - segmentTick) * double(tempo) / (ticksPerQuarterNote * 1000000.0);
+    };
+
+    for (auto& event : events) {
+        event.time = secondsAt(event.tick);
+    }
+    return secondsAt(std::max(endTick, events.empty() ? 0u : events.back().tick));
+}
+
+void MidiParser::buildNotes(const std::vector<MidiEvent>& events, double endTime) {
+    // Notes sounding per channel and key, oldest first, so repeated
+    // note-ons of one key are released in order
+    std::vector<std::deque<const MidiEvent*>> noteStarts(16 * 128);
+
+    auto addNote = [this](const MidiEvent& start, double releaseTime) {
         MidiNote midiNote;
-        midiNote.note = note;
-        midiNote.velocity = 0;
-        midiNote.timestamp = ticksToSeconds(startTime, ticksPerQuarterNote, tempo);
-        midiNote.duration = ticksToSeconds(absoluteTime - startTime, ticksPerQuarterNote, tempo);
+        midiNote.note = start.data1;
+        midiNote.velocity = start.data2;
+        midiNote.timestamp = start.time;
+        midiNote.duration = releaseTime - start.time;
         m_notes.push_back(midiNote);
+    };
+
+    for (const auto& event : events) {
+        const uint8_t type = event.status & 0xF0;
+        if (type != 0x80 && type != 0x90) continue;
+
+        auto& starts = noteStarts[(event.status & 0x0F) * 128 + event.data1];
+        if (type == 0x90 && event.data2 > 0) {
+            starts.push_back(&event);
+        } else if (!starts.empty()) {
+            // Note off, or note-on with velocity 0
+            addNote(*starts.front(), event.time);
+            starts.pop_front();
+        }
     }
-}
 
-double MidiParser::ticksToSeconds(uint32_t ticks, uint16_t ticksPerQuarterNote, uint32_t tempo) {
-    return (ticks * tempo) / (ticksPerQuarterNote * 1000000.0);
+    // Close any notes still sounding at the end of the song
+    for (const auto& starts : noteStarts) {
+        for (const MidiEvent* start : starts) {
+            addNote(*start, endTime);
+        }
+    }
+
+    std::stable_sort(m_notes.begin(), m_notes.end(), [](const MidiNote& a, const MidiNote& b) {
+        return a.timestamp < b.timestamp;
+    });
 }
 
-uint32_t MidiParser::readVarLen(const std::vector<uint8_t>& data, size_t& pos) {
+uint32_t MidiParser::readVarLen(const std::vector<uint8_t>& data, size_t& pos, size_t end) {
     uint32_t value = 0;
     uint8_t byte;
-    
-    do {
-        if (pos >= data.size()) return 0;
+
+    // At most four bytes (28 bits)
+    for (int i = 0; i < 4; ++i) {
+        if (pos >= end) return value;
         byte = data[pos++];
         value = (value << 7) | (byte & 0x7F);
-    } while (byte & 0x80);
-    
+        if (!(byte & 0x80)) break;
+    }
+
     return value;
 }
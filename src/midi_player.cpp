@@ -1,16 +1,27 @@
 #include "midi_player.h"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include "porttime.h"
 
 MidiPlayer::MidiPlayer()
-    : m_stream(nullptr)
-    , m_isPlaying(false)
-    , m_shouldStop(false)
+    : m_duration(0.0f)
+    , m_playing(false)
     , m_tempo(1.0f)
-    , m_startTime(0)
+    , m_anchorSong(0.0)
+    , m_anchorTime(0)
     , m_currentEventIndex(0)
+    , m_isPlaying(false)
+    , m_clockSequence(0)
+    , m_clockSong(0.0)
+    , m_clockTime(0)
+    , m_clockTempo(1.0f)
+    , m_wakeups(0)
+    , m_stream(nullptr)
+    , m_lastWriteTime(0)
 {
+    std::fill(std::begin(m_channelsUsed), std::end(m_channelsUsed), false);
 }
 
 MidiPlayer::~MidiPlayer() {
@@ -30,76 +41,124 @@ bool MidiPlayer::initialize() {
         Pm_Terminate();
         return false;
     }
-    
+
+    PmDeviceID device = Pm_GetDefaultOutputDeviceID();
+    if (device != pmNoDevice && !setOutputDevice(device)) {
+        std::cerr << "Failed to open the default MIDI output" << std::endl;
+    }
+
+    // Lives until cleanup, sleeping while there is nothing to play
+    m_playbackThread = std::make_unique<std::thread>(&MidiPlayer::playbackThread, this);
     return true;
 }
 
 void MidiPlayer::cleanup() {
-    stop();
-    if (m_stream) {
-        Pm_Close(m_stream);
-        m_stream = nullptr;
+    if (m_playbackThread) {
+        Command quit;
+        quit.type = Command::Quit;
+        // The queue only fills if the thread is stalled; wait for a slot
+        while (!m_commands.push(quit)) {
+            std::this_thread::yield();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_wake.notify_one();
+        m_playbackThread->join();
+        m_playbackThread.reset();
+
+        std::lock_guard<std::mutex> lock(m_streamMutex);
+        if (m_stream) {
+            Pm_Close(m_stream);
+            m_stream = nullptr;
+        }
+        Pt_Stop();
+        Pm_Terminate();
     }
-    Pt_Stop();
-    Pm_Terminate();
 }
 
 bool MidiPlayer::loadMidiFile(const std::string& filename) {
-    // TODO: Implement MIDI file parsing
-    // For now, just create a test sequence
-    m_events.clear();
-    
-    // Example test sequence
-    MidiEvent evt;
-    evt.timestamp = 0;
-    evt.status = 0x90;  // Note On, channel 0
-    evt.data1 = 60;     // Middle C
-    evt.data2 = 100;    // Velocity
-    m_events.push_back(evt);
-    
-    evt.timestamp = 500;
-    evt.status = 0x80;  // Note Off, channel 0
-    evt.data1 = 60;
-    evt.data2 = 0;
-    m_events.push_back(evt);
-    
+    MidiParser parser;
+    if (!parser.loadFile(filename)) {
+        return false;
+    }
+    setEvents(parser.getEvents());
     return true;
 }
 
+void MidiPlayer::setEvents(std::shared_ptr<const std::vector<MidiEvent>> events) {
+    m_duration = events && !events->empty() ? static_cast<float>(events->back().time) : 0.0f;
+    Command command;
+    command.type = Command::SetEvents;
+    command.events = std::move(events);
+    send(std::move(command));
+}
+
 void MidiPlayer::play() {
-    if (m_isPlaying || m_events.empty()) return;
-    
-    m_shouldStop = false;
-    m_isPlaying = true;
-    m_currentEventIndex = 0;
-    m_startTime = Pt_Time();
-    
-    m_playbackThread = std::make_unique<std::thread>(&MidiPlayer::playbackThread, this);
+    Command command;
+    command.type = Command::Play;
+    send(std::move(command));
 }
 
 void MidiPlayer::pause() {
-    m_isPlaying = false;
-    if (m_playbackThread && m_playbackThread->joinable()) {
-        m_playbackThread->join();
-    }
+    Command command;
+    command.type = Command::Pause;
+    send(std::move(command));
 }
 
 void MidiPlayer::stop() {
-    m_shouldStop = true;
-    m_isPlaying = false;
-    if (m_playbackThread && m_playbackThread->joinable()) {
-        m_playbackThread->join();
-    }
-    m_currentEventIndex = 0;
+    Command command;
+    command.type = Command::Stop;
+    send(std::move(command));
+}
+
+void MidiPlayer::seek(double seconds) {
+    Command command;
+    command.type = Command::Seek;
+    command.value = seconds;
+    send(std::move(command));
 }
 
 void MidiPlayer::setTempo(float tempo) {
-    m_tempo = tempo;
+    Command command;
+    command.type = Command::SetTempo;
+    command.value = tempo;
+    send(std::move(command));
+}
+
+void MidiPlayer::send(Command command) {
+    if (!m_commands.push(std::move(command))) {
+        std::cerr << "MIDI player command queue full, command dropped" << std::endl;
+        return;
+    }
+    // Taking the mutex orders the push before the thread's check-and-wait,
+    // so the notify can't fall between them; the thread never holds it for
+    // longer than that check
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_wake.notify_one();
 }
 
 float MidiPlayer::getPlaybackPosition() const {
-    if (!m_isPlaying) return 0.0f;
-    return static_cast<float>(Pt_Time() - m_startTime) / 1000.0f;
+    double song;
+    long time;
+    float tempo;
+    bool playing;
+    uint32_t sequence;
+    do {
+        sequence = m_clockSequence.load(std::memory_order_acquire);
+        song = m_clockSong.load(std::memory_order_relaxed);
+        time = m_clockTime.load(std::memory_order_relaxed);
+        tempo = m_clockTempo.load(std::memory_order_relaxed);
+        playing = m_isPlaying.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) || sequence != m_clockSequence.load(std::memory_order_relaxed));
+
+    if (playing) {
+        song += std::max<long>(Pt_Time() - time, 0) * double(tempo) / 1000.0;
+    }
+    return static_cast<float>(std::max(song, 0.0));
 }
 
 bool MidiPlayer::isPlaying() const {
@@ -121,32 +180,289 @@ std::vector<std::string> MidiPlayer::getAvailableOutputDevices() const {
 }
 
 bool MidiPlayer::setOutputDevice(int deviceIndex) {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    m_sink.reset();
     if (m_stream) {
         Pm_Close(m_stream);
         m_stream = nullptr;
     }
     
-    PmError err = Pm_OpenOutput(&m_stream, deviceIndex, nullptr, 0, nullptr, nullptr, 0);
+    // A non-zero latency makes PortMidi honour event timestamps (against
+    // Pt_Time, started in initialize)
+    PmError err = Pm_OpenOutput(&m_stream, deviceIndex, nullptr, kOutputBufferSize, nullptr, nullptr,
+                                kOutputLatencyMs);
+    if (err != pmNoError) m_stream = nullptr;
+    m_lastWriteTime = 0;
     return err == pmNoError;
 }
 
+void MidiPlayer::setOutputSink(std::unique_ptr<MidiOutputSink> sink) {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (m_stream) {
+        Pm_Close(m_stream);
+        m_stream = nullptr;
+    }
+    m_sink = std::move(sink);
+    m_lastWriteTime = 0;
+}
+
 void MidiPlayer::playbackThread() {
-    while (m_isPlaying && !m_shouldStop && m_currentEventIndex < m_events.size()) {
-        const MidiEvent& evt = m_events[m_currentEventIndex];
-        long currentTime = Pt_Time() - m_startTime;
-        
-        if (currentTime >= evt.timestamp) {
-            if (m_stream) {
-                PmEvent pmEvt;
-                pmEvt.message = Pm_Message(evt.status, evt.data1, evt.data2);
-                pmEvt.timestamp = 0;
-                Pm_Write(m_stream, &pmEvt, 1);
+    std::vector<PmEvent> batch;
+    batch.reserve(kMaxBatchEvents);
+    for (;;) {
+        m_wakeups.fetch_add(1, std::memory_order_relaxed);
+        Command command;
+        while (m_commands.pop(command)) {
+            if (command.type == Command::Quit) {
+                if (m_playing) silence();
+                return;
             }
-            m_currentEventIndex++;
+            apply(command);
+        }
+
+        const long delay = m_playing ? writeDueEvents(batch) : -1;
+        if (delay == 0) continue;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto hasCommand = [this] { return !m_commands.empty(); };
+        if (delay < 0) {
+            m_wake.wait(lock, hasCommand);
+        } else {
+            m_wake.wait_for(lock, std::chrono::milliseconds(delay), hasCommand);
         }
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-    
-    m_isPlaying = false;
+}
+
+void MidiPlayer::apply(Command& command) {
+    const long now = Pt_Time();
+    switch (command.type) {
+    case Command::Play:
+        if (m_playing || !m_events || m_events->empty()) return;
+        if (m_currentEventIndex >= m_events->size()) {
+            seekTo(0.0);
+        }
+        m_playing = true;
+        m_anchorTime = outputTime();
+        break;
+
+    case Command::Pause:
+        if (!m_playing) return;
+        // Events already written to the lookahead still play, and the All
+        // Notes Off lands after them. Resuming carries on with the next
+        // unwritten event, the clock held no earlier than the last written
+        // one, so nothing plays twice.
+        silence();
+        m_anchorSong = songTimeAt(now);
+        if (m_currentEventIndex > 0) {
+            m_anchorSong = std::max(m_anchorSong, (*m_events)[m_currentEventIndex - 1].time);
+        }
+        m_playing = false;
+        break;
+
+    case Command::Stop:
+        seekTo(0.0);
+        m_playing = false;
+        break;
+
+    case Command::Seek:
+        seekTo(command.value);
+        break;
+
+    case Command::SetTempo:
+        // Re-anchor at the current position so only what follows speeds up
+        if (m_playing) {
+            m_anchorSong = songTimeAt(now);
+            m_anchorTime = now;
+        }
+        m_tempo = std::max(kMinTempo, static_cast<float>(command.value));
+        break;
+
+    case Command::SetEvents: {
+        if (m_playing) silence();
+        m_playing = false;
+        m_events = std::move(command.events);
+        m_currentEventIndex = 0;
+        m_anchorSong = 0.0;
+
+        // Snapshots let a seek chase the state from the nearest one
+        // instead of from the start of the song
+        m_chaseSnapshots.clear();
+        std::fill(std::begin(m_channelsUsed), std::end(m_channelsUsed), false);
+        if (m_events) {
+            ChaseState state;
+            std::memset(&state, 0xFF, sizeof(state));
+            std::fill(std::begin(state.used), std::end(state.used), false);
+            for (size_t i = 0; i < m_events->size(); ++i) {
+                if (i % kChaseInterval == 0) m_chaseSnapshots.push_back(state);
+                track(state, (*m_events)[i]);
+            }
+            std::copy(std::begin(state.used), std::end(state.used), std::begin(m_channelsUsed));
+        }
+        break;
+    }
+
+    case Command::Quit:
+        break;
+    }
+    publishClock(now);
+}
+
+long MidiPlayer::writeDueEvents(std::vector<PmEvent>& batch) {
+    const std::vector<MidiEvent>& events = *m_events;
+    const long now = Pt_Time();
+    if (m_currentEventIndex >= events.size()) {
+        // Everything is written; the song ends when its last event plays
+        const long end = events.empty() ? now : dueTime(events.back());
+        if (now < end) return end - now;
+        m_playing = false;
+        m_currentEventIndex = 0;
+        m_anchorSong = 0.0;
+        publishClock(now);
+        return -1;
+    }
+
+    // Everything due before the end of the lookahead window goes out in
+    // one write, each event stamped with its own time
+    const long horizon = now + kLookaheadMs;
+    batch.clear();
+    while (m_currentEventIndex < events.size() && dueTime(events[m_currentEventIndex]) <= horizon &&
+           batch.size() < kMaxBatchEvents) {
+        const MidiEvent& evt = events[m_currentEventIndex++];
+        PmEvent pmEvt;
+        pmEvt.message = Pm_Message(evt.status, evt.data1, evt.data2);
+        pmEvt.timestamp = static_cast<PmTimestamp>(dueTime(evt));
+        batch.push_back(pmEvt);
+    }
+    write(batch);
+    if (batch.size() == kMaxBatchEvents) return 0;
+    if (m_currentEventIndex >= events.size()) return std::max<long>(dueTime(events.back()) - Pt_Time(), 0);
+
+    // Sleep until the next event is kBatchMs into the window, so dense
+    // passages are gathered into one write and still go out early
+    const long wake = dueTime(events[m_currentEventIndex]) - kLookaheadMs + kBatchMs;
+    return std::max<long>(wake - Pt_Time(), 0);
+}
+
+void MidiPlayer::seekTo(double seconds) {
+    if (m_playing) silence();
+    if (!m_events) return;
+
+    const std::vector<MidiEvent>& events = *m_events;
+    seconds = std::max(seconds, 0.0);
+    const auto next = std::lower_bound(events.begin(), events.end(), seconds,
+                                       [](const MidiEvent& e, double t) { return e.time < t; });
+    m_currentEventIndex = static_cast<size_t>(next - events.begin());
+    m_anchorSong = seconds;
+    chase(m_currentEventIndex);
+    m_anchorTime = outputTime();
+}
+
+void MidiPlayer::chase(size_t eventIndex) {
+    if (m_chaseSnapshots.empty()) return;
+
+    // State just before eventIndex: nearest snapshot, then the events since
+    const size_t snapshot = std::min(eventIndex / kChaseInterval, m_chaseSnapshots.size() - 1);
+    ChaseState state = m_chaseSnapshots[snapshot];
+    for (size_t i = snapshot * kChaseInterval; i < eventIndex; ++i) {
+        track(state, (*m_events)[i]);
+    }
+
+    // Every channel the song uses starts from its defaults, then gets the
+    // values set before the new position; bank select precedes the program
+    const PmTimestamp now = static_cast<PmTimestamp>(Pt_Time());
+    std::vector<PmEvent> messages;
+    auto add = [&messages, now](int status, int data1, int data2) {
+        PmEvent event;
+        event.message = Pm_Message(status, data1, data2);
+        event.timestamp = now;
+        messages.push_back(event);
+    };
+    for (int channel = 0; channel < 16; ++channel) {
+        if (!m_channelsUsed[channel]) continue;
+        add(0xB0 | channel, 121, 0); // Reset All Controllers
+        if (!state.used[channel]) continue;
+        for (int controller = 0; controller < 120; ++controller) {
+            if (state.controllers[channel][controller] != 0xFF) add(0xB0 | channel, controller, state.controllers[channel][controller]);
+        }
+        if (state.program[channel] != 0xFF) add(0xC0 | channel, state.program[channel], 0);
+        if (state.pressure[channel] != 0xFF) add(0xD0 | channel, state.pressure[channel], 0);
+        if (state.bend[channel][0] != 0xFF) add(0xE0 | channel, state.bend[channel][0], state.bend[channel][1]);
+    }
+
+    // The buffer holds kOutputBufferSize events, so a big chase goes in parts
+    for (size_t offset = 0; offset < messages.size(); offset += kMaxBatchEvents) {
+        std::vector<PmEvent> part(messages.begin() + offset,
+                                  messages.begin() + std::min(messages.size(), offset + kMaxBatchEvents));
+        write(part);
+    }
+}
+
+void MidiPlayer::track(ChaseState& state, const MidiEvent& event) {
+    const int channel = event.status & 0x0F;
+    switch (event.status & 0xF0) {
+    case 0xB0:
+        // Channel mode messages (120-127) are actions, not state
+        if (event.data1 < 120) state.controllers[channel][event.data1] = event.data2;
+        break;
+    case 0xC0:
+        state.program[channel] = event.data1;
+        break;
+    case 0xD0:
+        state.pressure[channel] = event.data1;
+        break;
+    case 0xE0:
+        state.bend[channel][0] = event.data1;
+        state.bend[channel][1] = event.data2;
+        break;
+    default:
+        break;
+    }
+    state.used[channel] = true;
+}
+
+void MidiPlayer::write(std::vector<PmEvent>& events) {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if ((!m_stream && !m_sink) || events.empty()) return;
+
+    // PortMidi needs non-decreasing timestamps; a tempo change or seek can
+    // put new events before ones already queued in the lookahead window
+    PmTimestamp floor = static_cast<PmTimestamp>(m_lastWriteTime);
+    for (auto& event : events) {
+        event.timestamp = std::max(event.timestamp, floor);
+        floor = event.timestamp;
+    }
+    if (m_sink) {
+        m_sink->write(events.data(), static_cast<int32_t>(events.size()));
+    } else {
+        Pm_Write(m_stream, events.data(), static_cast<int32_t>(events.size()));
+    }
+    m_lastWriteTime = floor;
+}
+
+long MidiPlayer::outputTime() {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    return std::max<long>(Pt_Time(), m_lastWriteTime);
+}
+
+void MidiPlayer::silence() {
+    // All Notes Off on every channel. write keeps timestamps in order, so
+    // this goes out after anything still queued in the lookahead window.
+    const PmTimestamp now = static_cast<PmTimestamp>(Pt_Time());
+    std::vector<PmEvent> events(16);
+    for (int channel = 0; channel < 16; ++channel) {
+        events[channel].message = Pm_Message(0xB0 | channel, 123, 0);
+        events[channel].timestamp = now;
+    }
+    write(events);
+}
+
+void MidiPlayer::publishClock(long now) {
+    const uint32_t sequence = m_clockSequence.load(std::memory_order_relaxed);
+    m_clockSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_clockSong.store(m_playing ? songTimeAt(now) : m_anchorSong, std::memory_order_relaxed);
+    m_clockTime.store(now, std::memory_order_relaxed);
+    m_clockTempo.store(m_tempo, std::memory_order_relaxed);
+    m_isPlaying.store(m_playing, std::memory_order_relaxed);
+    m_clockSequence.store(sequence + 2, std::memory_order_release);
 }
@@ -0,0 +1,126 @@
+#include "phrase_detector.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+    const uint64_t kHashBase = 0x100000001B3ULL;
+    // Candidates kept per window hash; later starts rarely add new matches
+    const size_t kMaxCandidates = 4;
+}
+
+PhraseDetector::PhraseDetector(size_t minPhraseLength, double timeQuantum)
+    : m_minPhraseLength(std::max<size_t>(2, minPhraseLength))
+    , m_timeQuantum(timeQuantum > 0 ? timeQuantum : 0.001)
+{
+}
+
+uint64_t PhraseDetector::tokenFor(const MidiNote& previous, const MidiNote& note) const {
+    // pitch (8 bits) | velocity (8) | duration (20) | onset gap (28)
+    uint64_t pitch = note.note;
+    uint64_t velocity = note.velocity;
+    uint64_t duration = static_cast<uint64_t>(std::llround(note.duration / m_timeQuantum)) & 0xFFFFF;
+    uint64_t gap = static_cast<uint64_t>(std::llround((note.timestamp - previous.timestamp) / m_timeQuantum)) & 0xFFFFFFF;
+    return pitch | (velocity << 8) | (duration << 16) | (gap << 36);
+}
+
+uint64_t PhraseDetector::anchorFor(const MidiNote& note) {
+    // The replay starts from the anchor's position and height, which follow
+    // from its velocity and pitch
+    return static_cast<uint64_t>(note.note) | (static_cast<uint64_t>(note.velocity) << 8);
+}
+
+std::vector<PhraseRepeat> PhraseDetector::findRepeats(const std::vector<MidiNote>& notes) const {
+    std::vector<PhraseRepeat> repeats;
+    const size_t window = m_minPhraseLength - 1; // Tokens compared per phrase
+    if (notes.size() < 2 * m_minPhraseLength) return repeats;
+
+    // tokens[i] describes note i relative to note i - 1
+    std::vector<uint64_t> tokens(notes.size(), 0);
+    for (size_t i = 1; i < notes.size(); ++i) {
+        tokens[i] = tokenFor(notes[i - 1], notes[i]);
+    }
+
+    // Rolling polynomial hash of tokens[s + 1 .. s + window] for every phrase
+    // start s, keyed by the anchor note
+    const size_t starts = notes.size() - m_minPhraseLength + 1;
+    std::vector<uint64_t> hashes(starts);
+    uint64_t basePow = 1;
+    for (size_t i = 0; i < window; ++i) basePow *= kHashBase;
+
+    uint64_t hash = 0;
+    for (size_t i = 1; i <= window; ++i) {
+        hash = hash * kHashBase + tokens[i];
+    }
+    hashes[0] = hash * kHashBase + anchorFor(notes[0]);
+    for (size_t s = 1; s < starts; ++s) {
+        hash = hash * kHashBase + tokens[s + window] - basePow * tokens[s];
+        hashes[s] = hash * kHashBase + anchorFor(notes[s]);
+    }
+
+    auto sameTokens = [&](size_t a, size_t b, size_t count) {
+        return anchorFor(notes[a]) == anchorFor(notes[b]) &&
+               std::equal(tokens.begin() + a + 1, tokens.begin() + a + count, tokens.begin() + b + 1);
+    };
+
+    std::unordered_map<uint64_t, std::vector<size_t>> seen;
+    seen.reserve(starts);
+    auto remember = [&](size_t s) {
+        auto& candidates = seen[hashes[s]];
+        if (candidates.size() < kMaxCandidates) candidates.push_back(s);
+    };
+
+    // Repeats match against the earliest occurrence of their notes and stop
+    // where that occurrence's phrase ends, so a loop calls one body again
+    // and again instead of growing a longer one each time round
+    std::vector<size_t> earliest(notes.size());
+    std::iota(earliest.begin(), earliest.end(), size_t(0));
+    std::vector<size_t> phraseEnd(notes.size(), 0); // End of the phrase a note starts or sits in, 0 for none
+
+    size_t pos = 0;
+    while (pos < starts) {
+        size_t bestSource = 0;
+        size_t bestLength = 0;
+
+        auto it = seen.find(hashes[pos]);
+        if (it != seen.end()) {
+            for (size_t candidate : it->second) {
+                const size_t source = earliest[candidate];
+                // The source must end before the repeat begins
+                size_t limit = pos - source;
+                if (phraseEnd[source] > 0) limit = std::min(limit, phraseEnd[source] - source);
+                if (limit < m_minPhraseLength) continue;
+                if (!sameTokens(source, pos, m_minPhraseLength)) continue;
+
+                size_t length = m_minPhraseLength;
+                while (pos + length < notes.size() && length < limit &&
+                       tokens[source + length] == tokens[pos + length]) {
+                    ++length;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestSource = source;
+                }
+            }
+        }
+
+        if (bestLength > 0) {
+            repeats.push_back({pos, bestSource, bestLength});
+            for (size_t k = 0; k < bestLength; ++k) {
+                earliest[pos + k] = earliest[bestSource + k];
+                if (phraseEnd[bestSource + k] == 0) phraseEnd[bestSource + k] = bestSource + bestLength;
+            }
+            // Phrases inside the repeat may still serve as sources later on
+            for (size_t s = pos; s < std::min(pos + bestLength, starts); ++s) {
+                remember(s);
+            }
+            pos += bestLength;
+        } else {
+            remember(pos);
+            ++pos;
+        }
+    }
+
+    return repeats;
+}
@@ -0,0 +1,314 @@
+#include "piano_roll.h"
+#include <glad/glad.h>
+#include <imgui.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+    constexpr double kMinViewSeconds = 0.01;
+
+    uint32_t packCell(uint32_t onsets, uint32_t velocity) {
+        return std::min<uint32_t>(onsets, 0xFFFFFF) | (velocity << 24);
+    }
+
+    bool startsBefore(const MidiNote& note, double time) {
+        return note.timestamp < time;
+    }
+}
+
+uint32_t NotePyramid::merge(uint32_t a, uint32_t b) {
+    return packCell(onsets(a) + onsets(b), std::max(velocity(a), velocity(b)));
+}
+
+void NotePyramid::clear() {
+    m_levels.clear();
+    m_baseBinSeconds = kMinBinSeconds;
+    m_duration = 0.0;
+    m_lowestPitch = 0;
+    m_rows = 1;
+}
+
+void NotePyramid::build(const std::vector<MidiNote>& notes) {
+    clear();
+    if (notes.empty()) return;
+
+    int lowest = 127, highest = 0;
+    for (const auto& note : notes) {
+        lowest = std::min<int>(lowest, note.note);
+        highest = std::max<int>(highest, note.note);
+        m_duration = std::max(m_duration, note.timestamp + note.duration);
+    }
+    m_lowestPitch = lowest;
+    m_rows = static_cast<size_t>(highest - lowest + 1);
+
+    // Power-of-two multiples of a millisecond, so long files get coarser
+    // base bins instead of an unbounded grid
+    while (m_duration / m_baseBinSeconds > static_cast<double>(kMaxBaseBins)) m_baseBinSeconds *= 2.0;
+    const size_t bins = std::max<size_t>(1, static_cast<size_t>(std::ceil(m_duration / m_baseBinSeconds)));
+
+    std::vector<uint32_t> base(bins * m_rows, 0);
+    for (const auto& note : notes) {
+        const size_t row = static_cast<size_t>(note.note - lowest);
+        const size_t first = std::min(bins - 1, static_cast<size_t>(std::max(0.0, note.timestamp) / m_baseBinSeconds));
+        const double end = std::max(note.timestamp, note.timestamp + note.duration);
+        size_t last = static_cast<size_t>(std::max(0.0, end) / m_baseBinSeconds);
+        // A note ending exactly on a bin edge doesn't sound in the next bin
+        if (last > first && last * m_baseBinSeconds >= end) --last;
+        last = std::min(bins - 1, last);
+
+        uint32_t& onsetCell = base[first * m_rows + row];
+        onsetCell = merge(onsetCell, packCell(1, note.velocity));
+        for (size_t bin = first + 1; bin <= last; ++bin) {
+            uint32_t& cell = base[bin * m_rows + row];
+            cell = merge(cell, packCell(0, note.velocity));
+        }
+    }
+    m_levels.push_back(std::move(base));
+
+    while (binCount(m_levels.size() - 1) > 1) {
+        const std::vector<uint32_t>& fine = m_levels.back();
+        const size_t fineBins = fine.size() / m_rows;
+        std::vector<uint32_t> coarse(((fineBins + 1) / 2) * m_rows, 0);
+        for (size_t bin = 0; bin < fineBins; ++bin) {
+            for (size_t row = 0; row < m_rows; ++row) {
+                uint32_t& cell = coarse[(bin / 2) * m_rows + row];
+                cell = merge(cell, fine[bin * m_rows + row]);
+            }
+        }
+        m_levels.push_back(std::move(coarse));
+    }
+}
+
+std::vector<MidiNote> notesInRange(const std::vector<MidiNote>& notes, double start, double end) {
+    std::vector<MidiNote> selected;
+    auto it = std::lower_bound(notes.begin(), notes.end(), start, startsBefore);
+    for (; it != notes.end() && it->timestamp < end; ++it) {
+        MidiNote note = *it;
+        note.duration = std::min(note.duration, end - note.timestamp);
+        note.timestamp -= start;
+        selected.push_back(note);
+    }
+    return selected;
+}
+
+PianoRoll::PianoRoll()
+    : m_longestNote(0.0)
+    , m_viewStart(0.0)
+    , m_viewEnd(1.0)
+    , m_selectionStart(0.0)
+    , m_selectionEnd(0.0)
+    , m_dragAnchor(-1.0)
+    , m_cursorTime(-1.0)
+    , m_texture(0)
+    , m_textureColumns(0)
+    , m_dirty(true)
+{}
+
+PianoRoll::~PianoRoll() {
+    if (m_texture) glDeleteTextures(1, &m_texture);
+}
+
+void PianoRoll::setNotes(std::vector<MidiNote> notes) {
+    if (!std::is_sorted(notes.begin(), notes.end(),
+                        [](const MidiNote& a, const MidiNote& b) { return a.timestamp < b.timestamp; })) {
+        std::stable_sort(notes.begin(), notes.end(),
+                         [](const MidiNote& a, const MidiNote& b) { return a.timestamp < b.timestamp; });
+    }
+    m_notes = std::move(notes);
+    m_longestNote = 0.0;
+    for (const auto& note : m_notes) m_longestNote = std::max(m_longestNote, note.duration);
+    m_pyramid.build(m_notes);
+
+    m_viewStart = 0.0;
+    m_viewEnd = std::max(m_pyramid.duration(), kMinViewSeconds);
+    clearSelection();
+    m_dirty = true;
+}
+
+void PianoRoll::clear() {
+    setNotes({});
+}
+
+uint32_t PianoRoll::colorFor(uint32_t cell) {
+    const uint32_t velocity = NotePyramid::velocity(cell);
+    if (velocity == 0) return 0;
+    // Held notes in blue, brighter with velocity; onsets lighten the bin
+    const float level = 0.35f + 0.65f * static_cast<float>(velocity) / 127.0f;
+    const float lift = NotePyramid::onsets(cell) > 0 ? 0.35f : 0.0f;
+    auto channel = [&](float base) {
+        return static_cast<uint32_t>(std::min(255.0f, (base * level + (255.0f - base * level) * lift)));
+    };
+    return IM_COL32(channel(70.0f), channel(150.0f), channel(255.0f), 255);
+}
+
+void PianoRoll::rasterize(double start, double end, int columns, std::vector<uint32_t>& texels) const {
+    texels.assign(static_cast<size_t>(columns) * m_pyramid.rowCount(), 0);
+    if (m_pyramid.empty()) return;
+
+    // The coarsest level whose bins are still no wider than a column
+    const double secondsPerColumn = (end - start) / columns;
+    if (secondsPerColumn < m_pyramid.binSeconds(0)) {
+        rasterizeNotes(start, end, columns, texels);
+        return;
+    }
+    size_t level = 0;
+    while (level + 1 < m_pyramid.levelCount() && m_pyramid.binSeconds(level + 1) <= secondsPerColumn) ++level;
+    rasterizeLevel(level, start, end, columns, texels);
+}
+
+void PianoRoll::rasterizeLevel(size_t level, double start, double end, int columns,
+                               std::vector<uint32_t>& texels) const {
+    const int rows = m_pyramid.rowCount();
+    const double binSeconds = m_pyramid.binSeconds(level);
+    const double bins = static_cast<double>(m_pyramid.binCount(level));
+    const double secondsPerColumn = (end - start) / columns;
+    std::vector<uint32_t> column(rows);
+    for (int x = 0; x < columns; ++x) {
+        const double from = std::max(0.0, (start + x * secondsPerColumn) / binSeconds);
+        const double to = std::min(bins, (start + (x + 1) * secondsPerColumn) / binSeconds);
+        if (to <= from) continue;
+
+        // Every bin the column touches, at most a few at this level
+        std::fill(column.begin(), column.end(), 0);
+        const size_t last = static_cast<size_t>(std::ceil(to));
+        for (size_t bin = static_cast<size_t>(from); bin < last; ++bin) {
+            for (int row = 0; row < rows; ++row) {
+                column[row] = NotePyramid::merge(column[row], m_pyramid.cell(level, bin, row));
+            }
+        }
+        for (int row = 0; row < rows; ++row) {
+            texels[static_cast<size_t>(rows - 1 - row) * columns + x] = colorFor(column[row]);
+        }
+    }
+}
+
+void PianoRoll::rasterizeNotes(double start, double end, int columns, std::vector<uint32_t>& texels) const {
+    // Zoomed in past the finest bins: few enough notes are in view to draw
+    // them one by one
+    const int rows = m_pyramid.rowCount();
+    const double secondsPerColumn = (end - start) / columns;
+    std::vector<uint32_t> cells(static_cast<size_t>(rows) * columns, 0);
+    auto first = std::lower_bound(m_notes.begin(), m_notes.end(), start - m_longestNote, startsBefore);
+    for (auto it = first; it != m_notes.end() && it->timestamp < end; ++it) {
+        const double onset = (it->timestamp - start) / secondsPerColumn;
+        const double release = (it->timestamp + it->duration - start) / secondsPerColumn;
+        if (release < 0.0) continue;
+        const int from = static_cast<int>(std::max(0.0, std::floor(onset)));
+        const int to = static_cast<int>(std::min<double>(columns - 1, std::floor(release)));
+        const size_t row = static_cast<size_t>(rows - 1 - (it->note - m_pyramid.lowestPitch()));
+        for (int x = from; x <= to; ++x) {
+            const uint32_t onsets = x == from && onset >= 0.0 ? 1 : 0;
+            uint32_t& cell = cells[row * columns + x];
+            cell = NotePyramid::merge(cell, onsets | (uint32_t(it->velocity) << 24));
+        }
+    }
+    for (size_t i = 0; i < cells.size(); ++i) texels[i] = colorFor(cells[i]);
+}
+
+void PianoRoll::draw(float height) {
+    if (m_notes.empty()) {
+        ImGui::TextDisabled("Select a MIDI file to see its notes");
+        return;
+    }
+
+    const ImVec2 size(std::max(ImGui::GetContentRegionAvail().x, 1.0f), height);
+    const int columns = static_cast<int>(size.x);
+    ImGui::InvisibleButton("PianoRoll", size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+    const ImVec2 corner = ImGui::GetItemRectMin();
+    const ImGuiIO& io = ImGui::GetIO();
+    const double span = m_viewEnd - m_viewStart;
+    const double secondsPerPixel = span / size.x;
+    const double mouseTime = m_viewStart + (io.MousePos.x - corner.x) * secondsPerPixel;
+
+    if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+        // Zoom about the time under the mouse
+        const double limit = std::max(m_pyramid.duration(), kMinViewSeconds);
+        const double zoomed = std::clamp(span * std::pow(0.8, io.MouseWheel), kMinViewSeconds, limit);
+        const double anchor = (mouseTime - m_viewStart) / span;
+        m_viewStart = mouseTime - anchor * zoomed;
+        m_viewEnd = m_viewStart + zoomed;
+        m_dirty = true;
+    }
+    if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Right)) {
+        const double shift = -ImGui::GetMouseDragDelta(ImGuiMouseButton_Right).x * secondsPerPixel;
+        m_viewStart += shift;
+        m_viewEnd += shift;
+        ImGui::ResetMouseDragDelta(ImGuiMouseButton_Right);
+        m_dirty = true;
+    }
+    if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+        m_dragAnchor = std::max(0.0, mouseTime);
+    }
+    if (m_dragAnchor >= 0.0) {
+        const double time = std::clamp(mouseTime, 0.0, m_pyramid.duration());
+        m_selectionStart = std::min(m_dragAnchor, time);
+        m_selectionEnd = std::max(m_dragAnchor, time);
+        if (!ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+            // A click without a drag clears the selection
+            if ((m_selectionEnd - m_selectionStart) / secondsPerPixel < 2.0) clearSelection();
+            m_dragAnchor = -1.0;
+        }
+    }
+
+    // Keep the view on the song
+    const double viewSpan = m_viewEnd - m_viewStart;
+    const double margin = viewSpan * 0.5;
+    if (m_viewStart < -margin || m_viewEnd > m_pyramid.duration() + margin) {
+        m_viewStart = std::clamp(m_viewStart, -margin, std::max(-margin, m_pyramid.duration() + margin - viewSpan));
+        m_viewEnd = m_viewStart + viewSpan;
+        m_dirty = true;
+    }
+
+    if (!m_texture) {
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        m_dirty = true;
+    }
+    if (m_dirty || columns != m_textureColumns) {
+        rasterize(m_viewStart, m_viewEnd, columns, m_texels);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, columns, m_pyramid.rowCount(), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     m_texels.data());
+        m_textureColumns = columns;
+        m_dirty = false;
+    }
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const ImVec2 far(corner.x + size.x, corner.y + size.y);
+    drawList->AddRectFilled(corner, far, IM_COL32(20, 20, 28, 255));
+    drawList->AddImage(reinterpret_cast<ImTextureID>(static_cast<intptr_t>(m_texture)), corner, far);
+
+    // Octave lines at every C
+    const float rowHeight = size.y / m_pyramid.rowCount();
+    for (int row = 0; row < m_pyramid.rowCount(); ++row) {
+        if ((m_pyramid.lowestPitch() + row) % 12 != 0) continue;
+        const float y = far.y - row * rowHeight;
+        drawList->AddLine(ImVec2(corner.x, y), ImVec2(far.x, y), IM_COL32(255, 255, 255, 30));
+    }
+
+    auto screenX = [&](double time) {
+        return static_cast<float>(corner.x + (time - m_viewStart) / secondsPerPixel);
+    };
+    if (hasSelection() || m_dragAnchor >= 0.0) {
+        drawList->AddRectFilled(ImVec2(std::max(corner.x, screenX(m_selectionStart)), corner.y),
+                                ImVec2(std::min(far.x, screenX(m_selectionEnd)), far.y), IM_COL32(255, 200, 0, 50));
+    }
+    if (m_cursorTime >= m_viewStart && m_cursorTime <= m_viewEnd) {
+        const float x = screenX(m_cursorTime);
+        drawList->AddLine(ImVec2(x, corner.y), ImVec2(x, far.y), IM_COL32(255, 80, 80, 200));
+    }
+
+    ImGui::Text("%zu notes, %.1f s  |  view %.2f-%.2f s", m_notes.size(), m_pyramid.duration(), m_viewStart, m_viewEnd);
+    if (hasSelection()) {
+        ImGui::Text("Converting %.2f-%.2f s", m_selectionStart, m_selectionEnd);
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Clear Selection")) clearSelection();
+    } else {
+        ImGui::TextDisabled("Drag to convert only part of the song");
+    }
+}
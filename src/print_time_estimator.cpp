@@ -0,0 +1,194 @@
+#include "print_time_estimator.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+PrintTimeEstimator::PrintTimeEstimator(double acceleration, double jerk, double maxSpeed)
+    : m_acceleration(acceleration > 0 ? acceleration : 1000.0)
+    , m_jerk(std::max(0.0, jerk))
+    , m_maxSpeed(maxSpeed > 0 ? maxSpeed : 100.0)
+{
+}
+
+PrintTimeEstimator::PrintTimeEstimator(const PrinterProfile& profile)
+    : PrintTimeEstimator(profile.acceleration, profile.jerk, profile.maxSpeed)
+{
+}
+
+std::vector<BlockTiming> PrintTimeEstimator::planBlocks(const std::vector<ToolMove>& moves) const {
+    std::vector<BlockTiming> blocks;
+    if (moves.size() < 2) return blocks;
+
+    const size_t count = moves.size() - 1; // The first move only sets the start position
+    blocks.resize(count);
+    std::vector<double> dirX(count), dirY(count), dirZ(count);
+    std::vector<double> maxEntry(count + 1, 0.0);
+
+    for (size_t i = 0; i < count; ++i) {
+        const ToolMove& from = moves[i];
+        const ToolMove& to = moves[i + 1];
+        double dx = to.x - from.x;
+        double dy = to.y - from.y;
+        double dz = to.z - from.z;
+        double length = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        BlockTiming& block = blocks[i];
+        block = {};
+        block.length = length;
+        block.cruiseSpeed = std::min(m_maxSpeed, to.feedrate / 60.0);
+        block.dwell = to.dwell;
+        if (length > 0) {
+            dirX[i] = dx / length;
+            dirY[i] = dy / length;
+            dirZ[i] = dz / length;
+        }
+    }
+
+    // Junction limits: the velocity change across a corner may not exceed
+    // the jerk, and dwells or empty moves bring the head to a stop
+    for (size_t i = 1; i < count; ++i) {
+        const BlockTiming& previous = blocks[i - 1];
+        const BlockTiming& next = blocks[i];
+        if (previous.dwell > 0 || previous.length <= 0 || next.length <= 0) continue;
+
+        double limit = std::min(previous.cruiseSpeed, next.cruiseSpeed);
+        double ux = dirX[i] - dirX[i - 1];
+        double uy = dirY[i] - dirY[i - 1];
+        double uz = dirZ[i] - dirZ[i - 1];
+        double change = std::sqrt(ux * ux + uy * uy + uz * uz);
+        if (change > 1e-9) {
+            limit = std::min(limit, m_jerk / change);
+        }
+        maxEntry[i] = limit;
+    }
+
+    // Backward pass: every block must be able to decelerate into the next
+    const double twoA = 2.0 * m_acceleration;
+    for (size_t i = count; i-- > 0;) {
+        double exit = maxEntry[i + 1];
+        maxEntry[i] = std::min(maxEntry[i], std::sqrt(exit * exit + twoA * blocks[i].length));
+    }
+
+    // Forward pass: every block must be able to accelerate out of the previous
+    for (size_t i = 0; i < count; ++i) {
+        double entry = maxEntry[i];
+        maxEntry[i + 1] = std::min(maxEntry[i + 1], std::sqrt(entry * entry + twoA * blocks[i].length));
+    }
+
+    double clock = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        BlockTiming& block = blocks[i];
+        block.startTime = clock;
+        block.entrySpeed = maxEntry[i];
+        block.exitSpeed = maxEntry[i + 1];
+
+        if (block.length > 0 && block.cruiseSpeed > 0) {
+            double vEntry = block.entrySpeed;
+            double vExit = block.exitSpeed;
+            double vCruise = std::max(block.cruiseSpeed, std::max(vEntry, vExit));
+            double accelDistance = (vCruise * vCruise - vEntry * vEntry) / twoA;
+            double decelDistance = (vCruise * vCruise - vExit * vExit) / twoA;
+
+            if (accelDistance + decelDistance > block.length) {
+                // Triangle profile: never reaches the programmed feedrate
+                vCruise = std::sqrt((twoA * block.length + vEntry * vEntry + vExit * vExit) / 2.0);
+                vCruise = std::max(vCruise, std::max(vEntry, vExit));
+                accelDistance = (vCruise * vCruise - vEntry * vEntry) / twoA;
+                decelDistance = block.length - accelDistance;
+            }
+
+            block.cruiseSpeed = vCruise;
+            block.accelTime = (vCruise - vEntry) / m_acceleration;
+            block.decelTime = (vCruise - vExit) / m_acceleration;
+            block.cruiseTime = std::max(0.0, block.length - accelDistance - decelDistance) / vCruise;
+        }
+
+        clock += block.moveTime() + block.dwell;
+    }
+
+    return blocks;
+}
+
+PrintTimeReport PrintTimeEstimator::estimate(const std::vector<ToolMove>& moves, const std::vector<MidiNote>& notes,
+                                             double timeScale, double barLength, size_t worstBarCount) const {
+    PrintTimeReport report;
+    std::vector<BlockTiming> blocks = planBlocks(moves);
+    for (const auto& block : blocks) {
+        report.totalTime += block.moveTime() + block.dwell;
+        report.dwellTime += block.dwell;
+    }
+
+    // A note sounds when the move towards it starts; both clocks are aligned
+    // on the first note so the lead-in moves don't count as drift
+    bool aligned = false;
+    double expectedOrigin = 0.0;
+    double actualOrigin = 0.0;
+    double lastExpected = 0.0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const ToolMove& move = moves[i + 1];
+        if (move.noteIndex == kNoSourceNote || move.noteIndex >= notes.size()) continue;
+
+        double expected = notes[move.noteIndex].timestamp * timeScale;
+        double actual = blocks[i].startTime;
+        if (!aligned) {
+            expectedOrigin = expected;
+            actualOrigin = actual;
+            aligned = true;
+        }
+        expected -= expectedOrigin;
+        actual -= actualOrigin;
+        lastExpected = std::max(lastExpected, expected);
+        report.notes.push_back({move.noteIndex, expected, actual, actual - expected});
+    }
+    report.expectedDuration = lastExpected;
+    if (report.notes.empty()) return report;
+
+    std::vector<double> magnitudes;
+    magnitudes.reserve(report.notes.size());
+    double sum = 0.0;
+    for (const auto& note : report.notes) {
+        magnitudes.push_back(std::abs(note.drift));
+        sum += magnitudes.back();
+    }
+    report.meanDrift = sum / magnitudes.size();
+    report.maxDrift = *std::max_element(magnitudes.begin(), magnitudes.end());
+    size_t p99Index = std::min(magnitudes.size() - 1, static_cast<size_t>(std::ceil(magnitudes.size() * 0.99)) - 1);
+    std::nth_element(magnitudes.begin(), magnitudes.begin() + p99Index, magnitudes.end());
+    report.p99Drift = magnitudes[p99Index];
+
+    // Worst bars by their largest note drift
+    if (barLength > 0) {
+        std::vector<BarDrift> bars;
+        for (const auto& note : report.notes) {
+            size_t bar = static_cast<size_t>(notes[note.noteIndex].timestamp / barLength);
+            if (bars.empty() || bars.back().bar != bar) {
+                bars.push_back({bar, bar * barLength, 0.0});
+            }
+            bars.back().maxDrift = std::max(bars.back().maxDrift, std::abs(note.drift));
+        }
+        size_t keep = std::min(worstBarCount, bars.size());
+        std::partial_sort(bars.begin(), bars.begin() + keep, bars.end(), [](const BarDrift& a, const BarDrift& b) {
+            return a.maxDrift > b.maxDrift;
+        });
+        bars.resize(keep);
+        report.worstBars = bars;
+    }
+
+    return report;
+}
+
+std::string PrintTimeReport::summary() const {
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "Estimated print time " << totalTime << " s (music " << expectedDuration << " s, dwell "
+        << dwellTime << " s)\n"
+        << std::setprecision(0)
+        << "Onset drift: max " << (maxDrift * 1000.0) << " ms, p99 " << (p99Drift * 1000.0)
+        << " ms, mean " << (meanDrift * 1000.0) << " ms\n";
+    for (const auto& bar : worstBars) {
+        out << "  Bar " << (bar.bar + 1) << " (" << std::setprecision(1) << bar.startTime << " s): "
+            << std::setprecision(0) << (bar.maxDrift * 1000.0) << " ms\n";
+    }
+    return out.str();
+}
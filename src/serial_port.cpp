@@ -0,0 +1,220 @@
+#include "serial_port.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <filesystem>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+SerialPort::~SerialPort() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool SerialPort::open(const std::string& path, int baudRate) {
+    close();
+    // COM10 and up are only reachable through the device namespace
+    const std::string device = path.rfind("\\\\", 0) == 0 ? path : "\\\\.\\" + path;
+    HANDLE handle = CreateFileA(device.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open serial port " << path << std::endl;
+        return false;
+    }
+
+    DCB dcb = {};
+    dcb.DCBlength = sizeof(dcb);
+    if (!GetCommState(handle, &dcb)) {
+        CloseHandle(handle);
+        return false;
+    }
+    dcb.BaudRate = static_cast<DWORD>(baudRate);
+    dcb.ByteSize = 8;
+    dcb.Parity = NOPARITY;
+    dcb.StopBits = ONESTOPBIT;
+    dcb.fBinary = TRUE;
+    dcb.fOutxCtsFlow = FALSE;
+    dcb.fOutxDsrFlow = FALSE;
+    dcb.fOutX = FALSE;
+    dcb.fInX = FALSE;
+    dcb.fDtrControl = DTR_CONTROL_ENABLE; // Most boards reset here; the sender waits for them
+    dcb.fRtsControl = RTS_CONTROL_ENABLE;
+    if (!SetCommState(handle, &dcb)) {
+        std::cerr << "Failed to configure serial port " << path << std::endl;
+        CloseHandle(handle);
+        return false;
+    }
+    PurgeComm(handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+    m_handle = handle;
+    m_readTimeoutMs = static_cast<unsigned long>(-1);
+    return true;
+}
+
+void SerialPort::close() {
+    if (m_handle) CloseHandle(m_handle);
+    m_handle = nullptr;
+}
+
+bool SerialPort::isOpen() const {
+    return m_handle != nullptr;
+}
+
+bool SerialPort::write(const char* data, size_t size) {
+    while (size > 0) {
+        DWORD written = 0;
+        if (!WriteFile(m_handle, data, static_cast<DWORD>(size), &written, nullptr)) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+int SerialPort::read(char* buffer, size_t size, std::chrono::milliseconds timeout) {
+    // Return at once with whatever is buffered, else wait up to the timeout
+    // for the first byte
+    const unsigned long timeoutMs = static_cast<unsigned long>(timeout.count());
+    if (timeoutMs != m_readTimeoutMs) {
+        COMMTIMEOUTS timeouts = {};
+        timeouts.ReadIntervalTimeout = MAXDWORD;
+        timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+        timeouts.ReadTotalTimeoutConstant = timeoutMs > 0 ? timeoutMs : 1;
+        if (!SetCommTimeouts(m_handle, &timeouts)) return -1;
+        m_readTimeoutMs = timeoutMs;
+    }
+    DWORD count = 0;
+    if (!ReadFile(m_handle, buffer, static_cast<DWORD>(size), &count, nullptr)) return -1;
+    return static_cast<int>(count);
+}
+
+std::vector<std::string> SerialPort::availablePorts() {
+    std::vector<std::string> ports;
+    char target[256];
+    for (int i = 1; i <= 64; ++i) {
+        const std::string name = "COM" + std::to_string(i);
+        if (QueryDosDeviceA(name.c_str(), target, sizeof(target)) != 0) {
+            ports.push_back(name);
+        }
+    }
+    return ports;
+}
+
+#else
+
+namespace {
+    // Standard rates only; 250000 needs a platform-specific ioctl
+    speed_t baudConstant(int baudRate) {
+        switch (baudRate) {
+            case 9600: return B9600;
+            case 19200: return B19200;
+            case 38400: return B38400;
+            case 57600: return B57600;
+            case 115200: return B115200;
+#ifdef B230400
+            case 230400: return B230400;
+#endif
+#ifdef B460800
+            case 460800: return B460800;
+#endif
+#ifdef B500000
+            case 500000: return B500000;
+#endif
+#ifdef B1000000
+            case 1000000: return B1000000;
+#endif
+            default: return B0;
+        }
+    }
+}
+
+bool SerialPort::open(const std::string& path, int baudRate) {
+    close();
+    const speed_t speed = baudConstant(baudRate);
+    if (speed == B0) {
+        std::cerr << "Unsupported baud rate " << baudRate << std::endl;
+        return false;
+    }
+    int descriptor = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (descriptor < 0) {
+        std::cerr << "Failed to open serial port " << path << std::endl;
+        return false;
+    }
+
+    termios settings;
+    if (tcgetattr(descriptor, &settings) != 0) {
+        ::close(descriptor);
+        return false;
+    }
+    cfmakeraw(&settings);
+    settings.c_cflag |= CLOCAL | CREAD;
+    settings.c_cflag &= ~(CSTOPB | CRTSCTS);
+    settings.c_cc[VMIN] = 0;
+    settings.c_cc[VTIME] = 0;
+    cfsetispeed(&settings, speed);
+    cfsetospeed(&settings, speed);
+    if (tcsetattr(descriptor, TCSANOW, &settings) != 0) {
+        std::cerr << "Failed to configure serial port " << path << std::endl;
+        ::close(descriptor);
+        return false;
+    }
+    tcflush(descriptor, TCIOFLUSH);
+    m_descriptor = descriptor;
+    return true;
+}
+
+void SerialPort::close() {
+    if (m_descriptor >= 0) ::close(m_descriptor);
+    m_descriptor = -1;
+}
+
+bool SerialPort::isOpen() const {
+    return m_descriptor >= 0;
+}
+
+bool SerialPort::write(const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t written = ::write(m_descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+int SerialPort::read(char* buffer, size_t size, std::chrono::milliseconds timeout) {
+    pollfd descriptor = {m_descriptor, POLLIN, 0};
+    const int ready = poll(&descriptor, 1, static_cast<int>(timeout.count()));
+    if (ready < 0) return errno == EINTR ? 0 : -1;
+    if (ready == 0) return 0;
+    if (descriptor.revents & (POLLERR | POLLNVAL)) return -1;
+
+    const ssize_t count = ::read(m_descriptor, buffer, size);
+    if (count < 0) return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    // Readable with nothing to read means the other end hung up
+    if (count == 0) return -1;
+    return static_cast<int>(count);
+}
+
+std::vector<std::string> SerialPort::availablePorts() {
+    std::vector<std::string> ports;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/dev", error)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("ttyUSB", 0) == 0 || name.rfind("ttyACM", 0) == 0 || name.rfind("cu.usb", 0) == 0) {
+            ports.push_back(entry.path().string());
+        }
+    }
+    return ports;
+}
+
+#endif
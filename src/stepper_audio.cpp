@@ -0,0 +1,259 @@
+#include "stepper_audio.h"
+#include "print_time_estimator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define M2G_HAVE_SSE2 1
+#include <emmintrin.h>
+#else
+#define M2G_HAVE_SSE2 0
+#endif
+
+namespace {
+    const double kPi = 3.14159265358979323846;
+
+    // sin(2πx) for x in [0, 1): a parabola refined once, within 0.1%
+    inline float parabolicSine(float x) {
+        const float t = x - 0.5f;
+        float y = 8.0f * t * (1.0f - 2.0f * std::fabs(t));
+        y += 0.225f * (y * std::fabs(y) - y);
+        return -y;
+    }
+
+    // One step period: the fundamental plus its octave. That gives the
+    // buzzy edge of a step pulse without the aliasing of a hard edge at
+    // step rates of several kHz.
+    inline float stepPulse(float x) {
+        const float octave = 2.0f * x;
+        return parabolicSine(x) + 0.5f * parabolicSine(octave - std::floor(octave));
+    }
+
+#if M2G_HAVE_SSE2
+    inline __m128 fraction(__m128 x) {
+        // Truncate, then step down for negatives: SSE2 has no floor
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+        truncated = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+        return _mm_sub_ps(x, truncated);
+    }
+
+    inline __m128 absolute(__m128 x) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+    }
+
+    inline __m128 parabolicSine(__m128 x) {
+        const __m128 t = _mm_sub_ps(x, _mm_set1_ps(0.5f));
+        __m128 y = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(8.0f), t),
+                              _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(2.0f), absolute(t))));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(y, absolute(y)), y)));
+        return _mm_sub_ps(_mm_setzero_ps(), y);
+    }
+
+    inline __m128 stepPulse(__m128 x) {
+        const __m128 octave = fraction(_mm_add_ps(x, x));
+        return _mm_add_ps(parabolicSine(x), _mm_mul_ps(_mm_set1_ps(0.5f), parabolicSine(octave)));
+    }
+#endif
+
+    // Adds one axis under constant acceleration to out[0, count). Sample n
+    // is tau = tau0 + n * dt into the phase, where the axis has moved
+    // tau * (velocity + accel * tau / 2) steps on from phase0.
+    void addAxis(float* out, size_t count, double tau0, double dt, double phase0,
+                 double velocity, double accel, float gain) {
+        size_t n = 0;
+#if M2G_HAVE_SSE2
+        // Offsets from phase0 stay small enough for float within a phase
+        const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 halfAccel = _mm_set1_ps(static_cast<float>(0.5 * accel));
+        const __m128 v = _mm_set1_ps(static_cast<float>(velocity));
+        const __m128 start = _mm_set1_ps(static_cast<float>(phase0));
+        const __m128 amplitude = _mm_set1_ps(gain);
+        for (; count - n >= 4; n += 4) {
+            const __m128 tau = _mm_add_ps(_mm_set1_ps(static_cast<float>(tau0 + n * dt)),
+                                          _mm_mul_ps(lane, _mm_set1_ps(static_cast<float>(dt))));
+            const __m128 steps = _mm_mul_ps(tau, _mm_add_ps(v, _mm_mul_ps(halfAccel, tau)));
+            const __m128 pulse = stepPulse(fraction(_mm_add_ps(start, steps)));
+            _mm_storeu_ps(out + n, _mm_add_ps(_mm_loadu_ps(out + n), _mm_mul_ps(amplitude, pulse)));
+        }
+#endif
+        for (; n < count; ++n) {
+            const double tau = tau0 + n * dt;
+            const double phase = phase0 + tau * (velocity + 0.5 * accel * tau);
+            out[n] += gain * stepPulse(static_cast<float>(phase - std::floor(phase)));
+        }
+    }
+
+    void writeLittleEndian(std::ostream& out, uint32_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+}
+
+StepperAudioConfig StepperAudioConfig::fromProfile(const PrinterProfile& profile) {
+    StepperAudioConfig config;
+    if (profile.stepsPerMm > 0) config.stepsPerMm = profile.stepsPerMm;
+    return config;
+}
+
+std::string StepperAudioReport::summary() const {
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "Rendered " << audioSeconds << " s of printer audio in " << std::setprecision(2) << renderSeconds
+        << " s";
+    if (renderSeconds > 0) {
+        out << std::setprecision(0) << " (" << (audioSeconds / renderSeconds) << "x real time)";
+    }
+    if (normalized) {
+        out << ", peak " << std::setprecision(1) << (20.0 * std::log10(peak)) << " dBFS normalized";
+    }
+    out << "\n";
+    return out.str();
+}
+
+StepperAudioRenderer::StepperAudioRenderer(const PrinterProfile& profile)
+    : StepperAudioRenderer(profile, StepperAudioConfig::fromProfile(profile))
+{
+}
+
+StepperAudioRenderer::StepperAudioRenderer(const PrinterProfile& profile, const StepperAudioConfig& config)
+    : m_profile(profile)
+    , m_config(config)
+{
+    if (m_config.sampleRate <= 0) {
+        throw std::invalid_argument("Sample rate must be positive");
+    }
+}
+
+std::vector<float> StepperAudioRenderer::render(const std::vector<ToolMove>& moves, StepperAudioReport* report) const {
+    const auto started = std::chrono::steady_clock::now();
+    const std::vector<BlockTiming> blocks = PrintTimeEstimator(m_profile).planBlocks(moves);
+
+    const double rate = m_config.sampleRate;
+    const double duration = blocks.empty() ? 0.0 : blocks.back().startTime + blocks.back().moveTime() + blocks.back().dwell;
+    std::vector<float> samples(static_cast<size_t>(std::ceil(duration * rate)), 0.0f);
+    const double stepsPerMm[3] = {m_config.stepsPerMm, m_config.stepsPerMm, m_config.zStepsPerMm};
+    const float gain = static_cast<float>(m_config.gain);
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const BlockTiming& block = blocks[i];
+        if (block.length <= 0 || block.moveTime() <= 0) continue;
+
+        const ToolMove& from = moves[i];
+        const ToolMove& to = moves[i + 1];
+        const double origin[3] = {from.x, from.y, from.z};
+        const double direction[3] = {(to.x - from.x) / block.length, (to.y - from.y) / block.length,
+                                     (to.z - from.z) / block.length};
+        const double accel = block.accelTime > 0 ? (block.cruiseSpeed - block.entrySpeed) / block.accelTime : 0.0;
+        const double decel = block.decelTime > 0 ? (block.cruiseSpeed - block.exitSpeed) / block.decelTime : 0.0;
+
+        struct Phase { double start, duration, speed, accel; };
+        const Phase phases[3] = {
+            {block.startTime, block.accelTime, block.entrySpeed, accel},
+            {block.startTime + block.accelTime, block.cruiseTime, block.cruiseSpeed, 0.0},
+            {block.startTime + block.accelTime + block.cruiseTime, block.decelTime, block.cruiseSpeed, -decel},
+        };
+
+        double travelled = 0.0; // mm along the move at the start of the phase
+        for (const Phase& phase : phases) {
+            const size_t first = static_cast<size_t>(std::ceil(phase.start * rate));
+            const size_t last = std::min(samples.size(),
+                                         static_cast<size_t>(std::ceil((phase.start + phase.duration) * rate)));
+            if (phase.duration > 0 && last > first) {
+                const double tau0 = first / rate - phase.start;
+                for (int axis = 0; axis < 3; ++axis) {
+                    // Steps per mm of travel along the move; the sign only
+                    // runs the oscillator backwards
+                    const double steps = direction[axis] * stepsPerMm[axis];
+                    if (std::fabs(steps) < 1e-9) continue;
+                    // Absolute position keeps the phase continuous across moves
+                    double phase0 = (origin[axis] + direction[axis] * travelled) * stepsPerMm[axis];
+                    phase0 -= std::floor(phase0);
+                    addAxis(samples.data() + first, last - first, tau0, 1.0 / rate, phase0,
+                            phase.speed * steps, phase.accel * steps, gain);
+                }
+            }
+            travelled += phase.duration * (phase.speed + 0.5 * phase.accel * phase.duration);
+        }
+    }
+
+    // DC blocker (a stopped axis holds its last value), then a peaking
+    // filter for the resonance of motor and frame
+    const double w0 = 2.0 * kPi * m_config.resonanceHz / rate;
+    const double alpha = std::sin(w0) / (2.0 * std::max(m_config.resonanceQ, 0.1));
+    const double boost = std::pow(10.0, m_config.resonanceGainDb / 40.0);
+    const double a0 = 1.0 + alpha / boost;
+    const double b0 = (1.0 + alpha * boost) / a0, b1 = -2.0 * std::cos(w0) / a0, b2 = (1.0 - alpha * boost) / a0;
+    const double a1 = b1, a2 = (1.0 - alpha / boost) / a0;
+    double dcIn = 0.0, dcOut = 0.0;
+    double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+    double peak = 0.0;
+    for (float& sample : samples) {
+        dcOut = sample - dcIn + 0.995 * dcOut;
+        dcIn = sample;
+        const double y = b0 * dcOut + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1; x1 = dcOut;
+        y2 = y1; y1 = y;
+        sample = static_cast<float>(y);
+        peak = std::max(peak, std::fabs(y));
+    }
+
+    // Full scale with a little headroom rather than clipping
+    const bool normalize = peak > 1.0;
+    if (normalize) {
+        const float scale = static_cast<float>(0.95 / peak);
+        for (float& sample : samples) sample *= scale;
+    }
+
+    if (report) {
+        report->audioSeconds = duration;
+        report->renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        report->peak = peak;
+        report->normalized = normalize;
+    }
+    return samples;
+}
+
+StepperAudioReport StepperAudioRenderer::renderToFile(const std::vector<ToolMove>& moves, const std::string& path) const {
+    StepperAudioReport report;
+    writeWav(render(moves, &report), m_config.sampleRate, path);
+    return report;
+}
+
+void StepperAudioRenderer::writeWav(const std::vector<float>& samples, int sampleRate, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Failed to open audio file " + path);
+    }
+
+    const uint32_t dataBytes = static_cast<uint32_t>(samples.size() * 2);
+    out.write("RIFF", 4);
+    writeLittleEndian(out, 36 + dataBytes, 4);
+    out.write("WAVEfmt ", 8);
+    writeLittleEndian(out, 16, 4);             // fmt chunk size
+    writeLittleEndian(out, 1, 2);              // PCM
+    writeLittleEndian(out, 1, 2);              // Mono
+    writeLittleEndian(out, static_cast<uint32_t>(sampleRate), 4);
+    writeLittleEndian(out, static_cast<uint32_t>(sampleRate) * 2, 4); // Byte rate
+    writeLittleEndian(out, 2, 2);              // Block align
+    writeLittleEndian(out, 16, 2);             // Bits per sample
+    out.write("data", 4);
+    writeLittleEndian(out, dataBytes, 4);
+
+    std::vector<char> pcm(dataBytes);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const float clamped = std::max(-1.0f, std::min(1.0f, samples[i]));
+        const uint16_t value = static_cast<uint16_t>(static_cast<int16_t>(std::lround(clamped * 32767.0f)));
+        pcm[2 * i] = static_cast<char>(value & 0xFF);
+        pcm[2 * i + 1] = static_cast<char>(value >> 8);
+    }
+    out.write(pcm.data(), static_cast<std::streamsize>(pcm.size()));
+    if (!out) {
+        throw std::runtime_error("Failed to write audio file " + path);
+    }
+}
@@ -0,0 +1,538 @@
+#include "thumbnail.h"
+#include "gcode_generator.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define M2G_HAVE_SSE2 1
+#include <emmintrin.h>
+#else
+#define M2G_HAVE_SSE2 0
+#endif
+
+namespace {
+    // Height gradient: low notes cool, high notes warm
+    const float kLowColor[3] = {0.20f, 0.45f, 0.95f};
+    const float kHighColor[3] = {1.00f, 0.55f, 0.10f};
+    const size_t kBase64LineLength = 78; // What PrusaSlicer writes
+
+    // One row of a line: pixel centres relative to the segment start, the
+    // segment vector and the colour to blend in
+    struct Span {
+        float* red;
+        float* green;
+        float* blue;
+        float* alpha;
+        float startX;        // Segment start (px)
+        float offsetY;       // Row centre minus segment start (px)
+        float dx, dy;
+        float inverseLength; // 1 / |d|^2, 0 for a dot
+        float reach;         // Distance at which coverage reaches 0 (px)
+        float color[3];
+    };
+
+    // Exact coverage by distance to the segment, blended source-over into
+    // premultiplied planes. Four pixels per step where SSE2 is available.
+    void blendSpan(const Span& span, int first, int last) {
+        int x = first;
+#if M2G_HAVE_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 dx = _mm_set1_ps(span.dx);
+        const __m128 dy = _mm_set1_ps(span.dy);
+        const __m128 ry = _mm_set1_ps(span.offsetY);
+        const __m128 ryDy = _mm_set1_ps(span.offsetY * span.dy);
+        const __m128 inverseLength = _mm_set1_ps(span.inverseLength);
+        const __m128 reach = _mm_set1_ps(span.reach);
+        const __m128 red = _mm_set1_ps(span.color[0]);
+        const __m128 green = _mm_set1_ps(span.color[1]);
+        const __m128 blue = _mm_set1_ps(span.color[2]);
+        for (; x + 3 <= last; x += 4) {
+            __m128 rx = _mm_add_ps(_mm_set1_ps(x - span.startX), lanes);
+            __m128 along = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(rx, dx), ryDy), inverseLength);
+            along = _mm_min_ps(one, _mm_max_ps(zero, along));
+            __m128 ex = _mm_sub_ps(rx, _mm_mul_ps(along, dx));
+            __m128 ey = _mm_sub_ps(ry, _mm_mul_ps(along, dy));
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+            __m128 coverage = _mm_min_ps(one, _mm_max_ps(zero, _mm_sub_ps(reach, distance)));
+            __m128 keep = _mm_sub_ps(one, coverage);
+            _mm_storeu_ps(span.red + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(span.red + x), keep),
+                                                   _mm_mul_ps(red, coverage)));
+            _mm_storeu_ps(span.green + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(span.green + x), keep),
+                                                     _mm_mul_ps(green, coverage)));
+            _mm_storeu_ps(span.blue + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(span.blue + x), keep),
+                                                    _mm_mul_ps(blue, coverage)));
+            _mm_storeu_ps(span.alpha + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(span.alpha + x), keep), coverage));
+        }
+#endif
+        for (; x <= last; ++x) {
+            const float rx = x + 0.5f - span.startX;
+            const float ry = span.offsetY;
+            const float along = std::min(1.0f, std::max(0.0f, (rx * span.dx + ry * span.dy) * span.inverseLength));
+            const float ex = rx - along * span.dx;
+            const float ey = ry - along * span.dy;
+            const float coverage = std::min(1.0f, std::max(0.0f, span.reach - std::sqrt(ex * ex + ey * ey)));
+            const float keep = 1.0f - coverage;
+            span.red[x] = span.red[x] * keep + span.color[0] * coverage;
+            span.green[x] = span.green[x] * keep + span.color[1] * coverage;
+            span.blue[x] = span.blue[x] * keep + span.color[2] * coverage;
+            span.alpha[x] = span.alpha[x] * keep + coverage;
+        }
+    }
+
+    void writeBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+        static const std::vector<uint32_t> table = [] {
+            std::vector<uint32_t> entries(256);
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+            return entries;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    uint32_t adler32(const std::vector<uint8_t>& data) {
+        uint32_t a = 1, b = 0;
+        size_t i = 0;
+        while (i < data.size()) {
+            // 5552 bytes is the most that can be summed before b overflows
+            size_t end = std::min(data.size(), i + 5552);
+            for (; i < end; ++i) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    // Deflate writes bits from the least significant end of each byte
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+        void write(uint32_t value, int count) {
+            m_bits |= static_cast<uint64_t>(value) << m_count;
+            m_count += count;
+            while (m_count >= 8) {
+                m_out.push_back(static_cast<uint8_t>(m_bits));
+                m_bits >>= 8;
+                m_count -= 8;
+            }
+        }
+
+        // Huffman codes are defined most significant bit first
+        void writeCode(uint32_t code, int length) {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; ++i) reversed |= ((code >> i) & 1) << (length - 1 - i);
+            write(reversed, length);
+        }
+
+        void flush() {
+            if (m_count > 0) m_out.push_back(static_cast<uint8_t>(m_bits));
+            m_bits = 0;
+            m_count = 0;
+        }
+
+    private:
+        std::vector<uint8_t>& m_out;
+        uint64_t m_bits = 0;
+        int m_count = 0;
+    };
+
+    // Literal/length symbol in the fixed Huffman code (RFC 1951, 3.2.6)
+    void writeFixedSymbol(BitWriter& bits, int symbol) {
+        if (symbol < 144) bits.writeCode(0x30 + symbol, 8);
+        else if (symbol < 256) bits.writeCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280) bits.writeCode(symbol - 256, 7);
+        else bits.writeCode(0xC0 + symbol - 280, 8);
+    }
+
+    const int kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    const int kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    const int kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                   8193, 12289, 16385, 24577};
+    const int kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    void writeMatch(BitWriter& bits, int length, int distance) {
+        int code = 28;
+        while (kLengthBase[code] > length) --code;
+        writeFixedSymbol(bits, 257 + code);
+        bits.write(length - kLengthBase[code], kLengthExtra[code]);
+
+        code = 29;
+        while (kDistanceBase[code] > distance) --code;
+        bits.writeCode(code, 5);
+        bits.write(distance - kDistanceBase[code], kDistanceExtra[code]);
+    }
+
+    // zlib stream with a single fixed-Huffman block and greedy LZ77 matching.
+    // Thumbnails are mostly transparent runs, which this handles well enough
+    // that dynamic Huffman tables aren't worth their cost.
+    std::vector<uint8_t> zlibCompress(const std::vector<uint8_t>& data) {
+        const int kWindow = 32768;
+        const int kMaxMatch = 258;
+        const int kHashBits = 15;
+
+        std::vector<uint8_t> out;
+        out.reserve(data.size() / 4 + 64);
+        out.push_back(0x78); // Deflate, 32 KiB window
+        out.push_back(0x01); // Fastest compression, no dictionary
+
+        BitWriter bits(out);
+        bits.write(1, 1); // Final block
+        bits.write(1, 2); // Fixed Huffman codes
+
+        std::vector<int32_t> head(size_t(1) << kHashBits, -1);
+        auto hashAt = [&data](size_t i) {
+            uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16);
+            return (v * 2654435761u) >> (32 - kHashBits);
+        };
+
+        const size_t size = data.size();
+        size_t i = 0;
+        while (i < size) {
+            if (i + 3 <= size) {
+                uint32_t hash = hashAt(i);
+                int32_t candidate = head[hash];
+                head[hash] = static_cast<int32_t>(i);
+                if (candidate >= 0 && static_cast<int>(i - candidate) <= kWindow) {
+                    size_t limit = std::min<size_t>(kMaxMatch, size - i);
+                    size_t length = 0;
+                    while (length < limit && data[candidate + length] == data[i + length]) ++length;
+                    if (length >= 3) {
+                        writeMatch(bits, static_cast<int>(length), static_cast<int>(i - candidate));
+                        for (size_t k = i + 1; k < i + length && k + 3 <= size; ++k) {
+                            head[hashAt(k)] = static_cast<int32_t>(k);
+                        }
+                        i += length;
+                        continue;
+                    }
+                }
+            }
+            writeFixedSymbol(bits, data[i]);
+            ++i;
+        }
+        writeFixedSymbol(bits, 256); // End of block
+        bits.flush();
+
+        writeBigEndian(out, adler32(data));
+        return out;
+    }
+
+    void writePngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+        writeBigEndian(out, static_cast<uint32_t>(data.size()));
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        writeBigEndian(out, crc32(out.data() + start, out.size() - start));
+    }
+}
+
+std::vector<ThumbnailSpec> parseThumbnailSpecs(const std::string& text) {
+    std::vector<ThumbnailSpec> specs;
+    std::stringstream list(text);
+    std::string entry;
+    while (std::getline(list, entry, ',')) {
+        std::string token;
+        for (char c : entry) {
+            if (!std::isspace(static_cast<unsigned char>(c))) {
+                token += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            }
+        }
+        if (token.empty()) continue;
+
+        ThumbnailSpec spec{0, 0, ThumbnailFormat::Png};
+        size_t slash = token.find('/');
+        if (slash != std::string::npos) {
+            std::string format = token.substr(slash + 1);
+            if (format == "QOI") spec.format = ThumbnailFormat::Qoi;
+            else if (format != "PNG") continue;
+            token.resize(slash);
+        }
+
+        size_t cross = token.find('X');
+        if (cross == std::string::npos) continue;
+        try {
+            spec.width = std::stoi(token.substr(0, cross));
+            spec.height = std::stoi(token.substr(cross + 1));
+        } catch (const std::exception&) {
+            continue;
+        }
+        if (spec.width < 1 || spec.height < 1 || spec.width > 1024 || spec.height > 1024) continue;
+        specs.push_back(spec);
+    }
+    return specs;
+}
+
+ThumbnailRenderer::ThumbnailRenderer(int width, int height)
+    : m_width(std::max(1, width))
+    , m_height(std::max(1, height))
+    , m_halfWidth(std::max(0.5f, std::min(m_width, m_height) / 120.0f))
+{
+}
+
+ThumbnailImage ThumbnailRenderer::render(const std::vector<ToolMove>& moves) {
+    const size_t pixels = static_cast<size_t>(m_width) * m_height;
+    m_red.assign(pixels, 0.0f);
+    m_green.assign(pixels, 0.0f);
+    m_blue.assign(pixels, 0.0f);
+    m_alpha.assign(pixels, 0.0f);
+
+    project(moves);
+    for (size_t i = 1; i < m_points.size(); ++i) {
+        drawSegment(m_points[i - 1], m_points[i]);
+    }
+    return resolve();
+}
+
+void ThumbnailRenderer::project(const std::vector<ToolMove>& moves) {
+    m_points.clear();
+    if (moves.empty()) return;
+
+    // Isometric view from the front-left corner, 30 degrees above the bed
+    const float diagonal = 0.70710678f;
+    const float rise = 0.5f;       // sin(30)
+    const float height = 0.8660254f; // cos(30)
+
+    m_points.reserve(moves.size());
+    float minU = INFINITY, maxU = -INFINITY, minV = INFINITY, maxV = -INFINITY;
+    float minZ = INFINITY, maxZ = -INFINITY;
+    for (const auto& move : moves) {
+        float x = static_cast<float>(move.x);
+        float y = static_cast<float>(move.y);
+        float z = static_cast<float>(move.z);
+        float u = (x - y) * diagonal;
+        float v = (x + y) * diagonal * rise + z * height;
+        if (!m_points.empty() && m_points.back().x == u && m_points.back().y == v && m_points.back().t == z) continue;
+        m_points.push_back({u, v, z});
+        minU = std::min(minU, u);
+        maxU = std::max(maxU, u);
+        minV = std::min(minV, v);
+        maxV = std::max(maxV, v);
+        minZ = std::min(minZ, z);
+        maxZ = std::max(maxZ, z);
+    }
+
+    // Fit the path into the image with a small margin, keeping its aspect
+    const float margin = std::max(1.0f, std::min(m_width, m_height) * 0.06f) + m_halfWidth;
+    const float spanU = std::max(maxU - minU, 1e-3f);
+    const float spanV = std::max(maxV - minV, 1e-3f);
+    const float scale = std::min(std::max(1.0f, m_width - 2.0f * margin) / spanU,
+                                 std::max(1.0f, m_height - 2.0f * margin) / spanV);
+    const float centerU = (minU + maxU) * 0.5f;
+    const float centerV = (minV + maxV) * 0.5f;
+    const float zRange = maxZ - minZ;
+    for (auto& point : m_points) {
+        float z = point.t;
+        point.x = m_width * 0.5f + (point.x - centerU) * scale;
+        point.y = m_height * 0.5f - (point.y - centerV) * scale;
+        point.t = zRange > 1e-6f ? (z - minZ) / zRange : 0.5f;
+    }
+}
+
+void ThumbnailRenderer::drawSegment(const Point& a, const Point& b) {
+    Span span;
+    span.startX = a.x;
+    span.dx = b.x - a.x;
+    span.dy = b.y - a.y;
+    const float lengthSquared = span.dx * span.dx + span.dy * span.dy;
+    span.inverseLength = lengthSquared > 1e-12f ? 1.0f / lengthSquared : 0.0f;
+    // Coverage falls from 1 to 0 over the half pixel around the line's edge
+    span.reach = m_halfWidth + 0.5f;
+    const float t = (a.t + b.t) * 0.5f;
+    for (int c = 0; c < 3; ++c) {
+        span.color[c] = kLowColor[c] + (kHighColor[c] - kLowColor[c]) * t;
+    }
+
+    const float reach = span.reach;
+    const int firstRow = std::max(0, static_cast<int>(std::floor(std::min(a.y, b.y) - reach)));
+    const int lastRow = std::min(m_height - 1, static_cast<int>(std::ceil(std::max(a.y, b.y) + reach)));
+    for (int row = firstRow; row <= lastRow; ++row) {
+        const float py = row + 0.5f;
+
+        // Columns whose centres can be within reach: the part of the
+        // segment within reach vertically, widened by reach
+        float t0 = 0.0f, t1 = 1.0f;
+        if (std::abs(span.dy) > 1e-6f) {
+            t0 = std::clamp((py - reach - a.y) / span.dy, 0.0f, 1.0f);
+            t1 = std::clamp((py + reach - a.y) / span.dy, 0.0f, 1.0f);
+        }
+        const float xa = a.x + span.dx * t0;
+        const float xb = a.x + span.dx * t1;
+        const int first = std::max(0, static_cast<int>(std::floor(std::min(xa, xb) - reach)));
+        const int last = std::min(m_width - 1, static_cast<int>(std::ceil(std::max(xa, xb) + reach)));
+        if (first > last) continue;
+
+        const size_t offset = static_cast<size_t>(row) * m_width;
+        span.red = m_red.data() + offset;
+        span.green = m_green.data() + offset;
+        span.blue = m_blue.data() + offset;
+        span.alpha = m_alpha.data() + offset;
+        span.offsetY = py - a.y;
+        blendSpan(span, first, last);
+    }
+}
+
+ThumbnailImage ThumbnailRenderer::resolve() const {
+    ThumbnailImage image;
+    image.width = m_width;
+    image.height = m_height;
+    image.rgba.resize(m_alpha.size() * 4);
+    for (size_t i = 0; i < m_alpha.size(); ++i) {
+        float alpha = m_alpha[i];
+        uint8_t* pixel = &image.rgba[i * 4];
+        if (alpha <= 0.0f) {
+            pixel[0] = pixel[1] = pixel[2] = pixel[3] = 0;
+            continue;
+        }
+        float unpremultiply = 255.0f / alpha;
+        pixel[0] = static_cast<uint8_t>(std::min(255.0f, m_red[i] * unpremultiply + 0.5f));
+        pixel[1] = static_cast<uint8_t>(std::min(255.0f, m_green[i] * unpremultiply + 0.5f));
+        pixel[2] = static_cast<uint8_t>(std::min(255.0f, m_blue[i] * unpremultiply + 0.5f));
+        pixel[3] = static_cast<uint8_t>(std::min(255.0f, alpha * 255.0f + 0.5f));
+    }
+    return image;
+}
+
+std::vector<uint8_t> encodePng(const ThumbnailImage& image) {
+    // Unfiltered scanlines, each prefixed with its filter type. The Sub filter
+    // came out larger: LZ77 already takes the transparent runs, and what is
+    // left are anti-aliased edges that don't predict from their neighbours.
+    const size_t stride = static_cast<size_t>(image.width) * 4;
+    std::vector<uint8_t> raw;
+    raw.reserve((stride + 1) * image.height);
+    for (int row = 0; row < image.height; ++row) {
+        raw.push_back(0);
+        const uint8_t* line = image.rgba.data() + row * stride;
+        raw.insert(raw.end(), line, line + stride);
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> header;
+    writeBigEndian(header, static_cast<uint32_t>(image.width));
+    writeBigEndian(header, static_cast<uint32_t>(image.height));
+    header.push_back(8); // Bits per channel
+    header.push_back(6); // RGBA
+    header.push_back(0); // Deflate
+    header.push_back(0); // Adaptive filtering
+    header.push_back(0); // Not interlaced
+    writePngChunk(png, "IHDR", header);
+    writePngChunk(png, "IDAT", zlibCompress(raw));
+    writePngChunk(png, "IEND", {});
+    return png;
+}
+
+std::vector<uint8_t> encodeQoi(const ThumbnailImage& image) {
+    std::vector<uint8_t> out = {'q', 'o', 'i', 'f'};
+    writeBigEndian(out, static_cast<uint32_t>(image.width));
+    writeBigEndian(out, static_cast<uint32_t>(image.height));
+    out.push_back(4); // RGBA
+    out.push_back(0); // sRGB with linear alpha
+
+    uint8_t seen[64][4] = {};
+    uint8_t previous[4] = {0, 0, 0, 255};
+    int run = 0;
+    const size_t pixels = image.rgba.size() / 4;
+    for (size_t i = 0; i < pixels; ++i) {
+        const uint8_t* pixel = &image.rgba[i * 4];
+        if (std::equal(pixel, pixel + 4, previous)) {
+            ++run;
+            if (run == 62 || i + 1 == pixels) {
+                out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+            run = 0;
+        }
+
+        int slot = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+        if (std::equal(pixel, pixel + 4, seen[slot])) {
+            out.push_back(static_cast<uint8_t>(slot));
+        } else {
+            std::copy(pixel, pixel + 4, seen[slot]);
+            if (pixel[3] == previous[3]) {
+                int dr = static_cast<int8_t>(pixel[0] - previous[0]);
+                int dg = static_cast<int8_t>(pixel[1] - previous[1]);
+                int db = static_cast<int8_t>(pixel[2] - previous[2]);
+                int drg = dr - dg;
+                int dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                    out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                    out.push_back(static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8)));
+                } else {
+                    out.insert(out.end(), {0xFE, pixel[0], pixel[1], pixel[2]});
+                }
+            } else {
+                out.insert(out.end(), {0xFF, pixel[0], pixel[1], pixel[2], pixel[3]});
+            }
+        }
+        std::copy(pixel, pixel + 4, previous);
+    }
+
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return out;
+}
+
+std::string encodeBase64(const std::vector<uint8_t>& data) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string text;
+    text.reserve((data.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        uint32_t group = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        text += kAlphabet[(group >> 18) & 63];
+        text += kAlphabet[(group >> 12) & 63];
+        text += kAlphabet[(group >> 6) & 63];
+        text += kAlphabet[group & 63];
+    }
+    if (i < data.size()) {
+        uint32_t group = data[i] << 16;
+        if (i + 1 < data.size()) group |= data[i + 1] << 8;
+        text += kAlphabet[(group >> 18) & 63];
+        text += kAlphabet[(group >> 12) & 63];
+        text += i + 1 < data.size() ? kAlphabet[(group >> 6) & 63] : '=';
+        text += '=';
+    }
+    return text;
+}
+
+void writeThumbnails(std::ostream& out, const std::vector<ToolMove>& moves, const std::vector<ThumbnailSpec>& specs) {
+    for (const auto& spec : specs) {
+        ThumbnailRenderer renderer(spec.width, spec.height);
+        ThumbnailImage image = renderer.render(moves);
+        bool qoi = spec.format == ThumbnailFormat::Qoi;
+        std::string text = encodeBase64(qoi ? encodeQoi(image) : encodePng(image));
+        const char* tag = qoi ? "thumbnail_QOI" : "thumbnail";
+
+        out << ";\n; " << tag << " begin " << spec.width << "x" << spec.height << " " << text.size() << "\n";
+        for (size_t pos = 0; pos < text.size(); pos += kBase64LineLength) {
+            out << "; " << text.substr(pos, kBase64LineLength) << "\n";
+        }
+        out << "; " << tag << " end\n;\n";
+    }
+}
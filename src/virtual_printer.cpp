@@ -0,0 +1,203 @@
+#include "virtual_printer.h"
+#include "gcode_lexer.h"
+#include "print_time_estimator.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    const double kBitsPerByte = 10.0; // Start, 8 data and stop bit
+    const size_t kOkBytes = 3;        // "ok\n"
+
+    enum class LineKind { Other, Motion, Dwell };
+
+    struct SentLine {
+        size_t lineNumber;
+        const char* begin;
+        const char* end;
+        LineKind kind;
+        double duration; // Execution time of its planner block (s)
+    };
+
+    // What a host sends: the line without comments and surrounding blanks
+    void trimForSending(const char*& begin, const char*& end) {
+        const char* comment = begin;
+        while (comment < end && *comment != ';') ++comment;
+        end = comment;
+        while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+        while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+    }
+}
+
+VirtualPrinterConfig VirtualPrinterConfig::fromProfile(const PrinterProfile& profile) {
+    VirtualPrinterConfig config;
+    config.acceleration = profile.acceleration;
+    config.jerk = profile.jerk;
+    config.maxSpeed = profile.maxSpeed;
+    config.dialect = profile.dialect;
+    return config;
+}
+
+VirtualPrinter::VirtualPrinter(const VirtualPrinterConfig& config)
+    : m_config(config)
+{
+    m_config.plannerDepth = std::max<size_t>(1, m_config.plannerDepth);
+    m_config.maxOutstandingLines = std::max<size_t>(1, m_config.maxOutstandingLines);
+    if (m_config.baudRate <= 0) m_config.baudRate = 115200.0;
+    if (m_config.sampleInterval <= 0) m_config.sampleInterval = 0.1;
+}
+
+VirtualPrinterReport VirtualPrinter::run(const std::string& gcode) const {
+    VirtualPrinterReport report;
+
+    // Collect the lines a host would send and the motion they describe
+    std::vector<SentLine> lines;
+    std::vector<ToolMove> moves;
+    moves.push_back({0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0, kNoSourceNote});
+    double feedrate = 3000.0;
+    bool relative = false;
+    const double dwellUnit = m_config.dialect == FirmwareDialect::Grbl ? 1.0 : 0.001;
+
+    const char* text = gcode.data();
+    const char* textEnd = text + gcode.size();
+    size_t lineNumber = 0;
+    GCodeLine parsed;
+    while (text < textEnd) {
+        const char* lineEnd = findNewline(text, textEnd);
+        ++lineNumber;
+
+        const char* begin = text;
+        const char* end = lineEnd;
+        text = lineEnd < textEnd ? lineEnd + 1 : textEnd;
+        trimForSending(begin, end);
+        if (begin == end || !parseGCodeLine(begin, end, parsed)) continue;
+
+        SentLine sent{lineNumber, begin, end, LineKind::Other, 0.0};
+        if (parsed.g == 90) relative = false;
+        if (parsed.g == 91) relative = true;
+        if (parsed.isMove()) {
+            ToolMove move = moves.back();
+            if (parsed.has(GCodeLine::HasF)) feedrate = parsed.f;
+            if (parsed.has(GCodeLine::HasX)) move.x = relative ? move.x + parsed.x : parsed.x;
+            if (parsed.has(GCodeLine::HasY)) move.y = relative ? move.y + parsed.y : parsed.y;
+            if (parsed.has(GCodeLine::HasZ)) move.z = relative ? move.z + parsed.z : parsed.z;
+            move.feedrate = feedrate;
+            move.dwell = 0.0;
+            moves.push_back(move);
+            sent.kind = LineKind::Motion;
+            sent.duration = static_cast<double>(moves.size() - 2); // Block index, resolved below
+        } else if (parsed.g == 4) {
+            double seconds = parsed.has(GCodeLine::HasP) ? parsed.p * dwellUnit
+                           : parsed.has(GCodeLine::HasS) ? parsed.s : 0.0;
+            moves.back().dwell += seconds; // Makes the planner stop at this junction
+            sent.kind = LineKind::Dwell;
+            sent.duration = seconds;
+        }
+        lines.push_back(sent);
+    }
+
+    PrintTimeEstimator estimator(m_config.acceleration, m_config.jerk, m_config.maxSpeed);
+    std::vector<BlockTiming> blocks = estimator.planBlocks(moves);
+    for (auto& line : lines) {
+        if (line.kind == LineKind::Motion) {
+            line.duration = blocks[static_cast<size_t>(line.duration)].moveTime();
+        }
+    }
+
+    // Stream the lines through link, parser and planner
+    const double secondsPerByte = kBitsPerByte / m_config.baudRate;
+    const double okTime = kOkBytes * secondsPerByte;
+    std::vector<double> ackTimes(lines.size(), 0.0);
+    std::deque<double> queuedBlockEnds;   // End times of blocks still in the planner
+    std::deque<double> admittedBlockEnds; // End times of the last plannerDepth blocks
+    double serialFree = 0.0;
+    double parserFree = 0.0;
+    double lastBlockEnd = 0.0;
+    bool anyBlock = false;
+
+    size_t currentBucket = static_cast<size_t>(-1);
+    auto sampleOccupancy = [&](double time, size_t blocksQueued) {
+        size_t bucket = static_cast<size_t>(time / m_config.sampleInterval);
+        if (bucket != currentBucket) {
+            currentBucket = bucket;
+            report.occupancy.push_back({bucket * m_config.sampleInterval, blocksQueued, blocksQueued});
+        } else {
+            OccupancySample& sample = report.occupancy.back();
+            sample.minBlocks = std::min(sample.minBlocks, blocksQueued);
+            sample.maxBlocks = std::max(sample.maxBlocks, blocksQueued);
+        }
+    };
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const SentLine& line = lines[i];
+        const size_t bytes = static_cast<size_t>(line.end - line.begin) + 1;
+        const double transmit = bytes * secondsPerByte;
+
+        // The host waits for the link and for an ok to free a send slot
+        double sendStart = serialFree;
+        if (i >= m_config.maxOutstandingLines) {
+            sendStart = std::max(sendStart, ackTimes[i - m_config.maxOutstandingLines]);
+        }
+        serialFree = sendStart + transmit;
+        report.serialBusyTime += transmit;
+        report.bytesSent += bytes;
+
+        double parsedAt = std::max(serialFree, parserFree) + m_config.parseTimePerLine;
+        double acceptedAt = parsedAt;
+
+        if (line.kind != LineKind::Other) {
+            // A full planner blocks the parser until the oldest block finishes
+            if (admittedBlockEnds.size() >= m_config.plannerDepth) {
+                acceptedAt = std::max(acceptedAt, admittedBlockEnds.front());
+                admittedBlockEnds.pop_front();
+            }
+
+            while (!queuedBlockEnds.empty() && queuedBlockEnds.front() <= acceptedAt) {
+                queuedBlockEnds.pop_front();
+            }
+            sampleOccupancy(acceptedAt, queuedBlockEnds.size());
+
+            if (anyBlock && acceptedAt > lastBlockEnd) {
+                double stall = acceptedAt - lastBlockEnd;
+                report.starvedTime += stall;
+                report.starvations.push_back({lastBlockEnd, stall, line.lineNumber,
+                                              std::string(line.begin, line.end)});
+            }
+
+            double start = std::max(acceptedAt, lastBlockEnd);
+            lastBlockEnd = start + line.duration;
+            anyBlock = true;
+            queuedBlockEnds.push_back(lastBlockEnd);
+            admittedBlockEnds.push_back(lastBlockEnd);
+        }
+
+        parserFree = acceptedAt;
+        ackTimes[i] = acceptedAt + okTime;
+    }
+
+    report.linesSent = lines.size();
+    report.totalTime = std::max(lastBlockEnd, lines.empty() ? 0.0 : ackTimes.back());
+    return report;
+}
+
+std::string VirtualPrinterReport::summary(size_t maxEvents) const {
+    std::stringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "Virtual printer: " << totalTime << " s, " << linesSent << " lines, " << bytesSent << " bytes, link "
+        << (totalTime > 0 ? serialBusyTime / totalTime * 100.0 : 0.0) << "% busy\n"
+        << "Planner starved " << starvations.size() << " times for " << std::setprecision(3)
+        << starvedTime << " s\n";
+
+    std::vector<StarvationEvent> worst = starvations;
+    size_t keep = std::min(maxEvents, worst.size());
+    std::partial_sort(worst.begin(), worst.begin() + keep, worst.end(),
+                      [](const StarvationEvent& a, const StarvationEvent& b) { return a.duration > b.duration; });
+    for (size_t i = 0; i < keep; ++i) {
+        out << "  " << std::setprecision(3) << worst[i].time << " s: stalled "
+            << std::setprecision(1) << (worst[i].duration * 1000.0) << " ms waiting for line "
+            << worst[i].lineNumber << " (" << worst[i].line << ")\n";
+    }
+    return out.str();
+}
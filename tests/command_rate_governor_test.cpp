@@ -0,0 +1,103 @@
+// Checks that governed notes are never closer together than the minimum
+// segment time, however the merge groups fall, and that no second of output
+// time, wherever it starts, holds more commands than the rate allows.
+
+#include "command_rate_governor.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+MidiNote note(double timestamp, uint8_t velocity) {
+    return {60, velocity, 0.05, timestamp};
+}
+
+// Smallest gap between consecutive kept notes, in output time
+double minimumSpacing(const GovernorResult& result, double timeScale) {
+    double spacing = 1e9;
+    for (size_t i = 1; i < result.notes.size(); ++i) {
+        spacing = std::min(spacing, (result.notes[i].timestamp - result.notes[i - 1].timestamp) * timeScale);
+    }
+    return spacing;
+}
+
+// Most commands in any one second of output time, each note costing a move
+// plus a dwell when it is held
+size_t busiestSecond(const GovernorResult& result, double timeScale, double dwellThreshold) {
+    size_t busiest = 0;
+    for (size_t i = 0; i < result.notes.size(); ++i) {
+        size_t commands = 0;
+        for (size_t j = i; j < result.notes.size() &&
+                           (result.notes[j].timestamp - result.notes[i].timestamp) * timeScale < 1.0; ++j) {
+            commands += result.notes[j].duration > dwellThreshold ? 2 : 1;
+        }
+        busiest = std::max(busiest, commands);
+    }
+    return busiest;
+}
+
+} // namespace
+
+int main() {
+    const double minSegment = 0.02;
+    const CommandRateGovernor governor(1000.0, minSegment, 0.1);
+
+    // The loudest note of a group sits just before the next group starts
+    {
+        const std::vector<MidiNote> notes = {note(0.000, 40), note(0.019, 127), note(0.020, 40)};
+        const GovernorResult result = governor.apply(notes, 1.0);
+        check(minimumSpacing(result, 1.0) >= minSegment, "0/19/20 ms: kept notes closer than the minimum segment");
+        check(result.notes.size() + result.mergedNotes == notes.size(), "0/19/20 ms: every note kept or merged");
+    }
+
+    // A burst straddling a whole second gets one second's budget, not two
+    {
+        const CommandRateGovernor slow(10.0, minSegment, 0.1);
+        std::vector<MidiNote> notes;
+        for (int i = 0; i < 20; ++i) {
+            notes.push_back(note(0.5 + i * 0.05, static_cast<uint8_t>(40 + i)));
+        }
+        const GovernorResult result = slow.apply(notes, 1.0);
+        check(busiestSecond(result, 1.0, 0.1) <= 10, "straddling burst: more than the rate in one second");
+        check(result.notes.size() == 10, "straddling burst: the budget is used");
+        check(result.notes.back().velocity == 59, "straddling burst: the loudest notes are kept");
+    }
+
+    // Dense random notes at two time scales
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> gap(0.0, 0.03);
+    std::uniform_int_distribution<int> velocity(1, 127);
+    for (double timeScale : {1.0, 0.5}) {
+        std::vector<MidiNote> notes;
+        double time = 0.0;
+        for (int i = 0; i < 5000; ++i) {
+            time += gap(random);
+            notes.push_back(note(time, static_cast<uint8_t>(velocity(random))));
+        }
+        const GovernorResult result = governor.apply(notes, timeScale);
+        check(!result.notes.empty(), "random notes: something kept");
+        check(minimumSpacing(result, timeScale) >= minSegment - 1e-12,
+              "random notes: kept notes closer than the minimum segment");
+
+        // Held notes cost a dwell too
+        const CommandRateGovernor tight(30.0, minSegment, 0.1);
+        std::uniform_real_distribution<double> duration(0.02, 0.3);
+        for (auto& held : notes) held.duration = duration(random);
+        const GovernorResult thinned = tight.apply(notes, timeScale);
+        check(busiestSecond(thinned, timeScale, 0.1) <= 30, "random notes: more than the rate in one second");
+    }
+
+    if (failures == 0) std::printf("command_rate_governor_test: passed\n");
+    return failures == 0 ? 0 : 1;
+}
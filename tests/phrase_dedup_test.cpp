@@ -0,0 +1,168 @@
+// Checks that deduplicating phrases leaves the music alone: every note
+// plays at the same feedrate, for the same time and with the same hold as
+// without deduplication, and replayed phrases stay on the bed. Looped
+// material has to come out smaller, and its thumbnail has to show the
+// path the replays actually take.
+
+#include "gcode_generator.h"
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+// How a note plays: the move to it and the hold after it
+struct Played {
+    double feedrate;
+    double moveTime; // (s)
+    double dwell;    // (s)
+};
+
+std::map<size_t, Played> playedNotes(const GCodeProgram& program) {
+    std::map<size_t, Played> played;
+    for (size_t i = 1; i < program.moves.size(); ++i) {
+        const ToolMove& move = program.moves[i];
+        if (move.noteIndex == kNoSourceNote) continue;
+        const ToolMove& previous = program.moves[i - 1];
+        const double distance = std::sqrt((move.x - previous.x) * (move.x - previous.x) +
+                                           (move.y - previous.y) * (move.y - previous.y) +
+                                           (move.z - previous.z) * (move.z - previous.z));
+        played[move.noteIndex] = {move.feedrate, distance / (move.feedrate / 60.0), move.dwell};
+    }
+    return played;
+}
+
+// An eight-note motif, repeated exactly, then transposed, then exactly again
+std::vector<MidiNote> song() {
+    const uint8_t motif[] = {60, 62, 64, 65, 67, 65, 64, 62};
+    const int transpositions[] = {0, 0, 5, 0};
+    std::vector<MidiNote> notes;
+    double time = 0.0;
+    for (int transposition : transpositions) {
+        for (size_t i = 0; i < 8; ++i) {
+            const double duration = i == 7 ? 0.5 : 0.2;
+            notes.push_back({static_cast<uint8_t>(motif[i] + transposition), 40, duration, time});
+            time += 0.25;
+        }
+    }
+    return notes;
+}
+
+// A sixteen-note pattern played over and over
+std::vector<MidiNote> loop(size_t count) {
+    const uint8_t pattern[] = {60, 62, 64, 65, 67, 65, 64, 62, 60, 67, 72, 67, 64, 60, 55, 57};
+    std::vector<MidiNote> notes;
+    for (size_t i = 0; i < count; ++i) {
+        notes.push_back({pattern[i % 16], 64, 0.1, i * 0.125});
+    }
+    return notes;
+}
+
+// Note moves the main file itself contains, as the preview counts them
+size_t noteLines(const std::string& gcode) {
+    size_t count = 0;
+    for (size_t at = gcode.find("; Note "); at != std::string::npos; at = gcode.find("; Note ", at + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+size_t totalSize(const GCodeProgram& program) {
+    size_t size = program.gcode.size();
+    for (const auto& file : program.sideFiles) size += file.second.size();
+    return size;
+}
+
+void checkSameNotes(const GCodeProgram& plain, const GCodeProgram& deduplicated, size_t noteCount) {
+    const std::map<size_t, Played> expected = playedNotes(plain);
+    const std::map<size_t, Played> actual = playedNotes(deduplicated);
+    check(actual.size() == expected.size() && actual.size() == noteCount, "every note is played once");
+    for (const auto& [index, note] : expected) {
+        auto it = actual.find(index);
+        if (it == actual.end()) continue;
+        check(it->second.feedrate == note.feedrate, "same feedrate per note");
+        check(std::abs(it->second.moveTime - note.moveTime) < 1e-4, "same move time per note");
+        check(it->second.dwell == note.dwell, "same hold per note");
+    }
+}
+
+const std::vector<ThumbnailSpec> kThumbnails = {{32, 32, ThumbnailFormat::Png}};
+
+GCodeProgram generate(FirmwareDialect dialect, bool deduplicate, const std::vector<MidiNote>& notes,
+                      double radiusScale = 0.5) {
+    GCodeGenerator generator;
+    generator.setFirmwareDialect(dialect);
+    generator.setRadiusScale(radiusScale);
+    generator.setPhraseDeduplication(deduplicate);
+    generator.setThumbnails(kThumbnails);
+    return generator.generateProgram(notes, GCodeGenerator::analyzeNotes(notes));
+}
+
+// The thumbnail the header should carry: the note moves as executed
+std::string executedThumbnail(const GCodeProgram& program) {
+    std::vector<ToolMove> notesOnly;
+    for (const ToolMove& move : program.moves) {
+        if (move.noteIndex != kNoSourceNote) notesOnly.push_back(move);
+    }
+    std::stringstream out;
+    writeThumbnails(out, notesOnly, kThumbnails);
+    return out.str();
+}
+
+} // namespace
+
+int main() {
+    const std::vector<MidiNote> notes = song();
+
+    for (FirmwareDialect dialect : {FirmwareDialect::Klipper, FirmwareDialect::RepRapFirmware}) {
+        const GCodeProgram plain = generate(dialect, false, notes);
+        const GCodeProgram deduplicated = generate(dialect, true, notes);
+        check(!deduplicated.sideFiles.empty(), "subroutine dialect: repeats become subroutines");
+
+        checkSameNotes(plain, deduplicated, notes.size());
+
+        for (const ToolMove& move : deduplicated.moves) {
+            check(move.x >= 0.0 && move.x <= 220.0 && move.y >= 0.0 && move.y <= 220.0, "replay stays on the bed");
+        }
+    }
+
+    // A loop calls the same few bodies throughout and comes out smaller, on
+    // the default spiral that reaches the edges of the bed
+    {
+        const std::vector<MidiNote> notes = loop(2000);
+        const GCodeProgram plain = generate(FirmwareDialect::Klipper, false, notes, 1.0);
+        const GCodeProgram deduplicated = generate(FirmwareDialect::Klipper, true, notes, 1.0);
+        check(deduplicated.sideFiles.size() == 1, "loop: one subroutine file");
+        check(totalSize(deduplicated) < totalSize(plain) * 3 / 4, "loop: output shrinks by a quarter or more");
+        checkSameNotes(plain, deduplicated, notes.size());
+        check(deduplicated.mainNotes.size() == noteLines(deduplicated.gcode) &&
+                  deduplicated.mainNotes.size() < notes.size(),
+              "loop: main notes are the note moves left in the main file");
+        check(deduplicated.gcode.find(executedThumbnail(deduplicated)) != std::string::npos,
+              "loop: thumbnail shows the executed path");
+        check(executedThumbnail(deduplicated) != executedThumbnail(plain),
+              "loop: replays move the executed path");
+    }
+
+    // Without subroutines the option changes nothing
+    for (FirmwareDialect dialect : {FirmwareDialect::Marlin, FirmwareDialect::Grbl}) {
+        const GCodeProgram plain = generate(dialect, false, notes);
+        const GCodeProgram deduplicated = generate(dialect, true, notes);
+        check(deduplicated.gcode == plain.gcode && deduplicated.sideFiles.empty(),
+              "no subroutines: program unchanged");
+    }
+
+    if (failures == 0) std::printf("phrase_dedup_test: passed\n");
+    return failures == 0 ? 0 : 1;
+}